@@ -0,0 +1,123 @@
+//
+//  BenchmarkStats.hpp
+//  Benchmark
+//
+//  Timing and summary statistics shared by the benchmark executables
+
+#ifndef BenchmarkStats_hpp
+#define BenchmarkStats_hpp
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+/// Monotonic time in nanoseconds
+inline double NowNanoseconds()
+{
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// Summary of a set of samples
+struct BenchmarkStats
+{
+    double mean;
+    double min;
+    double p50;
+    double p90;
+    double p99;
+    double max;
+
+    BenchmarkStats() : mean(0), min(0), p50(0), p90(0), p99(0), max(0) { }
+
+    /// Sorts a copy of the samples and picks nearest-rank percentiles
+    static BenchmarkStats FromSamples(std::vector<double> samples)
+    {
+        BenchmarkStats stats;
+        if (samples.empty())
+        {
+            return stats;
+        }
+
+        std::sort(samples.begin(), samples.end());
+
+        double total = 0;
+        for (size_t i = 0; i < samples.size(); i++)
+        {
+            total += samples[i];
+        }
+
+        stats.mean = total / samples.size();
+        stats.min = samples.front();
+        stats.max = samples.back();
+        stats.p50 = Percentile(samples, 0.50);
+        stats.p90 = Percentile(samples, 0.90);
+        stats.p99 = Percentile(samples, 0.99);
+        return stats;
+    }
+
+    /// Scale every value, e.g. to turn block time into time per frame
+    BenchmarkStats Scaled(double factor) const
+    {
+        BenchmarkStats stats(*this);
+        stats.mean *= factor;
+        stats.min *= factor;
+        stats.p50 *= factor;
+        stats.p90 *= factor;
+        stats.p99 *= factor;
+        stats.max *= factor;
+        return stats;
+    }
+
+    /// Write as a JSON object
+    void WriteJson(FILE* file) const
+    {
+        fprintf(file, "{\"mean\": %.6g, \"min\": %.6g, \"p50\": %.6g, \"p90\": %.6g, \"p99\": %.6g, \"max\": %.6g}", mean, min, p50, p90, p99, max);
+    }
+
+private:
+    static double Percentile(const std::vector<double>& sorted, double fraction)
+    {
+        size_t index = (size_t)(fraction * (sorted.size() - 1) + 0.5);
+        return sorted[std::min(index, sorted.size() - 1)];
+    }
+};
+
+/// Parse a comma separated list of integers, e.g. "64,128,256"
+inline std::vector<int> ParseIntList(const char* text)
+{
+    std::vector<int> values;
+    const char* cursor = text;
+    while (*cursor)
+    {
+        char* end = nullptr;
+        long value = strtol(cursor, &end, 10);
+        if (end == cursor)
+        {
+            break;
+        }
+        values.push_back((int)value);
+        cursor = (*end == ',') ? end + 1 : end;
+    }
+    return values;
+}
+
+/// Write a string as a JSON string literal
+inline void WriteJsonString(FILE* file, const std::string& text)
+{
+    fputc('"', file);
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        char c = text[i];
+        if (c == '"' || c == '\\')
+        {
+            fputc('\\', file);
+        }
+        fputc((unsigned char)c < 0x20 ? ' ' : c, file);
+    }
+    fputc('"', file);
+}
+
+#endif /* BenchmarkStats_hpp */
@@ -0,0 +1,454 @@
+//
+//  KernelBenchmark.cpp
+//  Benchmark
+//
+//  Isolated timings for the DelayUnit and CutoffFilter primitives the Reverb plugin is built from.
+//  Each kernel is called once per channel per frame over interleaved audio, the same pattern Plugin::Read uses.
+//  Read kernels advance the write head with TickChannel after each call as the reverb does,
+//  so TickChannel is also timed on its own to show its share. Block kernels report the same per sample cost.
+//  Cycles, instructions, branch misses and cache misses come from perf_event_open when it is available
+
+#include <algorithm>
+#include <functional>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "PluginHost.hpp"
+#include "BenchmarkStats.hpp"
+#include "PerfCounters.hpp"
+
+#include "DelayUnit.hpp"
+#include "CutoffFilter.hpp"
+#include "FixedDelay.hpp"
+
+/// Keeps the compiler from discarding kernel results
+static volatile float s_sink;
+
+struct KernelSettings
+{
+    int channels;
+    int frames;
+    int repeats;
+    int length;
+    DELAYSTORAGE storage;
+    DELAYINTERPOLATION interpolation;
+    std::string filter;
+};
+
+struct Kernel
+{
+    const char* name;
+    /// Runs the kernel over the given number of frames. Returns a value to feed the sink
+    std::function<float(int frames)> run;
+};
+
+static void WriteKernel(FILE* out, bool& first, PerfCounters& counters, bool perfOpen, const Kernel& kernel, const KernelSettings& settings)
+{
+    double calls = (double)settings.frames * settings.channels;
+    std::vector<double> nsPerCall;
+    uint64_t totals[PerfCounters::NUM_COUNTERS] = { 0 };
+    uint64_t timestampTotal = 0;
+
+    // One untimed pass to fault in memory and warm the caches
+    s_sink = kernel.run(settings.frames);
+
+    for (int r = 0; r < settings.repeats; r++)
+    {
+        if (perfOpen)
+        {
+            counters.Start();
+        }
+        uint64_t timestamp = PerfCounters::ReadTimestamp();
+        double start = NowNanoseconds();
+
+        float result = kernel.run(settings.frames);
+
+        double elapsed = NowNanoseconds() - start;
+        timestampTotal += PerfCounters::ReadTimestamp() - timestamp;
+        if (perfOpen)
+        {
+            counters.Stop();
+            for (int c = 0; c < PerfCounters::NUM_COUNTERS; c++)
+            {
+                totals[c] += counters.GetValue((PerfCounters::Counter)c);
+            }
+        }
+
+        s_sink = result;
+        nsPerCall.push_back(elapsed / calls);
+    }
+
+    double totalCalls = calls * settings.repeats;
+
+    fprintf(out, "%s\n    {\"kernel\": ", first ? "" : ",");
+    WriteJsonString(out, kernel.name);
+    fprintf(out, ", \"channels\": %d, \"calls\": %.0f,\n     \"ns_per_call\": ", settings.channels, calls);
+    BenchmarkStats::FromSamples(nsPerCall).WriteJson(out);
+
+    for (int c = 0; c < PerfCounters::NUM_COUNTERS; c++)
+    {
+        PerfCounters::Counter counter = (PerfCounters::Counter)c;
+        fprintf(out, ",\n     \"%s_per_call\": ", PerfCounters::GetName(counter));
+        if (perfOpen && counters.IsAvailable(counter))
+        {
+            fprintf(out, "%.6g", totals[c] / totalCalls);
+        }
+        else
+        {
+            fprintf(out, "null");
+        }
+    }
+
+    fprintf(out, ",\n     \"tsc_per_call\": ");
+    if (timestampTotal)
+    {
+        fprintf(out, "%.6g}", timestampTotal / totalCalls);
+    }
+    else
+    {
+        fprintf(out, "null}");
+    }
+
+    first = false;
+}
+
+static const char* GetStorageName(DELAYSTORAGE storage)
+{
+    switch (storage)
+    {
+        case DELAY_STORAGE_POWER_OF_TWO:
+            return "power_of_two";
+        case DELAY_STORAGE_PLANAR:
+            return "planar";
+        default:
+            return "linear";
+    }
+}
+
+static const char* GetInterpolationName(DELAYINTERPOLATION interpolation)
+{
+    switch (interpolation)
+    {
+        case DELAY_INTERPOLATION_HERMITE:
+            return "hermite";
+        case DELAY_INTERPOLATION_LAGRANGE:
+            return "lagrange";
+        case DELAY_INTERPOLATION_THIRAN:
+            return "thiran";
+        default:
+            return "linear";
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    KernelSettings settings;
+    settings.channels = 2;
+    settings.frames = 1 << 16;
+    settings.repeats = 9;
+    settings.length = 3164;     // longest line in the reverb tank
+    settings.storage = DELAY_STORAGE_LINEAR;
+    settings.interpolation = DELAY_INTERPOLATION_LINEAR;
+    const char* outPath = nullptr;
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool hasValue = i + 1 < argc;
+
+        if (strcmp(argv[i], "--channels") == 0 && hasValue)
+        {
+            settings.channels = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--frames") == 0 && hasValue)
+        {
+            settings.frames = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--repeats") == 0 && hasValue)
+        {
+            settings.repeats = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--length") == 0 && hasValue)
+        {
+            settings.length = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--pow2") == 0)
+        {
+            settings.storage = DELAY_STORAGE_POWER_OF_TWO;
+        }
+        else if (strcmp(argv[i], "--planar") == 0)
+        {
+            settings.storage = DELAY_STORAGE_PLANAR;
+        }
+        else if (strcmp(argv[i], "--interpolation") == 0 && hasValue)
+        {
+            const char* name = argv[++i];
+            settings.interpolation = DELAY_INTERPOLATION_LINEAR;
+            for (int mode = DELAY_INTERPOLATION_LINEAR; mode <= DELAY_INTERPOLATION_THIRAN; mode++)
+            {
+                if (strcmp(name, GetInterpolationName((DELAYINTERPOLATION)mode)) == 0)
+                {
+                    settings.interpolation = (DELAYINTERPOLATION)mode;
+                }
+            }
+        }
+        else if (strcmp(argv[i], "--filter") == 0 && hasValue)
+        {
+            settings.filter = argv[++i];
+        }
+        else if (strcmp(argv[i], "--out") == 0 && hasValue)
+        {
+            outPath = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr,
+                    "usage: %s [options]\n"
+                    "  --channels n   interleaved channels (default 2)\n"
+                    "  --frames n     frames per repeat (default 65536)\n"
+                    "  --repeats n    timed repeats (default 9)\n"
+                    "  --length n     delay line length in samples (default 3164)\n"
+                    "  --pow2         use power of two DelayUnit storage\n"
+                    "  --planar       use planar DelayUnit storage, one lane per channel\n"
+                    "  --interpolation linear|hermite|lagrange|thiran\n"
+                    "                 interpolation for fractional DelayUnit reads (default linear)\n"
+                    "  --filter text  only run kernels whose name contains text\n"
+                    "  --out file     write JSON to a file instead of stdout\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (settings.channels <= 0 || settings.frames <= 0 || settings.repeats <= 0 || settings.length < 2)
+    {
+        fprintf(stderr, "channels, frames and repeats must be positive and length at least 2\n");
+        return 1;
+    }
+
+    // The primitives only need a DSP state that can answer FMOD_DSP_GETSAMPLERATE
+    PluginHost host(48000, 1024);
+    FMOD_DSP_STATE dsp_state;
+    memset(&dsp_state, 0, sizeof(dsp_state));
+    dsp_state.instance = &host;
+    dsp_state.functions = host.GetFunctions();
+
+    const int channels = settings.channels;
+    const int tap = settings.length - 1;
+    const float tapMs = SAMPLES_TO_MS(tap - 0.5f, (float)host.GetSampleRate());
+
+    DelayUnit delay;
+    delay.Init(&dsp_state, settings.length);
+    delay.SetStorage(settings.storage);
+    delay.SetInterpolation(settings.interpolation);
+    delay.SetDelayTime(tapMs);
+    delay.CreateBuffers(channels);
+
+    // The reverb's longest line, with its tap fixed at compile time
+    FixedDelay<3164> fixedDelay;
+    fixedDelay.Init(&dsp_state);
+    fixedDelay.CreateBuffers(channels);
+
+    CutoffFilter filter;
+    filter.Init(&dsp_state);
+    filter.SetCutoff(8000.0f);
+
+    std::vector<float> input(settings.frames * channels), output(settings.frames * channels);
+    unsigned int seed = 1;
+    for (size_t i = 0; i < input.size(); i++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        input[i] = ((seed >> 8) / (float)(1 << 24)) - 0.5f;
+    }
+
+    std::vector<Kernel> kernels;
+
+    kernels.push_back({ "DelayUnit::TickChannel", [&](int frames)
+    {
+        for (int i = 0; i < frames * channels; i++)
+        {
+            delay.TickChannel();
+        }
+        return 0.0f;
+    } });
+
+    kernels.push_back({ "DelayUnit::WriteDelay", [&](int frames)
+    {
+        const float* in = input.data();
+        for (int i = 0; i < frames * channels; i++)
+        {
+            delay.WriteDelay(*in++);
+            delay.TickChannel();
+        }
+        return 0.0f;
+    } });
+
+    kernels.push_back({ "DelayUnit::GetDelayedSampleAt(int)", [&](int frames)
+    {
+        float sum = 0.0f;
+        for (int i = 0; i < frames * channels; i++)
+        {
+            sum += delay.GetDelayedSampleAt(tap);
+            delay.TickChannel();
+        }
+        return sum;
+    } });
+
+    kernels.push_back({ "DelayUnit::GetDelayedSampleAt(float)", [&](int frames)
+    {
+        float sum = 0.0f;
+        for (int i = 0; i < frames * channels; i++)
+        {
+            sum += delay.GetDelayedSampleAt(tapMs);
+            delay.TickChannel();
+        }
+        return sum;
+    } });
+
+    kernels.push_back({ "DelayUnit::GetDelayedSample", [&](int frames)
+    {
+        float sum = 0.0f;
+        for (int i = 0; i < frames * channels; i++)
+        {
+            sum += delay.GetDelayedSample();
+            delay.TickChannel();
+        }
+        return sum;
+    } });
+
+    kernels.push_back({ "FixedDelay<3164>::GetDelayedSampleAt<3163>", [&](int frames)
+    {
+        float sum = 0.0f;
+        const float* in = input.data();
+        for (int i = 0; i < frames * channels; i++)
+        {
+            sum += fixedDelay.GetDelayedSampleAt<3163>();
+            fixedDelay.WriteDelay(*in++);
+            fixedDelay.TickChannel();
+        }
+        return sum;
+    } });
+
+    // Multi-tap kernels read eight taps spread over the back half of the line, as separate calls and in one call
+    const int numTaps = 8;
+    int taps[numTaps];
+    float gains[numTaps];
+    for (int k = 0; k < numTaps; k++)
+    {
+        taps[k] = std::max(1, tap - k * (settings.length / (2 * numTaps)));
+        gains[k] = 1.0f / (k + 1);
+    }
+
+    kernels.push_back({ "DelayUnit::GetDelayedSampleAt(int) x8", [&](int frames)
+    {
+        float sum = 0.0f;
+        for (int i = 0; i < frames * channels; i++)
+        {
+            for (int k = 0; k < numTaps; k++)
+            {
+                sum += delay.GetDelayedSampleAt(taps[k]) * gains[k];
+            }
+            delay.TickChannel();
+        }
+        return sum;
+    } });
+
+    kernels.push_back({ "DelayUnit::GetDelayedSampleTaps x8", [&](int frames)
+    {
+        float sum = 0.0f;
+        for (int i = 0; i < frames * channels; i++)
+        {
+            sum += delay.GetDelayedSampleTaps(taps, gains, numTaps);
+            delay.TickChannel();
+        }
+        return sum;
+    } });
+
+    // Block kernels move the same number of samples in calls of up to DELAY_UNIT_BLOCK_SAMPLES
+    const int blockFrames = std::max(1, DELAY_UNIT_BLOCK_SAMPLES / channels);
+
+    kernels.push_back({ "DelayUnit::WriteBlock", [&](int frames)
+    {
+        for (int i = 0; i < frames; i += blockFrames)
+        {
+            delay.WriteBlock(input.data() + i * channels, std::min(blockFrames, frames - i));
+        }
+        return 0.0f;
+    } });
+
+    kernels.push_back({ "DelayUnit::ReadBlock", [&](int frames)
+    {
+        for (int i = 0; i < frames; i += blockFrames)
+        {
+            int pass = std::min(blockFrames, frames - i);
+            delay.ReadBlock(output.data() + i * channels, pass, tapMs);
+            delay.WriteBlock(input.data() + i * channels, pass);
+        }
+        return output[0];
+    } });
+
+    kernels.push_back({ "DelayUnit::ReadBlockTaps x8", [&](int frames)
+    {
+        for (int i = 0; i < frames; i += blockFrames)
+        {
+            int pass = std::min(blockFrames, frames - i);
+            delay.ReadBlockTaps(output.data() + i * channels, pass, taps, gains, numTaps);
+            delay.WriteBlock(input.data() + i * channels, pass);
+        }
+        return output[0];
+    } });
+
+    kernels.push_back({ "DelayUnit::ProcessBlock", [&](int frames)
+    {
+        delay.ProcessBlock(input.data(), output.data(), frames);
+        return output[0];
+    } });
+
+    kernels.push_back({ "CutoffFilter::Read", [&](int frames)
+    {
+        filter.Read(input.data(), output.data(), frames, channels);
+        return output[0];
+    } });
+
+    kernels.push_back({ "CutoffFilter::ReadSingle", [&](int frames)
+    {
+        float* in = input.data();
+        float* out = output.data();
+        for (int i = 0; i < frames * channels; i++)
+        {
+            filter.ReadSingle(in++, out++, channels);
+        }
+        return output[0];
+    } });
+
+    FILE* out = outPath ? fopen(outPath, "w") : stdout;
+    if (!out)
+    {
+        fprintf(stderr, "Could not open %s\n", outPath);
+        return 1;
+    }
+
+    PerfCounters counters;
+    bool perfOpen = counters.Open();
+
+    fprintf(out, "{\"benchmark\": \"kernels\", \"perf_events\": %s, \"delay_length\": %d, \"storage\": \"%s\", \"interpolation\": \"%s\", \"results\": [", perfOpen ? "true" : "false", settings.length, GetStorageName(settings.storage), GetInterpolationName(settings.interpolation));
+
+    bool first = true;
+    for (size_t k = 0; k < kernels.size(); k++)
+    {
+        if (settings.filter.empty() || std::string(kernels[k].name).find(settings.filter) != std::string::npos)
+        {
+            WriteKernel(out, first, counters, perfOpen, kernels[k], settings);
+        }
+    }
+
+    fprintf(out, "\n]}\n");
+
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+
+    return 0;
+}
@@ -0,0 +1,141 @@
+//
+//  PerfCounters.cpp
+//  Benchmark
+//
+
+#include "PerfCounters.hpp"
+
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+PerfCounters::PerfCounters()
+{
+    for (int i = 0; i < NUM_COUNTERS; i++)
+    {
+        m_fds[i] = -1;
+        m_values[i] = 0;
+    }
+}
+
+PerfCounters::~PerfCounters()
+{
+    Close();
+}
+
+bool PerfCounters::Open()
+{
+#if defined(__linux__)
+    static const uint64_t configs[NUM_COUNTERS] =
+    {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_BRANCH_MISSES,
+        PERF_COUNT_HW_CACHE_MISSES
+    };
+
+    bool opened = false;
+
+    for (int i = 0; i < NUM_COUNTERS; i++)
+    {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = configs[i];
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        m_fds[i] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        opened = opened || m_fds[i] >= 0;
+    }
+
+    return opened;
+#else
+    return false;
+#endif
+}
+
+void PerfCounters::Close()
+{
+    for (int i = 0; i < NUM_COUNTERS; i++)
+    {
+        if (m_fds[i] >= 0)
+        {
+            close(m_fds[i]);
+            m_fds[i] = -1;
+        }
+    }
+}
+
+void PerfCounters::Start()
+{
+#if defined(__linux__)
+    for (int i = 0; i < NUM_COUNTERS; i++)
+    {
+        if (m_fds[i] >= 0)
+        {
+            ioctl(m_fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(m_fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+}
+
+void PerfCounters::Stop()
+{
+#if defined(__linux__)
+    for (int i = 0; i < NUM_COUNTERS; i++)
+    {
+        if (m_fds[i] >= 0)
+        {
+            ioctl(m_fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+
+    for (int i = 0; i < NUM_COUNTERS; i++)
+    {
+        m_values[i] = 0;
+        if (m_fds[i] >= 0 && read(m_fds[i], &m_values[i], sizeof(uint64_t)) != sizeof(uint64_t))
+        {
+            m_values[i] = 0;
+        }
+    }
+#endif
+}
+
+const char* PerfCounters::GetName(Counter counter)
+{
+    switch (counter)
+    {
+        case CYCLES:
+            return "cycles";
+        case INSTRUCTIONS:
+            return "instructions";
+        case BRANCH_MISSES:
+            return "branch_misses";
+        case CACHE_MISSES:
+            return "cache_misses";
+        default:
+            return "unknown";
+    }
+}
+
+uint64_t PerfCounters::ReadTimestamp()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,58 @@
+//
+//  PerfCounters.hpp
+//  Benchmark
+//
+//  Hardware counters through perf_event_open. Every counter is optional: kernels, VMs and
+//  containers often refuse some or all of them, in which case the counter reads as unavailable
+
+#ifndef PerfCounters_hpp
+#define PerfCounters_hpp
+
+#include <stdint.h>
+
+class PerfCounters
+{
+public:
+    enum Counter
+    {
+        CYCLES = 0,
+        INSTRUCTIONS,
+        BRANCH_MISSES,
+        CACHE_MISSES,
+        NUM_COUNTERS
+    };
+
+    PerfCounters();
+
+    ~PerfCounters();
+
+    /// Open every counter the system allows. Returns true if at least one opened
+    bool Open ();
+
+    /// Close all counters
+    void Close ();
+
+    /// Reset and start counting
+    void Start ();
+
+    /// Stop counting and latch the values
+    void Stop ();
+
+    /// True if the counter opened
+    bool IsAvailable (Counter counter) const { return m_fds[counter] >= 0; }
+
+    /// Value latched by the last Stop
+    uint64_t GetValue (Counter counter) const { return m_values[counter]; }
+
+    /// Name used in benchmark output
+    static const char* GetName (Counter counter);
+
+    /// Time stamp counter, used for cycles when perf is not available. Returns 0 where there is none
+    static uint64_t ReadTimestamp ();
+
+private:
+    int m_fds[NUM_COUNTERS];
+    uint64_t m_values[NUM_COUNTERS];
+};
+
+#endif /* PerfCounters_hpp */
@@ -0,0 +1,400 @@
+//
+//  PluginBenchmark.cpp
+//  Benchmark
+//
+//  End-to-end throughput of every plugin's process callback, driven through PluginHost.
+//  Runs a grid of block lengths, channel counts and sample rates and writes the results as JSON.
+//  With --tail it instead times each plugin ringing out after its input stops, where feedback that decays into
+//  subnormal floats shows up as blocks getting slower
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "PluginHost.hpp"
+#include "BenchmarkStats.hpp"
+
+#ifndef PLUGIN_DIR
+#define PLUGIN_DIR "plugins"
+#endif
+
+/// A parameter override given on the command line as Name=value
+struct ParameterOverride
+{
+    std::string name;
+    float value;
+};
+
+struct BenchmarkSettings
+{
+    std::vector<int> blockLengths;
+    std::vector<int> channelCounts;
+    std::vector<int> sampleRates;
+    std::vector<ParameterOverride> parameters;
+    std::string filter;
+    int warmupBlocks;
+    int measuredBlocks;
+    float tailSeconds;
+    int tailWindows;
+};
+
+/// Small deterministic noise source so every run sees the same input
+static float NextNoise(unsigned int& seed)
+{
+    seed = seed * 1664525u + 1013904223u;
+    return ((seed >> 8) / (float)(1 << 24)) * 2.0f - 1.0f;
+}
+
+/// Apply any overrides whose name matches one of the plugin's parameters
+static void ApplyParameters(PluginHost& host, PluginInstance& instance, const std::vector<ParameterOverride>& parameters)
+{
+    FMOD_DSP_DESCRIPTION* description = host.GetDescription();
+
+    for (size_t p = 0; p < parameters.size(); p++)
+    {
+        for (int i = 0; i < description->numparameters; i++)
+        {
+            FMOD_DSP_PARAMETER_DESC* param = description->paramdesc[i];
+            if (parameters[p].name != param->name)
+            {
+                continue;
+            }
+
+            switch (param->type)
+            {
+                case FMOD_DSP_PARAMETER_TYPE_FLOAT:
+                    instance.SetParameterFloat(i, parameters[p].value);
+                    break;
+
+                case FMOD_DSP_PARAMETER_TYPE_INT:
+                    instance.SetParameterInt(i, (int)parameters[p].value);
+                    break;
+
+                case FMOD_DSP_PARAMETER_TYPE_BOOL:
+                    instance.SetParameterBool(i, parameters[p].value != 0.0f);
+                    break;
+
+                default:
+                    break;
+            }
+        }
+    }
+}
+
+/// Time one configuration and write its JSON object. Returns false if the plugin failed
+static bool RunConfiguration(FILE* out, bool& first, PluginHost& host, const BenchmarkSettings& settings, int sampleRate, int blockLength, int channels)
+{
+    host.SetSampleRate(sampleRate);
+    host.SetBlockSize(blockLength);
+    host.SetSpeakerMode(PluginHost::SpeakerModeForChannels(channels));
+
+    PluginInstance instance(&host);
+    if (instance.Create() != FMOD_OK)
+    {
+        return false;
+    }
+    ApplyParameters(host, instance, settings.parameters);
+
+    std::vector<float> inbuffer(blockLength * channels), outbuffer(blockLength * channels);
+    unsigned int seed = 1;
+    for (size_t i = 0; i < inbuffer.size(); i++)
+    {
+        inbuffer[i] = NextNoise(seed) * 0.5f;
+    }
+
+    std::vector<double> blockTimes;
+    blockTimes.reserve(settings.measuredBlocks);
+
+    for (int block = 0; block < settings.warmupBlocks + settings.measuredBlocks; block++)
+    {
+        host.BeginMix();
+        double start = NowNanoseconds();
+        FMOD_RESULT result = instance.Process(inbuffer.data(), outbuffer.data(), blockLength, channels, false);
+        double elapsed = NowNanoseconds() - start;
+        host.EndMix();
+
+        if (result != FMOD_OK)
+        {
+            return false;
+        }
+
+        if (block >= settings.warmupBlocks)
+        {
+            blockTimes.push_back(elapsed);
+        }
+    }
+
+    instance.Release();
+
+    BenchmarkStats blockStats = BenchmarkStats::FromSamples(blockTimes);
+    double blockDurationNs = (double)blockLength * 1.0e9 / sampleRate;
+    BenchmarkStats perFrameChannel = blockStats.Scaled(1.0 / ((double)blockLength * channels));
+    BenchmarkStats budget = blockStats.Scaled(1.0 / blockDurationNs);
+
+    fprintf(out, "%s\n    {\"plugin\": ", first ? "" : ",");
+    WriteJsonString(out, host.GetDescription()->name);
+    fprintf(out, ", \"file\": ");
+    WriteJsonString(out, host.GetPath());
+    fprintf(out, ", \"sample_rate\": %d, \"block_length\": %d, \"channels\": %d, \"blocks\": %d,\n", sampleRate, blockLength, channels, settings.measuredBlocks);
+    fprintf(out, "     \"ns_per_frame_channel\": ");
+    perFrameChannel.WriteJson(out);
+    fprintf(out, ",\n     \"block_ns\": ");
+    blockStats.WriteJson(out);
+    fprintf(out, ",\n     \"realtime_budget\": ");
+    budget.WriteJson(out);
+    fprintf(out, ",\n     \"voices_per_core\": %.6g}", budget.mean > 0 ? 1.0 / budget.mean : 0.0);
+
+    first = false;
+    return true;
+}
+
+/// Feed noise through the warmup blocks, then silence for the length of the tail, and write the block times of each
+/// stretch of the tail as a JSON object. Returns false if the plugin failed
+static bool RunTail(FILE* out, bool& first, PluginHost& host, const BenchmarkSettings& settings, int sampleRate, int blockLength, int channels)
+{
+    host.SetSampleRate(sampleRate);
+    host.SetBlockSize(blockLength);
+    host.SetSpeakerMode(PluginHost::SpeakerModeForChannels(channels));
+
+    PluginInstance instance(&host);
+    if (instance.Create() != FMOD_OK)
+    {
+        return false;
+    }
+    ApplyParameters(host, instance, settings.parameters);
+
+    std::vector<float> inbuffer(blockLength * channels), silence(blockLength * channels, 0.0f), outbuffer(blockLength * channels);
+    unsigned int seed = 1;
+
+    const int windowBlocks = std::max(1, (int)(settings.tailSeconds * sampleRate / blockLength) / settings.tailWindows);
+    std::vector<BenchmarkStats> windows;
+    std::vector<double> blockTimes;
+    blockTimes.reserve(windowBlocks);
+
+    for (int block = 0; block < settings.warmupBlocks + windowBlocks * settings.tailWindows; block++)
+    {
+        bool warmup = block < settings.warmupBlocks;
+        if (warmup)
+        {
+            for (size_t i = 0; i < inbuffer.size(); i++)
+            {
+                inbuffer[i] = NextNoise(seed) * 0.5f;
+            }
+        }
+
+        // The input is silent but not idle, so every plugin keeps processing its tail however quiet it gets
+        host.BeginMix();
+        double start = NowNanoseconds();
+        FMOD_RESULT result = instance.Process(warmup ? inbuffer.data() : silence.data(), outbuffer.data(), blockLength, channels, false);
+        double elapsed = NowNanoseconds() - start;
+        host.EndMix();
+
+        if (result != FMOD_OK)
+        {
+            return false;
+        }
+
+        if (!warmup)
+        {
+            blockTimes.push_back(elapsed);
+            if ((int)blockTimes.size() == windowBlocks)
+            {
+                windows.push_back(BenchmarkStats::FromSamples(blockTimes));
+                blockTimes.clear();
+            }
+        }
+    }
+
+    instance.Release();
+
+    // A flat tail has every stretch as fast as the first, however quiet the feedback has become
+    double slowest = 0;
+    for (size_t w = 0; w < windows.size(); w++)
+    {
+        slowest = std::max(slowest, windows[w].p50);
+    }
+
+    fprintf(out, "%s\n    {\"plugin\": ", first ? "" : ",");
+    WriteJsonString(out, host.GetDescription()->name);
+    fprintf(out, ", \"file\": ");
+    WriteJsonString(out, host.GetPath());
+    fprintf(out, ", \"sample_rate\": %d, \"block_length\": %d, \"channels\": %d, \"tail_seconds\": %g, \"window_blocks\": %d,\n", sampleRate, blockLength, channels, settings.tailSeconds, windowBlocks);
+    fprintf(out, "     \"window_block_ns\": [");
+    for (size_t w = 0; w < windows.size(); w++)
+    {
+        fprintf(out, "%s\n       ", w ? "," : "");
+        windows[w].WriteJson(out);
+    }
+    fprintf(out, "],\n     \"slowest_to_first_p50\": %.6g}", windows[0].p50 > 0 ? slowest / windows[0].p50 : 0.0);
+
+    first = false;
+    return true;
+}
+
+static void PrintUsage(const char* program)
+{
+    fprintf(stderr,
+            "usage: %s [options] [plugin.so...]\n"
+            "  --blocks 64,128,...      block lengths in frames (default 64,128,256,512,1024,2048,4096)\n"
+            "  --channels 1,2,6,8,12    channel counts\n"
+            "  --rates 44100,48000,...  sample rates\n"
+            "  --iterations n           measured blocks per configuration (default 64)\n"
+            "  --warmup n               unmeasured blocks before timing (default 8)\n"
+            "  --param Name=value       set a parameter on every plugin that has it, may repeat\n"
+            "  --filter text            only run plugins whose name or path contains text\n"
+            "  --tail seconds           time silence after the warmup noise instead, in stretches of the tail\n"
+            "  --windows n              stretches the tail is split into (default 16)\n"
+            "  --out file.json          write results to a file instead of stdout\n", program);
+}
+
+int main(int argc, char* argv[])
+{
+    BenchmarkSettings settings;
+    settings.blockLengths = ParseIntList("64,128,256,512,1024,2048,4096");
+    settings.channelCounts = ParseIntList("1,2,6,8,12");
+    settings.sampleRates = ParseIntList("44100,48000,96000");
+    settings.warmupBlocks = 8;
+    settings.measuredBlocks = 64;
+    settings.tailSeconds = 0.0f;
+    settings.tailWindows = 16;
+
+    const char* outPath = nullptr;
+    std::vector<std::string> paths;
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool hasValue = i + 1 < argc;
+
+        if (strcmp(argv[i], "--blocks") == 0 && hasValue)
+        {
+            settings.blockLengths = ParseIntList(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--channels") == 0 && hasValue)
+        {
+            settings.channelCounts = ParseIntList(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--rates") == 0 && hasValue)
+        {
+            settings.sampleRates = ParseIntList(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--iterations") == 0 && hasValue)
+        {
+            settings.measuredBlocks = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--warmup") == 0 && hasValue)
+        {
+            settings.warmupBlocks = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--param") == 0 && hasValue)
+        {
+            const char* text = argv[++i];
+            const char* equals = strchr(text, '=');
+            if (!equals)
+            {
+                PrintUsage(argv[0]);
+                return 1;
+            }
+
+            ParameterOverride parameter;
+            parameter.name = std::string(text, equals - text);
+            parameter.value = (float)atof(equals + 1);
+            settings.parameters.push_back(parameter);
+        }
+        else if (strcmp(argv[i], "--filter") == 0 && hasValue)
+        {
+            settings.filter = argv[++i];
+        }
+        else if (strcmp(argv[i], "--tail") == 0 && hasValue)
+        {
+            settings.tailSeconds = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--windows") == 0 && hasValue)
+        {
+            settings.tailWindows = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--out") == 0 && hasValue)
+        {
+            outPath = argv[++i];
+        }
+        else if (argv[i][0] == '-')
+        {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+        else
+        {
+            paths.push_back(argv[i]);
+        }
+    }
+
+    if (paths.empty())
+    {
+        paths = PluginHost::FindPlugins(PLUGIN_DIR);
+    }
+
+    if (paths.empty() || settings.measuredBlocks <= 0 || settings.tailSeconds < 0 || settings.tailWindows <= 0)
+    {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    FILE* out = outPath ? fopen(outPath, "w") : stdout;
+    if (!out)
+    {
+        fprintf(stderr, "Could not open %s\n", outPath);
+        return 1;
+    }
+
+    bool tail = settings.tailSeconds > 0;
+    fprintf(out, "{\"benchmark\": \"%s\", \"warmup_blocks\": %d, \"results\": [", tail ? "plugin_tails" : "plugins", settings.warmupBlocks);
+
+    int failures = 0;
+    bool first = true;
+
+    for (size_t p = 0; p < paths.size(); p++)
+    {
+        PluginHost host;
+        if (!host.Load(paths[p].c_str()))
+        {
+            failures++;
+            continue;
+        }
+
+        if (!settings.filter.empty() && paths[p].find(settings.filter) == std::string::npos && std::string(host.GetDescription()->name).find(settings.filter) == std::string::npos)
+        {
+            continue;
+        }
+
+        fprintf(stderr, "%s\n", host.GetDescription()->name);
+
+        for (size_t r = 0; r < settings.sampleRates.size(); r++)
+        {
+            for (size_t c = 0; c < settings.channelCounts.size(); c++)
+            {
+                for (size_t b = 0; b < settings.blockLengths.size(); b++)
+                {
+                    bool ran = tail ? RunTail(out, first, host, settings, settings.sampleRates[r], settings.blockLengths[b], settings.channelCounts[c])
+                                    : RunConfiguration(out, first, host, settings, settings.sampleRates[r], settings.blockLengths[b], settings.channelCounts[c]);
+                    if (!ran)
+                    {
+                        fprintf(stderr, "  failed at %d Hz, %d frames, %d channels\n", settings.sampleRates[r], settings.blockLengths[b], settings.channelCounts[c]);
+                        failures++;
+                    }
+                }
+            }
+        }
+    }
+
+    fprintf(out, "\n]}\n");
+
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,99 @@
+//
+//  DenormalGuard.hpp
+//  Common
+//
+//  Keeps decaying feedback out of subnormal floats, which many CPUs work on many times slower than normal ones.
+//  A guard turns on flush to zero and denormals are zero for the thread while it is in scope, and puts the thread
+//  back how it found it afterwards. Builds for CPUs without those flags zero quiet feedback in code instead
+//
+
+#ifndef DenormalGuard_hpp
+#define DenormalGuard_hpp
+
+#include <math.h>
+#include <stdint.h>
+
+// Define DENORMAL_GUARD_PORTABLE to use the fallback even where the flags exist, e.g. to compare the two
+#if !defined(DENORMAL_GUARD_PORTABLE) && (defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+#include <xmmintrin.h>
+#define DENORMAL_GUARD_SSE 1
+#elif !defined(DENORMAL_GUARD_PORTABLE) && defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__))
+#define DENORMAL_GUARD_AARCH64 1
+#endif
+
+#if defined(DENORMAL_GUARD_SSE) || defined(DENORMAL_GUARD_AARCH64)
+#define DENORMAL_GUARD_HARDWARE 1
+#else
+#define DENORMAL_GUARD_HARDWARE 0
+#endif
+
+/// Level the fallback treats feedback below as silence, 300dB down, far above the smallest normal float
+const float DENORMAL_FLUSH_LEVEL = 1.0e-15f;
+
+/// Zero a sample that is fed back once it is too quiet to hear, before it can decay into a subnormal.
+/// Returns the sample untouched when the guard sets the flags, so builds that have them are unchanged
+inline float FlushDenormal(float value)
+{
+#if DENORMAL_GUARD_HARDWARE
+    return value;
+#else
+    return (fabsf(value) < DENORMAL_FLUSH_LEVEL) ? 0.0f : value;
+#endif
+}
+
+/// Flush to zero and denormals are zero for the current thread, for as long as the guard is in scope.
+/// Put one at the top of each process call. The flags are only written when they are not already set
+class DenormalGuard
+{
+public:
+    DenormalGuard()
+    {
+#if defined(DENORMAL_GUARD_SSE)
+        // MXCSR bit 15 flushes results, bit 6 treats inputs as zero
+        m_saved = _mm_getcsr();
+        m_changed = (m_saved & 0x8040) != 0x8040;
+        if (m_changed)
+        {
+            _mm_setcsr(m_saved | 0x8040);
+        }
+#elif defined(DENORMAL_GUARD_AARCH64)
+        // FPCR bit 24 flushes both inputs and results
+        __asm__ __volatile__("mrs %0, fpcr" : "=r"(m_saved));
+        m_changed = (m_saved & (1u << 24)) == 0;
+        if (m_changed)
+        {
+            uint64_t fpcr = m_saved | (1u << 24);
+            __asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr));
+        }
+#endif
+    }
+
+    ~DenormalGuard()
+    {
+#if defined(DENORMAL_GUARD_SSE)
+        if (m_changed)
+        {
+            _mm_setcsr(m_saved);
+        }
+#elif defined(DENORMAL_GUARD_AARCH64)
+        if (m_changed)
+        {
+            __asm__ __volatile__("msr fpcr, %0" : : "r"(m_saved));
+        }
+#endif
+    }
+
+private:
+    DenormalGuard(const DenormalGuard&);
+    DenormalGuard& operator=(const DenormalGuard&);
+
+#if defined(DENORMAL_GUARD_SSE)
+    unsigned int m_saved;
+    bool m_changed;
+#elif defined(DENORMAL_GUARD_AARCH64)
+    uint64_t m_saved;
+    bool m_changed;
+#endif
+};
+
+#endif /* DenormalGuard_hpp */
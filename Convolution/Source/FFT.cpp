@@ -0,0 +1,149 @@
+//
+//  FFT.cpp
+//  Convolution
+//
+
+#include "FFT.hpp"
+
+#include <math.h>
+
+void FFT::Init(int size)
+{
+    m_size = size;
+    m_half = size / 2;
+
+    int bits = 0;
+    while ((1 << bits) < m_half)
+    {
+        bits++;
+    }
+
+    m_bitReverse.resize(m_half);
+    for (int i = 0; i < m_half; i++)
+    {
+        int reversed = 0;
+        for (int b = 0; b < bits; b++)
+        {
+            reversed |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        m_bitReverse[i] = reversed;
+    }
+
+    // A stage whose butterflies are span apart keeps its span twiddles from index span - 1
+    m_twiddleRe.resize(m_half);
+    m_twiddleIm.resize(m_half);
+    for (int span = 1; span < m_half; span <<= 1)
+    {
+        for (int k = 0; k < span; k++)
+        {
+            double angle = -M_PI * k / span;
+            m_twiddleRe[span - 1 + k] = (float)cos(angle);
+            m_twiddleIm[span - 1 + k] = (float)sin(angle);
+        }
+    }
+
+    m_splitRe.resize(m_half + 1);
+    m_splitIm.resize(m_half + 1);
+    for (int k = 0; k <= m_half; k++)
+    {
+        double angle = -2.0 * M_PI * k / m_size;
+        m_splitRe[k] = (float)cos(angle);
+        m_splitIm[k] = (float)sin(angle);
+    }
+
+    m_workRe.assign(m_half, 0.0f);
+    m_workIm.assign(m_half, 0.0f);
+}
+
+void FFT::Transform(float* re, float* im) const
+{
+    for (int span = 1; span < m_half; span <<= 1)
+    {
+        const float* twiddleRe = &m_twiddleRe[span - 1];
+        const float* twiddleIm = &m_twiddleIm[span - 1];
+
+        for (int start = 0; start < m_half; start += span * 2)
+        {
+            float* aRe = re + start;
+            float* aIm = im + start;
+            float* bRe = aRe + span;
+            float* bIm = aIm + span;
+
+            for (int k = 0; k < span; k++)
+            {
+                float tRe = (bRe[k] * twiddleRe[k]) - (bIm[k] * twiddleIm[k]);
+                float tIm = (bRe[k] * twiddleIm[k]) + (bIm[k] * twiddleRe[k]);
+
+                bRe[k] = aRe[k] - tRe;
+                bIm[k] = aIm[k] - tIm;
+                aRe[k] += tRe;
+                aIm[k] += tIm;
+            }
+        }
+    }
+}
+
+void FFT::Forward(const float* input, float* re, float* im)
+{
+    // Pack even samples into the real parts and odd samples into the imaginary parts
+    float* workRe = m_workRe.data();
+    float* workIm = m_workIm.data();
+    for (int n = 0; n < m_half; n++)
+    {
+        workRe[m_bitReverse[n]] = input[n * 2];
+        workIm[m_bitReverse[n]] = input[n * 2 + 1];
+    }
+
+    Transform(workRe, workIm);
+
+    // Separate the even and odd spectra and join them with one more butterfly
+    for (int k = 0; k <= m_half; k++)
+    {
+        int a = (k == m_half) ? 0 : k;
+        int b = (k == 0) ? 0 : m_half - k;
+
+        float aRe = workRe[a], aIm = workIm[a];
+        float bRe = workRe[b], bIm = -workIm[b];
+
+        float evenRe = (aRe + bRe) * 0.5f;
+        float evenIm = (aIm + bIm) * 0.5f;
+        float oddRe = (aIm - bIm) * 0.5f;
+        float oddIm = (bRe - aRe) * 0.5f;
+
+        re[k] = evenRe + (oddRe * m_splitRe[k]) - (oddIm * m_splitIm[k]);
+        im[k] = evenIm + (oddRe * m_splitIm[k]) + (oddIm * m_splitRe[k]);
+    }
+}
+
+void FFT::Inverse(const float* re, const float* im, float* output)
+{
+    // Rebuild the even and odd spectra and pack them as one complex spectrum, in bit reversed order
+    float* workRe = m_workRe.data();
+    float* workIm = m_workIm.data();
+    for (int k = 0; k < m_half; k++)
+    {
+        float aRe = re[k], aIm = im[k];
+        float bRe = re[m_half - k], bIm = -im[m_half - k];
+
+        float evenRe = aRe + bRe;
+        float evenIm = aIm + bIm;
+        float diffRe = aRe - bRe;
+        float diffIm = aIm - bIm;
+
+        // The odd spectrum is the difference turned back by the split twiddle
+        float oddRe = (diffRe * m_splitRe[k]) + (diffIm * m_splitIm[k]);
+        float oddIm = (diffIm * m_splitRe[k]) - (diffRe * m_splitIm[k]);
+
+        workRe[m_bitReverse[k]] = evenRe - oddIm;
+        workIm[m_bitReverse[k]] = evenIm + oddRe;
+    }
+
+    // Swapping real and imaginary parts turns the forward transform into the inverse
+    Transform(workIm, workRe);
+
+    for (int n = 0; n < m_half; n++)
+    {
+        output[n * 2] = workRe[n];
+        output[n * 2 + 1] = workIm[n];
+    }
+}
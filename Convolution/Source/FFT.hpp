@@ -0,0 +1,62 @@
+//
+//  FFT.hpp
+//  Convolution
+//
+//  Real FFT of a power of two size, done as a complex FFT of half the size. Spectra are kept as separate real and
+//  imaginary arrays so loops over bins vectorise
+//
+
+#ifndef FFT_hpp
+#define FFT_hpp
+
+#include <vector>
+
+class FFT
+{
+public:
+    FFT() :
+    m_size(0),
+    m_half(0)
+    { }
+
+    /// Prepare for transforms of size real samples. Size must be a power of two of at least 4. Allocates
+    void Init (int size);
+
+    /// Number of real samples in a transform
+    int GetSize () const { return m_size; }
+
+    /// Number of bins in a spectrum, from DC to Nyquist
+    int GetBins () const { return m_half + 1; }
+
+    /// Spectrum of GetSize real samples, written as GetBins real and imaginary parts
+    void Forward (const float* input, float* re, float* im);
+
+    /// GetSize real samples from GetBins real and imaginary parts. Not scaled, so the signal comes back GetSize
+    /// times larger than it went into Forward
+    void Inverse (const float* re, const float* im, float* output);
+
+private:
+    /// In place complex FFT of m_half points whose input is already in bit reversed order
+    void Transform (float* re, float* im) const;
+
+    /// Real samples per transform, and the complex points it is done as
+    int m_size;
+    int m_half;
+
+    /// Where each complex point goes before the butterflies
+    std::vector<int> m_bitReverse;
+
+    /// Twiddles of every butterfly stage, each stage's contiguous so a stage's loop runs straight through them
+    std::vector<float> m_twiddleRe;
+    std::vector<float> m_twiddleIm;
+
+    /// Twiddles that split the half size transform into the real one, one per bin
+    std::vector<float> m_splitRe;
+    std::vector<float> m_splitIm;
+
+    /// Complex points being transformed
+    std::vector<float> m_workRe;
+    std::vector<float> m_workIm;
+};
+
+#endif /* FFT_hpp */
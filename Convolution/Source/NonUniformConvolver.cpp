@@ -0,0 +1,189 @@
+//
+//  NonUniformConvolver.cpp
+//  Convolution
+//
+
+#include "NonUniformConvolver.hpp"
+
+#include <algorithm>
+#include <string.h>
+
+NonUniformConvolver::~NonUniformConvolver()
+{
+    if (m_worker.joinable())
+    {
+        m_quit.store(true, std::memory_order_release);
+        m_wake.Post();
+        m_worker.join();
+    }
+}
+
+void NonUniformConvolver::Init(const float* ir, int irFrames, int irChannels, int headBlockSize, int tailBlockSize, int maxChannels)
+{
+    m_irFrames = irFrames;
+    m_tailBlockSize = tailBlockSize;
+    m_maxChannels = maxChannels;
+    m_position = 0;
+
+    // A tail block reaches the worker a whole tail block late, and its result is played a tail block after that.
+    // Starting the tail that far in, less the head's own latency, lines it up with the head
+    int headFrames = std::min(irFrames, tailBlockSize * 2 - headBlockSize);
+    m_head.Init(ir, headFrames, irChannels, headBlockSize, maxChannels);
+
+    m_hasTail = irFrames > headFrames;
+    if (!m_hasTail)
+    {
+        return;
+    }
+
+    m_tail.Init(ir + headFrames * irChannels, irFrames - headFrames, irChannels, tailBlockSize, maxChannels);
+
+    int blockSamples = tailBlockSize * maxChannels;
+    m_blocks.assign(blockSamples * 4, 0.0f);
+    m_collect = &m_blocks[0];
+    m_play = &m_blocks[blockSamples];
+    m_work = &m_blocks[blockSamples * 2];
+    m_result = &m_blocks[blockSamples * 3];
+
+    m_worker = std::thread(&NonUniformConvolver::Run, this);
+}
+
+void NonUniformConvolver::Clear()
+{
+    m_head.Clear();
+    if (!m_hasTail)
+    {
+        return;
+    }
+
+    // Whatever the worker has finished or is still working on is from before the clear, so it is dropped
+    int state = TAIL_DONE;
+    if (!m_state.compare_exchange_strong(state, TAIL_IDLE, std::memory_order_acq_rel))
+    {
+        m_dropResult = state == TAIL_BUSY;
+    }
+
+    memset(m_collect, 0, m_tailBlockSize * m_maxChannels * sizeof(float));
+    memset(m_play, 0, m_tailBlockSize * m_maxChannels * sizeof(float));
+    m_position = 0;
+    m_skipped = 0;
+    m_clears.fetch_add(1, std::memory_order_release);
+}
+
+void NonUniformConvolver::Process(const float* inbuffer, float* outbuffer, unsigned int length, int channels)
+{
+    m_head.Process(inbuffer, outbuffer, length, channels);
+    if (!m_hasTail)
+    {
+        return;
+    }
+
+    const int convolved = std::min(channels, m_maxChannels);
+
+    while (length)
+    {
+        int pass = (int)std::min(length, (unsigned int)(m_tailBlockSize - m_position));
+
+        for (int c = 0; c < convolved; c++)
+        {
+            float* collect = m_collect + c * m_tailBlockSize + m_position;
+            const float* play = m_play + c * m_tailBlockSize + m_position;
+
+            for (int i = 0; i < pass; i++)
+            {
+                collect[i] = inbuffer[i * channels + c];
+                outbuffer[i * channels + c] += play[i];
+            }
+        }
+
+        m_position += pass;
+        if (m_position == m_tailBlockSize)
+        {
+            HandOff(convolved);
+            m_position = 0;
+        }
+
+        inbuffer += pass * channels;
+        outbuffer += pass * channels;
+        length -= pass;
+    }
+}
+
+void NonUniformConvolver::HandOff(int channels)
+{
+    int state = m_state.load(std::memory_order_acquire);
+
+    if (state == TAIL_BUSY)
+    {
+        // The worker missed its deadline. Play nothing for this block, and nothing for the late result once it is done.
+        // The block just gathered goes into the tail as silence, so the blocks after it still line up with the head
+        memset(m_play, 0, m_tailBlockSize * m_maxChannels * sizeof(float));
+        m_dropResult = true;
+        m_skipped++;
+        m_lateBlocks.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    if (state == TAIL_DONE && !m_dropResult)
+    {
+        std::swap(m_play, m_result);
+    }
+    else
+    {
+        memset(m_play, 0, m_tailBlockSize * m_maxChannels * sizeof(float));
+    }
+    m_dropResult = false;
+
+    // The worker is not touching its buffers, so the gathered block can be swapped in for it
+    std::swap(m_collect, m_work);
+    m_workChannels = channels;
+    m_workSkipped = m_skipped;
+    m_skipped = 0;
+    m_workClears = m_clears.load(std::memory_order_relaxed);
+    m_state.store(TAIL_BUSY, std::memory_order_release);
+    m_wake.Post();
+}
+
+void NonUniformConvolver::Run()
+{
+    while (true)
+    {
+        m_wake.Wait();
+
+        if (m_quit.load(std::memory_order_acquire))
+        {
+            return;
+        }
+
+        if (m_state.load(std::memory_order_acquire) != TAIL_BUSY)
+        {
+            continue;
+        }
+
+        // A clear made before this block was handed over empties the tail ahead of it
+        if (m_tailClears != m_workClears)
+        {
+            m_tail.Clear();
+            m_tailClears = m_workClears;
+        }
+
+        // Blocks that were gathered while this thread was late come before the one just handed over
+        if (m_workSkipped > 0)
+        {
+            m_tail.Skip(m_workSkipped, m_tail.GetMaxChannels());
+        }
+
+        m_tail.Convolve(m_work, m_result, m_workChannels);
+
+        // A clear made while this block was on its way in means the block itself is from before it, so it goes too.
+        // The caller has already marked its result to be dropped
+        unsigned int clears = m_clears.load(std::memory_order_acquire);
+        if (clears != m_workClears)
+        {
+            m_tail.Clear();
+            m_tailClears = clears;
+        }
+
+        m_state.store(TAIL_DONE, std::memory_order_release);
+    }
+}
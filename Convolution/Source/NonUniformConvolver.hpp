@@ -0,0 +1,127 @@
+//
+//  NonUniformConvolver.hpp
+//  Convolution
+//
+//  Two stage non-uniformly partitioned convolution. The head of the impulse response is convolved in small blocks
+//  on the caller's thread, which sets the latency. The rest is convolved in large blocks on a worker thread that
+//  is given a whole large block of time to finish each one. If it is late, that block of the tail is left out
+//  rather than the caller waiting for it, and the block of input gathered meanwhile goes into the tail as silence
+//
+
+#ifndef NonUniformConvolver_hpp
+#define NonUniformConvolver_hpp
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "PartitionedConvolver.hpp"
+#include "Semaphore.hpp"
+
+class NonUniformConvolver
+{
+public:
+    NonUniformConvolver() :
+    m_hasTail(false),
+    m_tailBlockSize(0),
+    m_maxChannels(0),
+    m_position(0),
+    m_collect(nullptr),
+    m_play(nullptr),
+    m_work(nullptr),
+    m_result(nullptr),
+    m_workChannels(0),
+    m_skipped(0),
+    m_workSkipped(0),
+    m_workClears(0),
+    m_tailClears(0),
+    m_dropResult(false),
+    m_state(TAIL_IDLE),
+    m_clears(0),
+    m_quit(false),
+    m_lateBlocks(0)
+    { }
+
+    /// Stops the worker thread
+    ~NonUniformConvolver();
+
+    /// Build both stages for an interleaved impulse response and start the worker if there is a tail. Input channel n
+    /// is convolved with impulse channel n % irChannels. Allocates, so never call it on the mixer thread
+    void Init (const float* ir, int irFrames, int irChannels, int headBlockSize, int tailBlockSize, int maxChannels);
+
+    /// Convolve interleaved input, writing only the convolved signal. Channels past the maximum come out silent.
+    /// Output lags the input by one head block. Never waits for the worker
+    void Process (const float* inbuffer, float* outbuffer, unsigned int length, int channels);
+
+    /// Forget all input. The worker forgets its own before or after the block it is on, whichever keeps that block out
+    void Clear ();
+
+    /// Samples the output lags the input by
+    int GetLatency () const { return m_head.GetLatency(); }
+
+    /// Samples of output that follow the last non silent input
+    int GetTailLength () const { return m_irFrames + m_head.GetLatency(); }
+
+    /// Tail blocks left out because the worker had not finished them in time
+    unsigned int GetLateBlocks () const { return m_lateBlocks.load(std::memory_order_relaxed); }
+
+private:
+    /// Who holds the tail's work and result buffers
+    enum TailState
+    {
+        TAIL_IDLE = 0,  // nothing handed over yet
+        TAIL_BUSY,      // the worker is convolving a block
+        TAIL_DONE       // the worker's result is ready for the caller
+    };
+
+    /// A whole tail block of input has been gathered: take the last result and hand the block to the worker
+    void HandOff (int channels);
+
+    /// Worker thread loop
+    void Run ();
+
+    /// Small blocks for the start of the response, large blocks for everything after it
+    PartitionedConvolver m_head;
+    PartitionedConvolver m_tail;
+    bool m_hasTail;
+    int m_irFrames;
+
+    /// Samples in a tail block, channels there is state for, and samples into the tail block being gathered
+    int m_tailBlockSize;
+    int m_maxChannels;
+    int m_position;
+
+    /// Four planar tail blocks. The caller gathers input into one and plays another, the worker convolves one into
+    /// another, and they change hands only at the end of a tail block
+    std::vector<float> m_blocks;
+    float* m_collect;
+    float* m_play;
+    float* m_work;
+    float* m_result;
+    int m_workChannels;
+
+    /// Blocks gathered while the worker was late, which never reached it, and how many of them came before the block
+    /// the worker is on. It takes them as silence first, so every block after keeps its place in the tail
+    int m_skipped;
+    int m_workSkipped;
+
+    /// Clears made before the block the worker is on was handed over, and clears the worker's tail has caught up with.
+    /// A block gathered before a clear never stays in the tail, however the clear and the worker's run fall
+    unsigned int m_workClears;
+    unsigned int m_tailClears;
+
+    /// The block the worker is on was handed over before a clear, or finished too late, so its result is not played
+    bool m_dropResult;
+
+    std::atomic<int> m_state;
+    std::atomic<unsigned int> m_clears;
+    std::atomic<bool> m_quit;
+    std::atomic<unsigned int> m_lateBlocks;
+
+    /// Posted once for each block handed over, and once to quit. A post made before the worker sleeps is kept in the
+    /// count, so no wake-up is lost, and posting never blocks the caller
+    Semaphore m_wake;
+    std::thread m_worker;
+};
+
+#endif /* NonUniformConvolver_hpp */
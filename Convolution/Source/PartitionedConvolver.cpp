@@ -0,0 +1,198 @@
+//
+//  PartitionedConvolver.cpp
+//  Convolution
+//
+
+#include "PartitionedConvolver.hpp"
+
+#include <algorithm>
+#include <string.h>
+
+void PartitionedConvolver::Init(const float* ir, int irFrames, int irChannels, int blockSize, int maxChannels)
+{
+    m_blockSize = blockSize;
+    m_irFrames = irFrames;
+    m_irChannels = irChannels;
+    m_maxChannels = maxChannels;
+    m_partitions = std::max(1, (irFrames + blockSize - 1) / blockSize);
+
+    // Two blocks per transform, so the newest block's circular wrap lands only in the half that is thrown away
+    m_fft.Init(blockSize * 2);
+    m_bins = m_fft.GetBins();
+
+    int kernelSize = irChannels * m_partitions * m_bins;
+    m_kernelRe.assign(kernelSize, 0.0f);
+    m_kernelIm.assign(kernelSize, 0.0f);
+
+    std::vector<float> partition(blockSize * 2);
+    const float scale = 1.0f / (blockSize * 2);
+
+    for (int c = 0; c < irChannels; c++)
+    {
+        for (int p = 0; p < m_partitions; p++)
+        {
+            std::fill(partition.begin(), partition.end(), 0.0f);
+            int frames = std::min(blockSize, irFrames - p * blockSize);
+            for (int i = 0; i < frames; i++)
+            {
+                partition[i] = ir[(p * blockSize + i) * irChannels + c] * scale;
+            }
+
+            int offset = (c * m_partitions + p) * m_bins;
+            m_fft.Forward(partition.data(), &m_kernelRe[offset], &m_kernelIm[offset]);
+        }
+    }
+
+    m_spectraRe.assign(maxChannels * m_partitions * m_bins, 0.0f);
+    m_spectraIm.assign(maxChannels * m_partitions * m_bins, 0.0f);
+    m_input.assign(maxChannels * blockSize * 2, 0.0f);
+    m_output.assign(maxChannels * blockSize, 0.0f);
+    m_sumRe.assign(m_bins, 0.0f);
+    m_sumIm.assign(m_bins, 0.0f);
+    m_result.assign(blockSize * 2, 0.0f);
+
+    m_position = 0;
+    m_head = 0;
+}
+
+void PartitionedConvolver::Clear()
+{
+    std::fill(m_spectraRe.begin(), m_spectraRe.end(), 0.0f);
+    std::fill(m_spectraIm.begin(), m_spectraIm.end(), 0.0f);
+    std::fill(m_input.begin(), m_input.end(), 0.0f);
+    std::fill(m_output.begin(), m_output.end(), 0.0f);
+
+    m_position = 0;
+    m_head = 0;
+}
+
+void PartitionedConvolver::Process(const float* inbuffer, float* outbuffer, unsigned int length, int channels)
+{
+    const int convolved = std::min(channels, m_maxChannels);
+
+    while (length)
+    {
+        // Fill the rest of the block, playing out the block made from the last one as it goes
+        int pass = (int)std::min(length, (unsigned int)(m_blockSize - m_position));
+
+        for (int c = 0; c < convolved; c++)
+        {
+            float* input = &m_input[(c * 2 + 1) * m_blockSize + m_position];
+            const float* output = &m_output[c * m_blockSize + m_position];
+
+            for (int i = 0; i < pass; i++)
+            {
+                input[i] = inbuffer[i * channels + c];
+                outbuffer[i * channels + c] = output[i];
+            }
+        }
+
+        for (int c = convolved; c < channels; c++)
+        {
+            for (int i = 0; i < pass; i++)
+            {
+                outbuffer[i * channels + c] = 0.0f;
+            }
+        }
+
+        m_position += pass;
+        if (m_position == m_blockSize)
+        {
+            ProcessBlock(convolved, m_output.data());
+            m_position = 0;
+        }
+
+        inbuffer += pass * channels;
+        outbuffer += pass * channels;
+        length -= pass;
+    }
+}
+
+void PartitionedConvolver::Convolve(const float* inbuffer, float* outbuffer, int channels)
+{
+    channels = std::min(channels, m_maxChannels);
+    for (int c = 0; c < channels; c++)
+    {
+        memcpy(&m_input[(c * 2 + 1) * m_blockSize], inbuffer + c * m_blockSize, m_blockSize * sizeof(float));
+    }
+
+    ProcessBlock(channels, outbuffer);
+}
+
+void PartitionedConvolver::Skip(int blocks, int channels)
+{
+    // Past a whole delay line of silence there is nothing left to shift out
+    blocks = std::min(blocks, m_partitions + 1);
+    channels = std::min(channels, m_maxChannels);
+
+    for (int b = 0; b < blocks; b++)
+    {
+        for (int c = 0; c < channels; c++)
+        {
+            float* input = &m_input[c * m_blockSize * 2];
+            float* spectraRe = &m_spectraRe[c * m_partitions * m_bins];
+            float* spectraIm = &m_spectraIm[c * m_partitions * m_bins];
+
+            // The silent block still overlaps the one before it, so it is transformed like any other
+            memset(input + m_blockSize, 0, m_blockSize * sizeof(float));
+            m_fft.Forward(input, spectraRe + m_head * m_bins, spectraIm + m_head * m_bins);
+            memcpy(input, input + m_blockSize, m_blockSize * sizeof(float));
+        }
+
+        if (++m_head >= m_partitions)
+        {
+            m_head = 0;
+        }
+    }
+}
+
+void PartitionedConvolver::ProcessBlock(int channels, float* outbuffer)
+{
+    const int bins = m_bins;
+    float* sumRe = m_sumRe.data();
+    float* sumIm = m_sumIm.data();
+
+    for (int c = 0; c < channels; c++)
+    {
+        float* input = &m_input[c * m_blockSize * 2];
+        float* spectraRe = &m_spectraRe[c * m_partitions * bins];
+        float* spectraIm = &m_spectraIm[c * m_partitions * bins];
+        const float* kernelRe = &m_kernelRe[(c % m_irChannels) * m_partitions * bins];
+        const float* kernelIm = &m_kernelIm[(c % m_irChannels) * m_partitions * bins];
+
+        m_fft.Forward(input, spectraRe + m_head * bins, spectraIm + m_head * bins);
+
+        // Partition p meets the input spectrum from p blocks ago
+        std::fill(m_sumRe.begin(), m_sumRe.end(), 0.0f);
+        std::fill(m_sumIm.begin(), m_sumIm.end(), 0.0f);
+
+        for (int p = 0; p < m_partitions; p++)
+        {
+            int slot = m_head - p;
+            if (slot < 0) slot += m_partitions;
+
+            const float* xRe = spectraRe + slot * bins;
+            const float* xIm = spectraIm + slot * bins;
+            const float* hRe = kernelRe + p * bins;
+            const float* hIm = kernelIm + p * bins;
+
+            for (int k = 0; k < bins; k++)
+            {
+                sumRe[k] += (xRe[k] * hRe[k]) - (xIm[k] * hIm[k]);
+                sumIm[k] += (xRe[k] * hIm[k]) + (xIm[k] * hRe[k]);
+            }
+        }
+
+        // Only the second half is free of the circular wrap
+        m_fft.Inverse(sumRe, sumIm, m_result.data());
+        memcpy(outbuffer + c * m_blockSize, &m_result[m_blockSize], m_blockSize * sizeof(float));
+
+        // The newest block becomes the older half of the next transform
+        memcpy(input, input + m_blockSize, m_blockSize * sizeof(float));
+    }
+
+    if (++m_head >= m_partitions)
+    {
+        m_head = 0;
+    }
+}
@@ -0,0 +1,103 @@
+//
+//  PartitionedConvolver.hpp
+//  Convolution
+//
+//  Uniformly partitioned overlap-save convolution. The impulse response is cut into partitions of one block, each
+//  transformed once when the convolver is built. Every block of input is transformed once and kept in a frequency
+//  domain delay line, so a block of output is one inverse transform of the sum of each partition times the input
+//  spectrum from that many blocks ago
+//
+
+#ifndef PartitionedConvolver_hpp
+#define PartitionedConvolver_hpp
+
+#include <vector>
+
+#include "FFT.hpp"
+
+class PartitionedConvolver
+{
+public:
+    PartitionedConvolver() :
+    m_blockSize(0),
+    m_bins(0),
+    m_partitions(0),
+    m_irFrames(0),
+    m_irChannels(0),
+    m_maxChannels(0),
+    m_position(0),
+    m_head(0)
+    { }
+
+    /// Build the convolver for an interleaved impulse response. Input channel n is convolved with impulse channel
+    /// n % irChannels. Allocates and transforms the whole response, so never call it on the mixer thread
+    void Init (const float* ir, int irFrames, int irChannels, int blockSize, int maxChannels);
+
+    /// Convolve interleaved input, writing only the convolved signal. Channels past the maximum come out silent.
+    /// Output lags the input by one block
+    void Process (const float* inbuffer, float* outbuffer, unsigned int length, int channels);
+
+    /// Convolve one whole block of planar input, a block per channel, into planar output. Does the same work as
+    /// Process at a block boundary, for callers that gather blocks themselves
+    void Convolve (const float* inbuffer, float* outbuffer, int channels);
+
+    /// Take a number of whole blocks of silence without making any output, for blocks of input that were lost. Only
+    /// transforms them into the delay line, so it costs far less than convolving silence
+    void Skip (int blocks, int channels);
+
+    /// Forget all input
+    void Clear ();
+
+    /// Samples the output lags the input by
+    int GetLatency () const { return m_blockSize; }
+
+    /// Samples of output that follow the last non silent input
+    int GetTailLength () const { return m_irFrames + m_blockSize; }
+
+    /// Channels the convolver was built for
+    int GetMaxChannels () const { return m_maxChannels; }
+
+private:
+    /// Run the newest block of every channel through the partitions, writing a block per channel
+    void ProcessBlock (int channels, float* outbuffer);
+
+    FFT m_fft;
+
+    /// Samples in a block and a partition, and bins in the spectrum of two blocks
+    int m_blockSize;
+    int m_bins;
+
+    /// Partitions of the impulse response, and its length and channels
+    int m_partitions;
+    int m_irFrames;
+    int m_irChannels;
+
+    /// Channels there is state for
+    int m_maxChannels;
+
+    /// Spectrum of every partition, by impulse channel, then partition, then bin. Scaled to undo the inverse transform
+    std::vector<float> m_kernelRe;
+    std::vector<float> m_kernelIm;
+
+    /// Frequency domain delay line: the spectrum of each of the last m_partitions blocks of input, by channel,
+    /// then block, then bin
+    std::vector<float> m_spectraRe;
+    std::vector<float> m_spectraIm;
+
+    /// Last two blocks of input per channel, the newest filling the second half
+    std::vector<float> m_input;
+
+    /// Block of output per channel being played while the next block of input arrives
+    std::vector<float> m_output;
+
+    /// Sum of the partitions for the block being made, and its inverse transform
+    std::vector<float> m_sumRe;
+    std::vector<float> m_sumIm;
+    std::vector<float> m_result;
+
+    /// Samples into the current block, and the delay line slot the newest block goes in
+    int m_position;
+    int m_head;
+};
+
+#endif /* PartitionedConvolver_hpp */
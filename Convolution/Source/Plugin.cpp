@@ -0,0 +1,566 @@
+//
+//  Plugin.cpp
+//  Convolution
+//
+//  Convolution reverb plugin. The impulse response is set as parameter data and convolved with non-uniformly
+//  partitioned overlap-save FFT convolution, the late part of it on a worker thread
+
+#include <algorithm>
+#include <atomic>
+#include <math.h>
+#include <new>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "fmod.hpp"
+
+#include "NonUniformConvolver.hpp"
+
+extern "C"
+{
+    F_EXPORT FMOD_DSP_DESCRIPTION* F_CALL FMODGetDSPDescription();
+}
+
+// ==================== //
+// CALLBACK DEFINITIONS //
+// ==================== //
+FMOD_RESULT Create_Callback                     (FMOD_DSP_STATE *dsp_state);
+FMOD_RESULT Release_Callback                    (FMOD_DSP_STATE *dsp_state);
+FMOD_RESULT Reset_Callback                      (FMOD_DSP_STATE *dsp_state);
+FMOD_RESULT Process_Callback                    (FMOD_DSP_STATE *dsp_state, unsigned int length, const FMOD_DSP_BUFFER_ARRAY *inbufferarray, FMOD_DSP_BUFFER_ARRAY *outbufferarray, FMOD_BOOL inputsidle, FMOD_DSP_PROCESS_OPERATION op);
+FMOD_RESULT SetPosition_Callback                (FMOD_DSP_STATE *dsp_state, unsigned int pos);
+FMOD_RESULT ShouldIProcess_Callback             (FMOD_DSP_STATE *dsp_state, FMOD_BOOL inputsidle, unsigned int length, FMOD_CHANNELMASK inmask, int inchannels, FMOD_SPEAKERMODE speakermode);
+
+FMOD_RESULT SetFloat_Callback                   (FMOD_DSP_STATE *dsp_state, int index, float value);
+FMOD_RESULT SetInt_Callback                     (FMOD_DSP_STATE *dsp_state, int index, int value);
+FMOD_RESULT SetBool_Callback                    (FMOD_DSP_STATE *dsp_state, int index, FMOD_BOOL value);
+FMOD_RESULT SetData_Callback                    (FMOD_DSP_STATE *dsp_state, int index, void *data, unsigned int length);
+FMOD_RESULT GetFloat_Callback                   (FMOD_DSP_STATE *dsp_state, int index, float *value, char *valuestr);
+FMOD_RESULT GetInt_Callback                     (FMOD_DSP_STATE *dsp_state, int index, int *value, char *valuestr);
+FMOD_RESULT GetBool_Callback                    (FMOD_DSP_STATE *dsp_state, int index, FMOD_BOOL *value, char *valuestr);
+FMOD_RESULT GetData_Callback                    (FMOD_DSP_STATE *dsp_state, int index, void **data, unsigned int *length, char *valuestr);
+
+FMOD_RESULT SystemRegister_Callback             (FMOD_DSP_STATE *dsp_state);
+FMOD_RESULT SystemDeregister_Callback           (FMOD_DSP_STATE *dsp_state);
+FMOD_RESULT SystemMix_Callback                  (FMOD_DSP_STATE *dsp_state, int stage);
+
+// ==================== //
+//      PARAMETERS      //
+// ==================== //
+
+enum
+{
+    PARAM_IMPULSE = 0,
+    PARAM_IMPULSE_CHANNELS,
+    PARAM_DRY,
+    PARAM_WET,
+    NUM_PARAMS
+};
+
+/// Samples in each partition of the start of the impulse response, run on the mixer thread. The output lags the
+/// input by this much
+#define CONVOLUTION_HEAD_BLOCK_SIZE 128
+
+/// Samples in each partition of the rest of the impulse response, run on the worker thread
+#define CONVOLUTION_TAIL_BLOCK_SIZE 2048
+
+/// Channels an impulse response can have
+#define CONVOLUTION_MAX_IMPULSE_CHANNELS 8
+
+/// Channels the convolver is built for when the mixer's speaker mode does not say
+#define CONVOLUTION_DEFAULT_MAX_CHANNELS 8
+
+#define DECIBELS_TO_LINEAR(__dbval__)  ((__dbval__ <= -80.0f) ? 0.0f : powf(10.0f, __dbval__ / 20.0f))
+#define LINEAR_TO_DECIBELS(__linval__) ((__linval__ <= 0.0f) ? -80.0f : 20.0f * log10f((float)__linval__))
+
+static FMOD_DSP_PARAMETER_DESC p_impulse, p_impulseChannels, p_dry, p_wet;
+
+FMOD_DSP_PARAMETER_DESC* PluginsParameters[NUM_PARAMS] =
+{
+    &p_impulse,
+    &p_impulseChannels,
+    &p_dry,
+    &p_wet
+};
+
+
+// ==================== //
+//     SET CALLBACKS    //
+// ==================== //
+
+FMOD_DSP_DESCRIPTION PluginCallbacks =
+{
+    FMOD_PLUGIN_SDK_VERSION,    // version
+    "Kelly Convolution",        // name
+    0x00010000,                 // plugin version
+    1,                          // no. input buffers
+    1,                          // no. output buffers
+    Create_Callback,            // create
+    Release_Callback,           // release
+    Reset_Callback,             // reset
+    0,                          // read
+    Process_Callback,           // process
+    SetPosition_Callback,       // setposition
+    NUM_PARAMS,                 // no. parameter
+    PluginsParameters,          // pointer to parameter descriptions
+    SetFloat_Callback,          // Set float
+    SetInt_Callback,            // Set int
+    SetBool_Callback,           // Set bool
+    SetData_Callback,           // Set data
+    GetFloat_Callback,          // Get float
+    GetInt_Callback,            // Get int
+    GetBool_Callback,           // Get bool
+    GetData_Callback,           // Get data
+    ShouldIProcess_Callback,    // Check states before processing
+    0,                          // User data
+    SystemRegister_Callback,    // System register
+    SystemDeregister_Callback,  // System deregister
+    SystemMix_Callback          // Mixer thread exucute / after execute
+};
+
+extern "C"
+{
+    F_EXPORT FMOD_DSP_DESCRIPTION* F_CALL FMODGetDSPDescription ()
+    {
+        FMOD_DSP_INIT_PARAMDESC_DATA(p_impulse, "Impulse", "", "Impulse response as interleaved float samples at the mixer's rate", FMOD_DSP_PARAMETER_DATA_TYPE_USER);
+        FMOD_DSP_INIT_PARAMDESC_INT(p_impulseChannels, "Impulse Chans", "", "Channels interleaved in the impulse response. Each output channel uses impulse channel n % this", 1, CONVOLUTION_MAX_IMPULSE_CHANNELS, 1, false, 0);
+        FMOD_DSP_INIT_PARAMDESC_FLOAT(p_dry, "Dry", "dB", "Dry volume", -80.0f, 10.0f, 0.0f);
+        FMOD_DSP_INIT_PARAMDESC_FLOAT(p_wet, "Wet", "dB", "Wet volume", -80.0f, 10.0f, 0.0f);
+        return &PluginCallbacks;
+    }
+}
+
+// ==================== //
+//     PLUGIN CLASS     //
+// ==================== //
+
+/// Number of channels the mixer sends in a speaker mode
+static int GetSpeakerModeChannels(FMOD_SPEAKERMODE speakermode)
+{
+    switch (speakermode)
+    {
+        case FMOD_SPEAKERMODE_MONO:
+            return 1;
+        case FMOD_SPEAKERMODE_STEREO:
+            return 2;
+        case FMOD_SPEAKERMODE_QUAD:
+            return 4;
+        case FMOD_SPEAKERMODE_SURROUND:
+            return 5;
+        case FMOD_SPEAKERMODE_5POINT1:
+            return 6;
+        case FMOD_SPEAKERMODE_7POINT1:
+            return 8;
+        case FMOD_SPEAKERMODE_7POINT1POINT4:
+            return 12;
+        default:
+            return CONVOLUTION_DEFAULT_MAX_CHANNELS;
+    }
+}
+
+/// The convolver is built wherever the impulse response is set and handed to the mixer thread through m_pending.
+/// The mixer thread takes it in Query and leaves the one it replaces in m_retired, which is only freed away from
+/// the mixer thread, so Process never allocates or frees
+class Plugin
+{
+public:
+    Plugin() :
+    m_active(nullptr),
+    m_pending(nullptr),
+    m_retired(nullptr),
+    m_impulseChannels(1),
+    m_maxChannels(CONVOLUTION_DEFAULT_MAX_CHANNELS),
+    m_tailSamples(0),
+    m_silentSamples(0),
+    m_dry(1.0f),
+    m_wet(1.0f)
+    { }
+
+    ~Plugin()
+    {
+        delete m_active;
+        delete m_pending.load();
+        delete m_retired.load();
+    }
+
+    /// Start the plugin and load resources
+    FMOD_RESULT Init (FMOD_DSP_STATE*);
+    /// Called when the event is restarted
+    void Reset(FMOD_DSP_STATE*);
+    /// Called before read to pick up a new impulse response
+    FMOD_RESULT Query(FMOD_DSP_STATE*, int);
+    /// Main DSP processing
+    void Read(float* inbuffer, float* outbuffer, unsigned int length, int channels);
+    /// Called after read to follow the tail once the input has gone idle
+    void UpdateTail(unsigned int length, bool inputsidle);
+    /// True once the input has been idle for longer than the impulse response, so the output is silent
+    bool IsTailSilent() const { return m_silentSamples >= m_tailSamples; }
+    /// Set parameter floats
+    void SetParameterFloat(int index, float value);
+    /// Get paramter floats
+    void GetParameterFloat(int index, float* value);
+    /// Set parameter ints
+    void SetParameterInt(int index, int value);
+    /// Get parameter ints
+    void GetParameterInt(int index, int* value);
+    /// Set parameter data
+    FMOD_RESULT SetParameterData(int index, void* data, unsigned int length);
+    /// Get parameter data
+    void GetParameterData(int index, void** data, unsigned int* length);
+
+private:
+    /// Build a convolver for the impulse response and queue it for the mixer thread
+    void Rebuild();
+
+    /// Convolver the mixer thread is using, the next one for it to take, and the last one it let go of
+    NonUniformConvolver* m_active;
+    std::atomic<NonUniformConvolver*> m_pending;
+    std::atomic<NonUniformConvolver*> m_retired;
+
+    /// Impulse response as it was set, kept to rebuild from and to hand back
+    std::vector<float> m_impulse;
+    int m_impulseChannels;
+
+    /// Channels the convolver keeps state for
+    int m_maxChannels;
+
+    /// Samples of idle input before the tail is over, and samples of idle input so far
+    int m_tailSamples;
+    int m_silentSamples;
+
+    // Parameters
+    float m_dry, m_wet;
+};
+
+FMOD_RESULT Plugin::Init(FMOD_DSP_STATE* dsp_state)
+{
+    // Keep state for the widest signal the mixer will send
+    FMOD_SPEAKERMODE mixerMode = FMOD_SPEAKERMODE_DEFAULT;
+    FMOD_SPEAKERMODE outputMode = FMOD_SPEAKERMODE_DEFAULT;
+
+    if (FMOD_DSP_GETSPEAKERMODE(dsp_state, &mixerMode, &outputMode) == FMOD_OK)
+    {
+        m_maxChannels = GetSpeakerModeChannels(mixerMode);
+    }
+
+    return FMOD_OK;
+}
+
+void Plugin::Reset(FMOD_DSP_STATE* dsp_state)
+{
+    if (m_active)
+    {
+        m_active->Clear();
+    }
+    m_silentSamples = m_tailSamples;
+}
+
+FMOD_RESULT Plugin::Query(FMOD_DSP_STATE* dsp_state, int channels)
+{
+    // Only take a new convolver once the last one let go of has been freed, so there is always somewhere to put it
+    if (!m_retired.load(std::memory_order_acquire))
+    {
+        NonUniformConvolver* convolver = m_pending.exchange(nullptr, std::memory_order_acq_rel);
+        if (convolver)
+        {
+            m_retired.store(m_active, std::memory_order_release);
+            m_active = convolver;
+            m_tailSamples = convolver->GetTailLength();
+        }
+    }
+    return FMOD_OK;
+}
+
+void Plugin::Read(float *inbuffer, float *outbuffer, unsigned int length, int channels)
+{
+    if (!m_active)
+    {
+        for (unsigned int k = 0; k < length * channels; k++)
+        {
+            outbuffer[k] = inbuffer[k] * m_dry;
+        }
+        return;
+    }
+
+    m_active->Process(inbuffer, outbuffer, length, channels);
+
+    for (unsigned int k = 0; k < length * channels; k++)
+    {
+        outbuffer[k] = (inbuffer[k] * m_dry) + (outbuffer[k] * m_wet);
+    }
+}
+
+void Plugin::UpdateTail(unsigned int length, bool inputsidle)
+{
+    // Idle input is silent, so the tail is over once all the input in the convolver is idle input
+    m_silentSamples = inputsidle ? std::min(m_silentSamples + (int)length, m_tailSamples) : 0;
+}
+
+void Plugin::Rebuild()
+{
+    // Anything the mixer thread has let go of can be freed here
+    delete m_retired.exchange(nullptr, std::memory_order_acq_rel);
+
+    NonUniformConvolver* convolver = new NonUniformConvolver();
+    int frames = (int)m_impulse.size() / m_impulseChannels;
+    convolver->Init(m_impulse.data(), frames, m_impulseChannels, CONVOLUTION_HEAD_BLOCK_SIZE, CONVOLUTION_TAIL_BLOCK_SIZE,
+                    m_maxChannels);
+
+    // A convolver the mixer thread never took can go straight away
+    delete m_pending.exchange(convolver, std::memory_order_acq_rel);
+}
+
+void Plugin::SetParameterFloat(int index, float value)
+{
+    switch (index) {
+        case PARAM_DRY:
+            m_dry = DECIBELS_TO_LINEAR(value);
+            break;
+
+        case PARAM_WET:
+            m_wet = DECIBELS_TO_LINEAR(value);
+            break;
+
+        default:
+            break;
+    }
+}
+
+void Plugin::GetParameterFloat(int index, float *value)
+{
+    switch (index) {
+        case PARAM_DRY:
+            *value = LINEAR_TO_DECIBELS(m_dry);
+            break;
+
+        case PARAM_WET:
+            *value = LINEAR_TO_DECIBELS(m_wet);
+            break;
+
+        default:
+            break;
+    }
+}
+
+void Plugin::SetParameterInt(int index, int value)
+{
+    switch (index) {
+        case PARAM_IMPULSE_CHANNELS:
+            if (value != m_impulseChannels)
+            {
+                m_impulseChannels = value;
+                if (!m_impulse.empty())
+                {
+                    Rebuild();
+                }
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+void Plugin::GetParameterInt(int index, int* value)
+{
+    switch (index) {
+        case PARAM_IMPULSE_CHANNELS:
+            *value = m_impulseChannels;
+            break;
+
+        default:
+            break;
+    }
+}
+
+FMOD_RESULT Plugin::SetParameterData(int index, void* data, unsigned int length)
+{
+    switch (index) {
+        case PARAM_IMPULSE:
+        {
+            const float* samples = (const float* )data;
+            m_impulse.assign(samples, samples + (data ? length / sizeof(float) : 0));
+            Rebuild();
+            return FMOD_OK;
+        }
+
+        default:
+            return FMOD_ERR_INVALID_PARAM;
+    }
+}
+
+void Plugin::GetParameterData(int index, void** data, unsigned int* length)
+{
+    switch (index) {
+        case PARAM_IMPULSE:
+            *data = m_impulse.data();
+            *length = (unsigned int)(m_impulse.size() * sizeof(float));
+            break;
+
+        default:
+            break;
+    }
+}
+
+// ======================= //
+// CALLBACK IMPLEMENTATION //
+// ======================= //
+
+FMOD_RESULT Create_Callback                     (FMOD_DSP_STATE *dsp_state)
+{
+    // create our plugin class and attach to fmod
+    void* memory = FMOD_DSP_ALLOC(dsp_state, sizeof(Plugin));
+    if (!memory)
+    {
+        return FMOD_ERR_MEMORY;
+    }
+
+    // The class owns containers, so it is constructed in place rather than relying on zeroed memory
+    Plugin* state = new (memory) Plugin();
+    dsp_state->plugindata = state;
+
+    FMOD_RESULT result = state->Init(dsp_state);
+    if (result != FMOD_OK)
+    {
+        state->~Plugin();
+        FMOD_DSP_FREE(dsp_state, state);
+        dsp_state->plugindata = nullptr;
+    }
+    return result;
+}
+
+FMOD_RESULT Release_Callback                    (FMOD_DSP_STATE *dsp_state)
+{
+    // release our plugin class
+    Plugin* state = (Plugin* )dsp_state->plugindata;
+    state->~Plugin();
+    FMOD_DSP_FREE(dsp_state, state);
+
+    return FMOD_OK;
+}
+
+FMOD_RESULT Reset_Callback                      (FMOD_DSP_STATE *dsp_state)
+{
+    Plugin* state = (Plugin* )dsp_state->plugindata;
+    state->Reset(dsp_state);
+    return FMOD_OK;
+}
+
+FMOD_RESULT Process_Callback                    (FMOD_DSP_STATE *dsp_state, unsigned int length, const FMOD_DSP_BUFFER_ARRAY *inbufferarray, FMOD_DSP_BUFFER_ARRAY *outbufferarray, FMOD_BOOL inputsidle, FMOD_DSP_PROCESS_OPERATION op)
+{
+    Plugin* state = (Plugin* )dsp_state->plugindata;
+
+    switch (op) {
+        case FMOD_DSP_PROCESS_QUERY:
+        {
+            if (outbufferarray && inbufferarray)
+            {
+                outbufferarray[0].bufferchannelmask[0] = inbufferarray[0].bufferchannelmask[0];
+                outbufferarray[0].buffernumchannels[0] = inbufferarray[0].buffernumchannels[0];
+                outbufferarray[0].speakermode       = inbufferarray[0].speakermode;
+            }
+
+            FMOD_RESULT result = state->Query(dsp_state, outbufferarray[0].buffernumchannels[0]);
+
+            // Silent input still has to run until the tail has played out
+            if (result == FMOD_OK && inputsidle && state->IsTailSilent())
+            {
+                return FMOD_ERR_DSP_DONTPROCESS;
+            }
+            return result;
+        }
+
+        case FMOD_DSP_PROCESS_PERFORM:
+
+            state->Read(inbufferarray[0].buffers[0], outbufferarray[0].buffers[0], length, outbufferarray[0].buffernumchannels[0]);
+            state->UpdateTail(length, inputsidle);
+
+            return FMOD_OK;
+            break;
+    }
+
+    return FMOD_OK;
+}
+
+FMOD_RESULT SetPosition_Callback                (FMOD_DSP_STATE *dsp_state, unsigned int pos)
+{
+    return FMOD_OK;
+}
+
+FMOD_RESULT ShouldIProcess_Callback             (FMOD_DSP_STATE *dsp_state, FMOD_BOOL inputsidle, unsigned int length, FMOD_CHANNELMASK inmask, int inchannels, FMOD_SPEAKERMODE speakermode)
+{
+    Plugin* state = (Plugin* )dsp_state->plugindata;
+
+    if (inputsidle && state->IsTailSilent())
+    {
+        return FMOD_ERR_DSP_DONTPROCESS;
+    }
+    return FMOD_OK;
+}
+
+FMOD_RESULT SetFloat_Callback                   (FMOD_DSP_STATE *dsp_state, int index, float value)
+{
+    Plugin* state = (Plugin* )dsp_state->plugindata;
+    state->SetParameterFloat(index, value);
+    return FMOD_OK;
+}
+
+FMOD_RESULT SetInt_Callback                     (FMOD_DSP_STATE *dsp_state, int index, int value)
+{
+    Plugin* state = (Plugin* )dsp_state->plugindata;
+    state->SetParameterInt(index, value);
+    return FMOD_OK;
+}
+
+FMOD_RESULT SetBool_Callback                    (FMOD_DSP_STATE *dsp_state, int index, FMOD_BOOL value)
+{
+    return FMOD_OK;
+}
+
+FMOD_RESULT SetData_Callback                    (FMOD_DSP_STATE *dsp_state, int index, void *data, unsigned int length)
+{
+    Plugin* state = (Plugin* )dsp_state->plugindata;
+    return state->SetParameterData(index, data, length);
+}
+
+FMOD_RESULT GetFloat_Callback                   (FMOD_DSP_STATE *dsp_state, int index, float *value, char *valuestr)
+{
+    Plugin* state = (Plugin* )dsp_state->plugindata;
+    state->GetParameterFloat(index, value);
+    return FMOD_OK;
+}
+
+FMOD_RESULT GetInt_Callback                     (FMOD_DSP_STATE *dsp_state, int index, int *value, char *valuestr)
+{
+    Plugin* state = (Plugin* )dsp_state->plugindata;
+    state->GetParameterInt(index, value);
+    return FMOD_OK;
+}
+
+FMOD_RESULT GetBool_Callback                    (FMOD_DSP_STATE *dsp_state, int index, FMOD_BOOL *value, char *valuestr)
+{
+    return FMOD_OK;
+}
+
+FMOD_RESULT GetData_Callback                    (FMOD_DSP_STATE *dsp_state, int index, void **data, unsigned int *length, char *valuestr)
+{
+    Plugin* state = (Plugin* )dsp_state->plugindata;
+    state->GetParameterData(index, data, length);
+    return FMOD_OK;
+}
+
+FMOD_RESULT SystemRegister_Callback             (FMOD_DSP_STATE *dsp_state)
+{
+    return FMOD_OK;
+}
+
+FMOD_RESULT SystemDeregister_Callback           (FMOD_DSP_STATE *dsp_state)
+{
+    return FMOD_OK;
+}
+
+FMOD_RESULT SystemMix_Callback                  (FMOD_DSP_STATE *dsp_state, int stage)
+{
+    return FMOD_OK;
+}
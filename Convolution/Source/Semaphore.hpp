@@ -0,0 +1,87 @@
+//
+//  Semaphore.hpp
+//  Convolution
+//
+//  Counting semaphore for waking a worker thread from the mixer thread. Posting never takes a lock or waits, so the
+//  mixer can never be held up behind the thread it wakes. Each platform's own semaphore is used, as C++11 has none
+//
+
+#ifndef Semaphore_hpp
+#define Semaphore_hpp
+
+#if defined(__APPLE__)
+#include <dispatch/dispatch.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#else
+#include <errno.h>
+#include <semaphore.h>
+#endif
+
+class Semaphore
+{
+public:
+    Semaphore()
+    {
+#if defined(__APPLE__)
+        // macOS does not implement unnamed POSIX semaphores
+        m_semaphore = dispatch_semaphore_create(0);
+#elif defined(_WIN32)
+        m_semaphore = CreateSemaphore(nullptr, 0, LONG_MAX, nullptr);
+#else
+        sem_init(&m_semaphore, 0, 0);
+#endif
+    }
+
+    ~Semaphore()
+    {
+#if defined(__APPLE__)
+        dispatch_release(m_semaphore);
+#elif defined(_WIN32)
+        CloseHandle(m_semaphore);
+#else
+        sem_destroy(&m_semaphore);
+#endif
+    }
+
+    Semaphore(const Semaphore&) = delete;
+    Semaphore& operator=(const Semaphore&) = delete;
+
+    /// Add one to the count, waking a waiting thread. Safe to call on the mixer thread
+    void Post()
+    {
+#if defined(__APPLE__)
+        dispatch_semaphore_signal(m_semaphore);
+#elif defined(_WIN32)
+        ReleaseSemaphore(m_semaphore, 1, nullptr);
+#else
+        sem_post(&m_semaphore);
+#endif
+    }
+
+    /// Sleep until the count is above zero, then take one from it
+    void Wait()
+    {
+#if defined(__APPLE__)
+        dispatch_semaphore_wait(m_semaphore, DISPATCH_TIME_FOREVER);
+#elif defined(_WIN32)
+        WaitForSingleObject(m_semaphore, INFINITE);
+#else
+        // A signal handler running on the thread can end the wait early without taking anything
+        while (sem_wait(&m_semaphore) != 0 && errno == EINTR)
+        {
+        }
+#endif
+    }
+
+private:
+#if defined(__APPLE__)
+    dispatch_semaphore_t m_semaphore;
+#elif defined(_WIN32)
+    HANDLE m_semaphore;
+#else
+    sem_t m_semaphore;
+#endif
+};
+
+#endif /* Semaphore_hpp */
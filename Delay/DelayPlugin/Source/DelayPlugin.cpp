@@ -7,7 +7,9 @@
 //
 //  Delay plugin
 
+#include <algorithm>
 #include <math.h>
+#include <new>
 #include <stdio.h>
 #include <string>
 #include <vector>
@@ -16,6 +18,8 @@
 
 #include "fmod.hpp"
 
+#include "DenormalGuard.hpp"
+
 extern "C"
 {
     F_EXPORT FMOD_DSP_DESCRIPTION* F_CALL FMODGetDSPDescription();
@@ -62,12 +66,18 @@ const float DELAY_PLUGIN_FEEDBACK_MIN = 0.0f;
 const float DELAY_PLUGIN_FEEDBACK_MAX = 99.0f;
 const float DELAY_PLUGIN_FEEDBACK_INIT = 0.0f;
 
+// level the tail must fall below before silent input stops processing
+const float DELAY_PLUGIN_IDLE_FLOOR_MIN = -140.0f;
+const float DELAY_PLUGIN_IDLE_FLOOR_MAX = -40.0f;
+const float DELAY_PLUGIN_IDLE_FLOOR_INIT = -90.0f;
+
 enum
 {
     DELAY_TIME = 0,
     FEEDBACK_PERCENT,
     DRY_LEVEL,
     WET_LEVEL,
+    IDLE_FLOOR,
     NUM_PARAMS
 };
 
@@ -75,13 +85,15 @@ static FMOD_DSP_PARAMETER_DESC p_delayTime;
 static FMOD_DSP_PARAMETER_DESC p_feedback;
 static FMOD_DSP_PARAMETER_DESC p_dry;
 static FMOD_DSP_PARAMETER_DESC p_wet;
+static FMOD_DSP_PARAMETER_DESC p_idleFloor;
 
 FMOD_DSP_PARAMETER_DESC* PluginsParameters[NUM_PARAMS] =
 {
     &p_delayTime,
     &p_feedback,
     &p_dry,
-    &p_wet
+    &p_wet,
+    &p_idleFloor
 };
 
 
@@ -131,6 +143,7 @@ extern "C"
         FMOD_DSP_INIT_PARAMDESC_FLOAT(p_feedback, "Feedback", "%", "Amount of feedback in delay", DELAY_PLUGIN_FEEDBACK_MIN, DELAY_PLUGIN_FEEDBACK_MAX, DELAY_PLUGIN_FEEDBACK_INIT);
         FMOD_DSP_INIT_PARAMDESC_FLOAT(p_dry, "Dry", "dB", "Dry amount in dB. -80 to 10. Default = 0", DELAY_PLUGIN_LEVELS_MIN, DELAY_PLUGIN_LEVELS_MAX, DELAY_PLUGIN_LEVELS_INIT);
         FMOD_DSP_INIT_PARAMDESC_FLOAT(p_wet, "Wet", "dB", "Wet amount in dB. -80 to 10. Default = 0", DELAY_PLUGIN_LEVELS_MIN, DELAY_PLUGIN_LEVELS_MAX, DELAY_PLUGIN_LEVELS_INIT);
+        FMOD_DSP_INIT_PARAMDESC_FLOAT(p_idleFloor, "Idle Floor", "dB", "Level the echoes must fall below before silent input stops processing. -140 to -40. Default = -90", DELAY_PLUGIN_IDLE_FLOOR_MIN, DELAY_PLUGIN_IDLE_FLOOR_MAX, DELAY_PLUGIN_IDLE_FLOOR_INIT);
         
         return &PluginCallbacks;
     }
@@ -145,13 +158,29 @@ typedef std::vector<float> DelayBuffer;
 class Plugin
 {
 public:
-    Plugin() { }
+    Plugin() :
+    m_bufferLeft(nullptr),
+    m_bufferRight(nullptr),
+    m_writePosLeft(0),
+    m_writePosRight(0),
+    m_writtenSamples(0),
+    m_delayTime(0),
+    m_feedbackAmount(0),
+    m_dryAmount(0),
+    m_wetAmount(0),
+    m_idleFloor(0),
+    m_silentSamples(0),
+    m_sampleRate(0),
+    m_maxSampleDelay(0),
+    m_numOfChannels(0)
+    {
+    }
     
     /// Start the plugin and load resources
     void Init (FMOD_DSP_STATE*);
     /// Release resources
     void Release ();
-    /// Called when the event is restarted
+    /// Called when the event is restarted. Silences the buffers without reallocating them
     void Reset(FMOD_DSP_STATE*);
     
     // parameter gets and sets
@@ -159,10 +188,18 @@ public:
     float GetFeedback() const {return ((m_feedbackAmount > DELAY_PLUGIN_FEEDBACK_MAX) ? DELAY_PLUGIN_FEEDBACK_MAX : (m_feedbackAmount < DELAY_PLUGIN_FEEDBACK_MIN) ? DELAY_PLUGIN_FEEDBACK_MIN : m_feedbackAmount) / 100;}
     float GetDry(bool linear = true) const {return linear ? DECIBELS_TO_LINEAR(m_dryAmount) : m_dryAmount; }
     float GetWet(bool linear = true) const {return linear ? DECIBELS_TO_LINEAR(m_wetAmount) : m_wetAmount; }
+    float GetIdleFloor(bool linear = true) const {return linear ? powf(10.0f, m_idleFloor / 20.0f) : m_idleFloor; }
     void SetDelayTime(float);
     void SetFeedback(float);
     void SetDry(float);
     void SetWet(float);
+    void SetIdleFloor(float);
+    
+    /// Called after read to follow the echoes once the input has gone idle
+    void UpdateTail(const float* outbuffer, unsigned int length, int channels, bool inputsidle);
+    /// True once the output has stayed below the idle floor for longer than the delay, so everything it can still
+    /// read back was written while it was that quiet
+    bool IsTailSilent() const { return m_silentSamples > (int)MS_TO_SAMPLES(m_delayTime, m_sampleRate); }
     
     /// Advance the write position by one sample
     void TickLeft();
@@ -188,6 +225,8 @@ private:
     /// Which index we are writing the samples into
     int m_writePosLeft;
     int m_writePosRight;
+    /// Samples written since the buffers were last cleared, up to their length. They are all at the front
+    int m_writtenSamples;
     /// Time in ms of delay
     float m_delayTime;
     /// Amount in % for feedback. Divide by 100 to get linear value
@@ -196,6 +235,10 @@ private:
     float m_dryAmount;
     /// Amount in dB for wet / delayed signal Use GetWet to get linear value
     float m_wetAmount;
+    /// Level in dB the tail must fall below to go idle. Use GetIdleFloor to get linear value
+    float m_idleFloor;
+    /// Samples of idle input the output has been below the idle floor
+    int m_silentSamples;
     /// Sample rate of application
     int m_sampleRate;
     /// Maximum time of delay in samples
@@ -210,6 +253,7 @@ void Plugin::Init(FMOD_DSP_STATE* dsp_state)
     m_feedbackAmount = DELAY_PLUGIN_FEEDBACK_INIT;
     m_dryAmount = DELAY_PLUGIN_LEVELS_INIT;
     m_wetAmount = DELAY_PLUGIN_LEVELS_INIT;
+    m_idleFloor = DELAY_PLUGIN_IDLE_FLOOR_INIT;
     m_numOfChannels = 2;
     Reset(dsp_state);
 }
@@ -222,19 +266,39 @@ void Plugin::Release()
 
 void Plugin::Reset(FMOD_DSP_STATE* dsp_state)
 {
-    delete m_bufferLeft;
-    delete m_bufferRight;
-    
     dsp_state->functions->getsamplerate(dsp_state, &m_sampleRate);
-    m_maxSampleDelay = MS_TO_SAMPLES(DELAY_PLUGIN_MAX_DELAY_TIME_MS, m_sampleRate);
+    int maxSampleDelay = MS_TO_SAMPLES(DELAY_PLUGIN_MAX_DELAY_TIME_MS, m_sampleRate);
+    
+    if (m_bufferLeft && m_bufferRight && maxSampleDelay == m_maxSampleDelay)
+    {
+        // Writing starts from the front after a reset, so only what was written since the last one can hold anything.
+        // The sample being written counts too, as TickLeft moves on after it
+        int written = std::min(m_writtenSamples + 1, m_maxSampleDelay);
+        std::fill(m_bufferLeft->begin(), m_bufferLeft->begin() + written, 0.0f);
+        std::fill(m_bufferRight->begin(), m_bufferRight->begin() + written, 0.0f);
+    }
+    else
+    {
+        delete m_bufferLeft;
+        delete m_bufferRight;
+        
+        m_maxSampleDelay = maxSampleDelay;
+        m_bufferLeft = new DelayBuffer(m_maxSampleDelay);
+        m_bufferRight = new DelayBuffer(m_maxSampleDelay);
+    }
+    
+    m_writePosLeft = 0;
+    m_writePosRight = 0;
+    m_writtenSamples = 0;
     
-    m_bufferLeft = new DelayBuffer(m_maxSampleDelay);
-    m_bufferRight = new DelayBuffer(m_maxSampleDelay);
+    // Clear buffers hold no tail
+    m_silentSamples = m_maxSampleDelay + 1;
 }
 
 void Plugin::TickLeft()
 {
     ++m_writePosLeft;
+    m_writtenSamples = std::min(m_writtenSamples + 1, m_maxSampleDelay);
     
     if (m_writePosLeft >= m_maxSampleDelay)
     {
@@ -366,51 +430,98 @@ void Plugin::SetWet(float wet)
     m_wetAmount = wet;
 }
 
+void Plugin::SetIdleFloor(float idleFloor)
+{
+    m_idleFloor = idleFloor;
+}
+
 void Plugin::Read(float *inbuffer, float *outbuffer, unsigned int length, int channels)
 {
     m_numOfChannels = channels;
     
-    float* inSample(inbuffer);
-    float* outSample(outbuffer);
+    if (!m_bufferLeft || !m_bufferRight)
+    {
+        return;
+    }
+    
+    // Both lines share the left write head, so a block of frames is read and written as two contiguous spans per line
+    float delayInSamples = MS_TO_SAMPLES(m_delayTime, m_sampleRate);
+    int wholeDelay = (int)delayInSamples;
+    float r = delayInSamples - wholeDelay;
+    float dry(GetDry()), wet(GetWet()), feedback(GetFeedback());
+    int delayChannels = std::min(channels, 2);
     
-    for (unsigned int i = 0; i < length; i++)
+    while (length)
     {
-        for (unsigned int n = 0; n < channels; n++, inSample++, outSample++)
+        int readPos = m_writePosLeft - wholeDelay;
+        if (readPos < 0) readPos += m_maxSampleDelay;
+        
+        int nextPos = readPos - 1;
+        if (nextPos < 0) nextPos += m_maxSampleDelay;
+        
+        // A pass ends before any span wraps and is never longer than the delay, so it only reads what earlier passes wrote
+        unsigned int pass = std::min(length, (unsigned int)std::max(wholeDelay, 1));
+        pass = std::min(pass, (unsigned int)(m_maxSampleDelay - m_writePosLeft));
+        pass = std::min(pass, (unsigned int)(m_maxSampleDelay - readPos));
+        pass = std::min(pass, (unsigned int)(m_maxSampleDelay - nextPos));
+        
+        for (int n = 0; n < delayChannels; n++)
         {
-            switch (n)
+            DelayBuffer* buffer = (n == 0) ? m_bufferLeft : m_bufferRight;
+            const float* readSample = buffer->data() + readPos;
+            const float* nextSample = buffer->data() + nextPos;
+            float* writeSample = buffer->data() + m_writePosLeft;
+            
+            for (unsigned int i = 0; i < pass; i++)
             {
-                case 0:
-                {
-                    float drySample(*inSample), wetSample(GetDelayedSampleLeft());
-                    
-                    WriteDelayLeft(drySample + (wetSample * GetFeedback()));
-                    
-                    *outSample = (drySample * GetDry()) + ((wetSample) * GetWet());
-                    
-                    TickLeft();
-
-                    break;
-                }
-                case 1:
-                {
-                    float drySample(*inSample), wetSample(GetDelayedSampleRight());
-                    
-                    WriteDelayRight(drySample + (wetSample * GetFeedback()));
-                    
-                    *outSample = (drySample * GetDry()) + ((wetSample) * GetWet());
-                    
-                    TickRight();
-
-                    break;
-                }
-                    
-                default:
-                    *outSample = *inSample * GetDry();
-                    break;
+                float drySample(inbuffer[i * channels + n]);
+                float wetSample(readSample[i] + ((nextSample[i] - readSample[i]) * r));
+                
+                writeSample[i] = FlushDenormal(drySample + (wetSample * feedback));
+                
+                outbuffer[i * channels + n] = (drySample * dry) + (wetSample * wet);
             }
-            
         }
+        
+        // Channels past the stereo pair only get the dry signal
+        for (int n = delayChannels; n < channels; n++)
+        {
+            for (unsigned int i = 0; i < pass; i++)
+            {
+                outbuffer[i * channels + n] = inbuffer[i * channels + n] * dry;
+            }
+        }
+        
+        m_writePosLeft += pass;
+        m_writtenSamples = std::min(m_writtenSamples + (int)pass, m_maxSampleDelay);
+        if (m_writePosLeft >= m_maxSampleDelay)
+        {
+            m_writePosLeft = 0;
+        }
+        
+        inbuffer += pass * channels;
+        outbuffer += pass * channels;
+        length -= pass;
+    }
+}
+
+void Plugin::UpdateTail(const float* outbuffer, unsigned int length, int channels, bool inputsidle)
+{
+    // While there is input the echoes are still being fed, so only idle input is worth measuring
+    if (!inputsidle)
+    {
+        m_silentSamples = 0;
+        return;
+    }
+    
+    // With silent input the output is only the echoes
+    float peak = 0.0f;
+    for (unsigned int k = 0; k < length * channels; k++)
+    {
+        peak = std::max(peak, fabsf(outbuffer[k]));
     }
+    
+    m_silentSamples = (peak >= GetIdleFloor()) ? 0 : std::min(m_silentSamples + (int)length, m_maxSampleDelay + 1);
 }
 
 // ======================= //
@@ -420,13 +531,16 @@ void Plugin::Read(float *inbuffer, float *outbuffer, unsigned int length, int ch
 FMOD_RESULT Create_Callback                     (FMOD_DSP_STATE *dsp_state)
 {
     // create our plugin class and attach to fmod
-    Plugin* state = (Plugin* )FMOD_DSP_ALLOC(dsp_state, sizeof(Plugin));
-    state->Init(dsp_state);
-    dsp_state->plugindata = state;
-    if (!dsp_state->plugindata)
+    void* memory = FMOD_DSP_ALLOC(dsp_state, sizeof(Plugin));
+    if (!memory)
     {
         return FMOD_ERR_MEMORY;
     }
+    
+    // FMOD's memory is not zeroed, so the class is constructed in place to null the buffers before Init checks them
+    Plugin* state = new (memory) Plugin();
+    state->Init(dsp_state);
+    dsp_state->plugindata = state;
     return FMOD_OK;
 }
 
@@ -435,6 +549,7 @@ FMOD_RESULT Release_Callback                    (FMOD_DSP_STATE *dsp_state)
     // release our plugin class
     Plugin* state = (Plugin* )dsp_state->plugindata;
     state->Release();
+    state->~Plugin();
     FMOD_DSP_FREE(dsp_state, state);
     
     return FMOD_OK;
@@ -470,18 +585,21 @@ FMOD_RESULT Process_Callback                    (FMOD_DSP_STATE *dsp_state, unsi
                 
             }
             
-            if (inputsidle)
+            // Silent input still has to run until the echoes have died away
+            if (inputsidle && state->IsTailSilent())
             {
                 return FMOD_ERR_DSP_DONTPROCESS;
             }
             break;
             
         case FMOD_DSP_PROCESS_PERFORM:
-            
+        {
+            DenormalGuard guard;
             state->Read(inbufferarray[0].buffers[0], outbufferarray[0].buffers[0], length, outbufferarray[0].buffernumchannels[0]);
+            state->UpdateTail(outbufferarray[0].buffers[0], length, outbufferarray[0].buffernumchannels[0], inputsidle);
             
             return FMOD_OK;
-            break;
+        }
     }
     
     return FMOD_OK;
@@ -494,7 +612,9 @@ FMOD_RESULT SetPosition_Callback                (FMOD_DSP_STATE *dsp_state, unsi
 
 FMOD_RESULT ShouldIProcess_Callback             (FMOD_DSP_STATE *dsp_state, FMOD_BOOL inputsidle, unsigned int length, FMOD_CHANNELMASK inmask, int inchannels, FMOD_SPEAKERMODE speakermode)
 {
-    if (inputsidle)
+    Plugin* state = (Plugin* )dsp_state->plugindata;
+    
+    if (inputsidle && state->IsTailSilent())
     {
         return FMOD_ERR_DSP_DONTPROCESS;
     }
@@ -525,6 +645,11 @@ FMOD_RESULT SetFloat_Callback                   (FMOD_DSP_STATE *dsp_state, int
             state->SetWet(value);
             return FMOD_OK;
             break;
+            
+        case IDLE_FLOOR:
+            state->SetIdleFloor(value);
+            return FMOD_OK;
+            break;
 
     }
     return FMOD_ERR_INVALID_PARAM;
@@ -570,6 +695,11 @@ FMOD_RESULT GetFloat_Callback                   (FMOD_DSP_STATE *dsp_state, int
             return FMOD_OK;
             break;
             
+        case IDLE_FLOOR:
+            *value = state->GetIdleFloor(false);
+            return FMOD_OK;
+            break;
+            
     }
     return FMOD_ERR_INVALID_PARAM;
 }
@@ -8,12 +8,15 @@
 //  This file is a 'blank' plugin that does not process audio and only lets it pass through
 
 #include <math.h>
+#include <new>
 #include <stdio.h>
 #include <string>
 #include <vector>
 
 #include "fmod.hpp"
 
+#include "DenormalGuard.hpp"
+
 extern "C"
 {
     F_EXPORT FMOD_DSP_DESCRIPTION* F_CALL FMODGetDSPDescription();
@@ -122,9 +125,14 @@ class Plugin
 {
 public:
     Plugin() :
-    m_isHighpass(0) { }
+    m_isHighpass(0),
+    m_inputFilter(PLUGIN_MAX_CUTOFF),
+    m_sampleRate(0),
+    m_channels(0),
+    m_yBuffer(nullptr),
+    m_xBuffer(nullptr) { }
     void Init (int sampleRate);
-    void Release () { delete m_yBuffer; }
+    void Release () { delete m_yBuffer; delete m_xBuffer; }
     void SetCutoff (float value) { m_inputFilter = value; }
     float GetCutoff () const { return m_inputFilter; }
     
@@ -197,7 +205,7 @@ void Plugin::Read(float *inbuffer, float *outbuffer, unsigned int length, int ch
             
             // Store previous values
             (*m_xBuffer)[n] = *inbuffer++;
-            (*m_yBuffer)[n] = *outbuffer++;
+            (*m_yBuffer)[n] = FlushDenormal(*outbuffer++);
             
         }
     }
@@ -211,12 +219,15 @@ void Plugin::Read(float *inbuffer, float *outbuffer, unsigned int length, int ch
 FMOD_RESULT Create_Callback                     (FMOD_DSP_STATE *dsp_state)
 {
     // create our plugin class and attach to fmod
-    Plugin* state = (Plugin* )FMOD_DSP_ALLOC(dsp_state, sizeof(Plugin));
-    dsp_state->plugindata = state;
-    if (!dsp_state->plugindata)
+    void* memory = FMOD_DSP_ALLOC(dsp_state, sizeof(Plugin));
+    if (!memory)
     {
         return FMOD_ERR_MEMORY;
     }
+    
+    // FMOD's memory is not zeroed, so the class is constructed in place to null the buffers before Read checks them
+    Plugin* state = new (memory) Plugin();
+    dsp_state->plugindata = state;
     int rate(0);
     state->Init(FMOD_DSP_GETSAMPLERATE(dsp_state, &rate));
     return FMOD_OK;
@@ -226,6 +237,8 @@ FMOD_RESULT Release_Callback                    (FMOD_DSP_STATE *dsp_state)
 {
     // release our plugin class
     Plugin* state = (Plugin* )dsp_state->plugindata;
+    state->Release();
+    state->~Plugin();
     FMOD_DSP_FREE(dsp_state, state);
     
     return FMOD_OK;
@@ -265,15 +278,16 @@ FMOD_RESULT Process_Callback                    (FMOD_DSP_STATE *dsp_state, unsi
             break;
             
         case FMOD_DSP_PROCESS_PERFORM:
-            
+        {
             if (inputsidle)
             {
                 return FMOD_ERR_DSP_DONTPROCESS;
             }
             
+            DenormalGuard guard;
             state->Read(inbufferarray[0].buffers[0], outbufferarray[0].buffers[0], length, outbufferarray[0].buffernumchannels[0]);
             return FMOD_OK;
-            break;
+        }
     }
     
     return FMOD_OK;
@@ -9,6 +9,7 @@
 //  This file can be placed directly in a game's code and be loaded, or compiled as a DLL or DYLIB file to be loaded as a library
 
 #include <math.h>
+#include <new>
 #include <stdio.h>
 #include <string>
 
@@ -87,6 +88,7 @@ F_EXPORT FMOD_DSP_DESCRIPTION* F_CALL FMODGetDSPDescription ()
 class TOmSSilenceState
 {
 public:
+    TOmSSilenceState() : m_mute(false) { }
     void SetMute(bool value) { m_mute = value; }
     bool GetMute() const { return m_mute; }
     
@@ -96,11 +98,12 @@ private:
 
 FMOD_RESULT F_CALLBACK Plugin_Create                    (FMOD_DSP_STATE *dsp_state)
 {
-    dsp_state->plugindata = (TOmSSilenceState* )FMOD_DSP_ALLOC(dsp_state, sizeof(TOmSSilenceState));
-    if (!dsp_state->plugindata)
+    void* memory = FMOD_DSP_ALLOC(dsp_state, sizeof(TOmSSilenceState));
+    if (!memory)
     {
         return FMOD_ERR_MEMORY;
     }
+    dsp_state->plugindata = new (memory) TOmSSilenceState();
     
     return FMOD_OK;
 }
@@ -108,6 +111,7 @@ FMOD_RESULT F_CALLBACK Plugin_Create                    (FMOD_DSP_STATE *dsp_sta
 FMOD_RESULT F_CALLBACK Plugin_Release                   (FMOD_DSP_STATE *dsp_state)
 {
     TOmSSilenceState* state = (TOmSSilenceState* )dsp_state->plugindata;
+    state->~TOmSSilenceState();
     FMOD_DSP_FREE(dsp_state, state);
     return FMOD_OK;
 }
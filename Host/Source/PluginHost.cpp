@@ -0,0 +1,496 @@
+//
+//  PluginHost.cpp
+//  Host
+//
+
+#include "PluginHost.hpp"
+
+#include <algorithm>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef FMOD_DSP_DESCRIPTION* (F_CALL *FMOD_GETDSPDESCRIPTION_FUNC)();
+
+// ==================== //
+//  STATE FUNCTIONS     //
+// ==================== //
+
+// FMOD makes no promise about what is in the memory it hands out, so fill it with garbage rather than let fresh
+// pages come back zeroed and hide state a plugin forgot to initialise. malloc is 16 byte aligned on every 64-bit
+// target we build for
+const unsigned char HOST_ALLOC_FILL = 0xCD;
+
+static void* Host_Alloc(unsigned int size, FMOD_MEMORY_TYPE type, const char* sourcestr)
+{
+    void* memory = malloc(size);
+    if (memory)
+    {
+        memset(memory, HOST_ALLOC_FILL, size);
+    }
+    return memory;
+}
+
+static void* Host_Realloc(void* ptr, unsigned int size, FMOD_MEMORY_TYPE type, const char* sourcestr)
+{
+    return realloc(ptr, size);
+}
+
+static void Host_Free(void* ptr, FMOD_MEMORY_TYPE type, const char* sourcestr)
+{
+    free(ptr);
+}
+
+static FMOD_RESULT Host_GetSampleRate(FMOD_DSP_STATE* dsp_state, int* rate)
+{
+    PluginHost* host = (PluginHost* )dsp_state->instance;
+    *rate = host->GetSampleRate();
+    return FMOD_OK;
+}
+
+static FMOD_RESULT Host_GetBlockSize(FMOD_DSP_STATE* dsp_state, unsigned int* blocksize)
+{
+    PluginHost* host = (PluginHost* )dsp_state->instance;
+    *blocksize = host->GetBlockSize();
+    return FMOD_OK;
+}
+
+static FMOD_RESULT Host_GetSpeakerMode(FMOD_DSP_STATE* dsp_state, FMOD_SPEAKERMODE* speakermode_mixer, FMOD_SPEAKERMODE* speakermode_output)
+{
+    PluginHost* host = (PluginHost* )dsp_state->instance;
+    if (speakermode_mixer)
+    {
+        *speakermode_mixer = host->GetSpeakerMode();
+    }
+    if (speakermode_output)
+    {
+        *speakermode_output = host->GetSpeakerMode();
+    }
+    return FMOD_OK;
+}
+
+static FMOD_RESULT Host_GetClock(FMOD_DSP_STATE* dsp_state, unsigned long long* clock, unsigned int* offset, unsigned int* length)
+{
+    PluginHost* host = (PluginHost* )dsp_state->instance;
+    if (clock)
+    {
+        *clock = host->GetClock() * host->GetBlockSize();
+    }
+    if (offset)
+    {
+        *offset = 0;
+    }
+    if (length)
+    {
+        *length = host->GetBlockSize();
+    }
+    return FMOD_OK;
+}
+
+static FMOD_RESULT Host_GetListenerAttributes(FMOD_DSP_STATE* dsp_state, int* numlisteners, FMOD_3D_ATTRIBUTES* attributes)
+{
+    if (numlisteners)
+    {
+        *numlisteners = 1;
+    }
+    if (attributes)
+    {
+        memset(attributes, 0, sizeof(FMOD_3D_ATTRIBUTES));
+        attributes->forward[2] = 1.0f;
+        attributes->up[1] = 1.0f;
+    }
+    return FMOD_OK;
+}
+
+static void Host_Log(FMOD_DEBUG_FLAGS level, const char* file, int line, const char* function, const char* string, ...)
+{
+    va_list args;
+    va_start(args, string);
+    fprintf(stderr, "%s(%d) %s: ", file, line, function);
+    vfprintf(stderr, string, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+}
+
+static FMOD_RESULT Host_GetUserData(FMOD_DSP_STATE* dsp_state, void** userdata)
+{
+    PluginHost* host = (PluginHost* )dsp_state->instance;
+    *userdata = host->GetDescription() ? host->GetDescription()->userdata : nullptr;
+    return FMOD_OK;
+}
+
+// ==================== //
+//     PLUGIN HOST      //
+// ==================== //
+
+PluginHost::PluginHost(int sampleRate, unsigned int blockSize) :
+m_library(nullptr),
+m_description(nullptr),
+m_sampleRate(sampleRate),
+m_blockSize(blockSize),
+m_speakerMode(FMOD_SPEAKERMODE_STEREO),
+m_clock(0)
+{
+    memset(&m_functions, 0, sizeof(m_functions));
+    m_functions.alloc = Host_Alloc;
+    m_functions.realloc = Host_Realloc;
+    m_functions.free = Host_Free;
+    m_functions.getsamplerate = Host_GetSampleRate;
+    m_functions.getblocksize = Host_GetBlockSize;
+    m_functions.getspeakermode = Host_GetSpeakerMode;
+    m_functions.getclock = Host_GetClock;
+    m_functions.getlistenerattributes = Host_GetListenerAttributes;
+    m_functions.log = Host_Log;
+    m_functions.getuserdata = Host_GetUserData;
+
+    memset(&m_systemState, 0, sizeof(m_systemState));
+    m_systemState.instance = this;
+    m_systemState.functions = &m_functions;
+}
+
+PluginHost::~PluginHost()
+{
+    Unload();
+}
+
+bool PluginHost::Load(const char* path)
+{
+    Unload();
+
+    m_library = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!m_library)
+    {
+        fprintf(stderr, "Failed to open %s: %s\n", path, dlerror());
+        return false;
+    }
+
+    FMOD_GETDSPDESCRIPTION_FUNC getDescription = (FMOD_GETDSPDESCRIPTION_FUNC)dlsym(m_library, "FMODGetDSPDescription");
+    if (!getDescription)
+    {
+        fprintf(stderr, "%s does not export FMODGetDSPDescription\n", path);
+        dlclose(m_library);
+        m_library = nullptr;
+        return false;
+    }
+
+    m_description = getDescription();
+    if (!m_description)
+    {
+        dlclose(m_library);
+        m_library = nullptr;
+        return false;
+    }
+
+    m_path = path;
+    m_clock = 0;
+
+    if (m_description->sys_register)
+    {
+        m_description->sys_register(&m_systemState);
+    }
+
+    return true;
+}
+
+void PluginHost::Unload()
+{
+    if (m_description && m_description->sys_deregister)
+    {
+        m_description->sys_deregister(&m_systemState);
+    }
+
+    m_description = nullptr;
+    m_systemState.plugindata = nullptr;
+
+    if (m_library)
+    {
+        dlclose(m_library);
+        m_library = nullptr;
+    }
+}
+
+void PluginHost::BeginMix()
+{
+    if (m_description && m_description->sys_mix)
+    {
+        m_description->sys_mix(&m_systemState, 0);
+    }
+}
+
+void PluginHost::EndMix()
+{
+    if (m_description && m_description->sys_mix)
+    {
+        m_description->sys_mix(&m_systemState, 1);
+    }
+    m_clock++;
+}
+
+FMOD_SPEAKERMODE PluginHost::SpeakerModeForChannels(int channels)
+{
+    switch (channels)
+    {
+        case 1:
+            return FMOD_SPEAKERMODE_MONO;
+        case 2:
+            return FMOD_SPEAKERMODE_STEREO;
+        case 4:
+            return FMOD_SPEAKERMODE_QUAD;
+        case 5:
+            return FMOD_SPEAKERMODE_SURROUND;
+        case 6:
+            return FMOD_SPEAKERMODE_5POINT1;
+        case 8:
+            return FMOD_SPEAKERMODE_7POINT1;
+        case 12:
+            return FMOD_SPEAKERMODE_7POINT1POINT4;
+        default:
+            return FMOD_SPEAKERMODE_RAW;
+    }
+}
+
+std::vector<std::string> PluginHost::FindPlugins(const char* directory)
+{
+    std::vector<std::string> paths;
+    DIR* dir = opendir(directory);
+    if (!dir)
+    {
+        return paths;
+    }
+
+    while (dirent* entry = readdir(dir))
+    {
+        size_t nameLength = strlen(entry->d_name);
+        if (nameLength > 3 && strcmp(entry->d_name + nameLength - 3, ".so") == 0)
+        {
+            paths.push_back(std::string(directory) + "/" + entry->d_name);
+        }
+    }
+    closedir(dir);
+
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
+// ==================== //
+//   PLUGIN INSTANCE    //
+// ==================== //
+
+PluginInstance::PluginInstance(PluginHost* host) :
+m_host(host),
+m_created(false),
+m_idle(false),
+m_outChannels(0)
+{
+    memset(&m_state, 0, sizeof(m_state));
+    m_state.instance = host;
+    m_state.functions = host->GetFunctions();
+}
+
+PluginInstance::~PluginInstance()
+{
+    Release();
+}
+
+FMOD_RESULT PluginInstance::Create()
+{
+    FMOD_DSP_DESCRIPTION* description = m_host->GetDescription();
+    if (!description)
+    {
+        return FMOD_ERR_NOTREADY;
+    }
+
+    m_state.source_speakermode = m_host->GetSpeakerMode();
+
+    if (description->create)
+    {
+        FMOD_RESULT result = description->create(&m_state);
+        if (result != FMOD_OK)
+        {
+            return result;
+        }
+    }
+
+    m_created = true;
+    SetDefaults();
+    return FMOD_OK;
+}
+
+FMOD_RESULT PluginInstance::Release()
+{
+    if (!m_created)
+    {
+        return FMOD_OK;
+    }
+
+    m_created = false;
+
+    FMOD_DSP_DESCRIPTION* description = m_host->GetDescription();
+    if (description && description->release)
+    {
+        return description->release(&m_state);
+    }
+    return FMOD_OK;
+}
+
+FMOD_RESULT PluginInstance::Reset()
+{
+    FMOD_DSP_DESCRIPTION* description = m_host->GetDescription();
+    if (m_created && description->reset)
+    {
+        return description->reset(&m_state);
+    }
+    return FMOD_OK;
+}
+
+void PluginInstance::SetDefaults()
+{
+    FMOD_DSP_DESCRIPTION* description = m_host->GetDescription();
+
+    for (int i = 0; i < description->numparameters; i++)
+    {
+        FMOD_DSP_PARAMETER_DESC* param = description->paramdesc[i];
+
+        switch (param->type)
+        {
+            case FMOD_DSP_PARAMETER_TYPE_FLOAT:
+                SetParameterFloat(i, param->floatdesc.defaultval);
+                break;
+
+            case FMOD_DSP_PARAMETER_TYPE_INT:
+                SetParameterInt(i, param->intdesc.defaultval);
+                break;
+
+            case FMOD_DSP_PARAMETER_TYPE_BOOL:
+                SetParameterBool(i, param->booldesc.defaultval);
+                break;
+
+            default:
+                break;
+        }
+    }
+}
+
+FMOD_RESULT PluginInstance::SetParameterFloat(int index, float value)
+{
+    FMOD_DSP_DESCRIPTION* description = m_host->GetDescription();
+    return description->setparameterfloat ? description->setparameterfloat(&m_state, index, value) : FMOD_ERR_INVALID_PARAM;
+}
+
+FMOD_RESULT PluginInstance::SetParameterInt(int index, int value)
+{
+    FMOD_DSP_DESCRIPTION* description = m_host->GetDescription();
+    return description->setparameterint ? description->setparameterint(&m_state, index, value) : FMOD_ERR_INVALID_PARAM;
+}
+
+FMOD_RESULT PluginInstance::SetParameterBool(int index, bool value)
+{
+    FMOD_DSP_DESCRIPTION* description = m_host->GetDescription();
+    return description->setparameterbool ? description->setparameterbool(&m_state, index, value) : FMOD_ERR_INVALID_PARAM;
+}
+
+FMOD_RESULT PluginInstance::SetParameterData(int index, void* data, unsigned int length)
+{
+    FMOD_DSP_DESCRIPTION* description = m_host->GetDescription();
+    return description->setparameterdata ? description->setparameterdata(&m_state, index, data, length) : FMOD_ERR_INVALID_PARAM;
+}
+
+FMOD_RESULT PluginInstance::GetParameterFloat(int index, float* value)
+{
+    FMOD_DSP_DESCRIPTION* description = m_host->GetDescription();
+    return description->getparameterfloat ? description->getparameterfloat(&m_state, index, value, nullptr) : FMOD_ERR_INVALID_PARAM;
+}
+
+FMOD_RESULT PluginInstance::GetParameterInt(int index, int* value)
+{
+    FMOD_DSP_DESCRIPTION* description = m_host->GetDescription();
+    return description->getparameterint ? description->getparameterint(&m_state, index, value, nullptr) : FMOD_ERR_INVALID_PARAM;
+}
+
+FMOD_RESULT PluginInstance::GetParameterBool(int index, bool* value)
+{
+    FMOD_DSP_DESCRIPTION* description = m_host->GetDescription();
+    if (!description->getparameterbool)
+    {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+
+    FMOD_BOOL result = 0;
+    FMOD_RESULT error = description->getparameterbool(&m_state, index, &result, nullptr);
+    *value = result != 0;
+    return error;
+}
+
+FMOD_RESULT PluginInstance::Process(float *inbuffer, float *outbuffer, unsigned int length, int channels, bool inputsidle)
+{
+    FMOD_DSP_DESCRIPTION* description = m_host->GetDescription();
+    FMOD_SPEAKERMODE speakerMode = PluginHost::SpeakerModeForChannels(channels);
+    FMOD_RESULT result = FMOD_OK;
+
+    m_idle = false;
+    m_outChannels = channels;
+
+    if (description->process)
+    {
+        int inChannels(channels), outChannels(channels);
+        FMOD_CHANNELMASK inMask(0), outMask(0);
+        float* inBuffers[1];
+        float* outBuffers[1];
+
+        FMOD_DSP_BUFFER_ARRAY inArray;
+        inArray.numbuffers = 1;
+        inArray.buffernumchannels = &inChannels;
+        inArray.bufferchannelmask = &inMask;
+        inArray.buffers = inBuffers;
+        inArray.speakermode = speakerMode;
+
+        FMOD_DSP_BUFFER_ARRAY outArray;
+        outArray.numbuffers = 1;
+        outArray.buffernumchannels = &outChannels;
+        outArray.bufferchannelmask = &outMask;
+        outArray.buffers = outBuffers;
+        outArray.speakermode = speakerMode;
+
+        // The buffer pointers are reset before each call as some plugins walk them while processing
+        inBuffers[0] = inbuffer;
+        outBuffers[0] = outbuffer;
+
+        result = description->process(&m_state, length, &inArray, &outArray, inputsidle, FMOD_DSP_PROCESS_QUERY);
+        m_outChannels = outChannels;
+
+        if (result == FMOD_OK)
+        {
+            inBuffers[0] = inbuffer;
+            outBuffers[0] = outbuffer;
+            result = description->process(&m_state, length, &inArray, &outArray, inputsidle, FMOD_DSP_PROCESS_PERFORM);
+        }
+    }
+    else if (description->read)
+    {
+        if (description->shouldiprocess)
+        {
+            result = description->shouldiprocess(&m_state, inputsidle, length, 0, channels, speakerMode);
+        }
+
+        if (result == FMOD_OK)
+        {
+            result = description->read(&m_state, inbuffer, outbuffer, length, channels, &m_outChannels);
+        }
+    }
+    else
+    {
+        memcpy(outbuffer, inbuffer, length * channels * sizeof(float));
+    }
+
+    if (result == FMOD_ERR_DSP_DONTPROCESS || result == FMOD_ERR_DSP_SILENCE)
+    {
+        // Skipped DSPs leave silence behind them in the mix
+        memset(outbuffer, 0, length * channels * sizeof(float));
+        m_idle = true;
+        return FMOD_OK;
+    }
+
+    return result;
+}
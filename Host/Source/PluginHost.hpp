@@ -0,0 +1,144 @@
+//
+//  PluginHost.hpp
+//  Host
+//
+//  Stand-in for the FMOD mixer. Loads a plugin library, asks it for its FMOD_DSP_DESCRIPTION
+//  and drives the callbacks in the same order FMOD does, so the plugins can be run and measured
+//  on machines without FMOD Studio
+
+#ifndef PluginHost_hpp
+#define PluginHost_hpp
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "fmod.hpp"
+
+class PluginInstance;
+
+/// One loaded plugin library plus the 'system' it is registered with
+class PluginHost
+{
+public:
+    PluginHost(int sampleRate = 48000, unsigned int blockSize = 1024);
+
+    ~PluginHost();
+
+    /// Open the library, fetch its description and call the system register callback
+    bool Load (const char* path);
+
+    /// Call the system deregister callback and close the library
+    void Unload ();
+
+    /// Returns true when a description has been loaded
+    bool IsLoaded () const { return m_description != nullptr; }
+
+    /// Description returned by FMODGetDSPDescription
+    FMOD_DSP_DESCRIPTION* GetDescription () const { return m_description; }
+
+    /// Path the plugin was loaded from
+    const std::string& GetPath () const { return m_path; }
+
+    /// Mixer sample rate reported through FMOD_DSP_GETSAMPLERATE
+    int GetSampleRate () const { return m_sampleRate; }
+
+    /// Mixer block size reported through FMOD_DSP_GETBLOCKSIZE
+    unsigned int GetBlockSize () const { return m_blockSize; }
+
+    /// Mixer speaker mode reported through FMOD_DSP_GETSPEAKERMODE
+    FMOD_SPEAKERMODE GetSpeakerMode () const { return m_speakerMode; }
+
+    /// Set the sample rate. Only affects instances created afterwards, as in FMOD
+    void SetSampleRate (int value) { m_sampleRate = value; }
+
+    /// Set the block size
+    void SetBlockSize (unsigned int value) { m_blockSize = value; }
+
+    /// Set the speaker mode of the mixer
+    void SetSpeakerMode (FMOD_SPEAKERMODE value) { m_speakerMode = value; }
+
+    /// Called before any instance is processed for a mix block (SystemMix stage 0)
+    void BeginMix ();
+
+    /// Called after every instance has been processed for a mix block (SystemMix stage 1)
+    void EndMix ();
+
+    /// Number of mix blocks run so far. Reported through FMOD_DSP_GETCLOCK
+    unsigned long long GetClock () const { return m_clock; }
+
+    /// Function table handed to every FMOD_DSP_STATE created by this host
+    FMOD_DSP_STATE_FUNCTIONS* GetFunctions () { return &m_functions; }
+
+    /// Speaker mode FMOD would use for a buffer with this many channels
+    static FMOD_SPEAKERMODE SpeakerModeForChannels (int channels);
+
+    /// Every shared object in a directory, sorted by path
+    static std::vector<std::string> FindPlugins (const char* directory);
+
+private:
+    void* m_library;
+    FMOD_DSP_DESCRIPTION* m_description;
+    std::string m_path;
+
+    int m_sampleRate;
+    unsigned int m_blockSize;
+    FMOD_SPEAKERMODE m_speakerMode;
+    unsigned long long m_clock;
+
+    FMOD_DSP_STATE_FUNCTIONS m_functions;
+
+    /// State used for the system register / deregister / mix callbacks
+    FMOD_DSP_STATE m_systemState;
+};
+
+/// A single DSP created from a PluginHost's description
+class PluginInstance
+{
+public:
+    PluginInstance(PluginHost* host);
+
+    ~PluginInstance();
+
+    /// Run the create callback then set every parameter to its default, as FMOD does
+    FMOD_RESULT Create ();
+
+    /// Run the release callback
+    FMOD_RESULT Release ();
+
+    /// Run the reset callback
+    FMOD_RESULT Reset ();
+
+    /// Set every float, int and bool parameter to the default in its description
+    void SetDefaults ();
+
+    FMOD_RESULT SetParameterFloat (int index, float value);
+    FMOD_RESULT SetParameterInt (int index, int value);
+    FMOD_RESULT SetParameterBool (int index, bool value);
+    FMOD_RESULT SetParameterData (int index, void* data, unsigned int length);
+    FMOD_RESULT GetParameterFloat (int index, float* value);
+    FMOD_RESULT GetParameterInt (int index, int* value);
+    FMOD_RESULT GetParameterBool (int index, bool* value);
+
+    /// Process one block of interleaved audio.
+    /// Process callbacks get a QUERY then, if the plugin did not refuse, a PERFORM. Read callbacks get ShouldIProcess then Read.
+    /// When the plugin refuses the block the output is silenced and IsIdle returns true
+    FMOD_RESULT Process (float* inbuffer, float* outbuffer, unsigned int length, int channels, bool inputsidle);
+
+    /// True when the last Process call was skipped by the plugin
+    bool IsIdle () const { return m_idle; }
+
+    /// Number of output channels the plugin asked for in the last QUERY
+    int GetOutChannels () const { return m_outChannels; }
+
+    FMOD_DSP_STATE* GetState () { return &m_state; }
+
+private:
+    PluginHost* m_host;
+    FMOD_DSP_STATE m_state;
+    bool m_created;
+    bool m_idle;
+    int m_outChannels;
+};
+
+#endif /* PluginHost_hpp */
@@ -0,0 +1,326 @@
+//
+//  main.cpp
+//  Host
+//
+//  Loads every plugin given on the command line (or every plugin in the build's plugin folder),
+//  runs it through a second of noise followed by idle blocks and reports what happened.
+//  The output can also be written out, or checked against output written out before
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "PluginHost.hpp"
+
+#ifndef PLUGIN_DIR
+#define PLUGIN_DIR "plugins"
+#endif
+
+/// A parameter override given on the command line as Name=value
+struct ParameterOverride
+{
+    std::string name;
+    float value;
+};
+
+struct HostSettings
+{
+    int sampleRate;
+    unsigned int blockSize;
+    int channels;
+    float seconds;
+    bool idle;
+    std::vector<ParameterOverride> parameters;
+    std::string renderPath;
+    std::string comparePath;
+    float tolerance;
+};
+
+/// Small deterministic noise source so every run sees the same input
+static float NextNoise(unsigned int& seed)
+{
+    seed = seed * 1664525u + 1013904223u;
+    return ((seed >> 8) / (float)(1 << 24)) * 2.0f - 1.0f;
+}
+
+/// Apply any overrides whose name matches one of the plugin's parameters
+static void ApplyParameters(PluginHost& host, PluginInstance& instance, const std::vector<ParameterOverride>& parameters)
+{
+    FMOD_DSP_DESCRIPTION* description = host.GetDescription();
+
+    for (size_t p = 0; p < parameters.size(); p++)
+    {
+        for (int i = 0; i < description->numparameters; i++)
+        {
+            FMOD_DSP_PARAMETER_DESC* param = description->paramdesc[i];
+            if (parameters[p].name != param->name)
+            {
+                continue;
+            }
+
+            switch (param->type)
+            {
+                case FMOD_DSP_PARAMETER_TYPE_FLOAT:
+                    instance.SetParameterFloat(i, parameters[p].value);
+                    break;
+
+                case FMOD_DSP_PARAMETER_TYPE_INT:
+                    instance.SetParameterInt(i, (int)parameters[p].value);
+                    break;
+
+                case FMOD_DSP_PARAMETER_TYPE_BOOL:
+                    instance.SetParameterBool(i, parameters[p].value != 0.0f);
+                    break;
+
+                default:
+                    break;
+            }
+        }
+    }
+}
+
+/// Write the output as raw interleaved floats
+static bool WriteOutput(const std::string& path, const std::vector<float>& output)
+{
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file)
+    {
+        printf("cannot write %s\n", path.c_str());
+        return false;
+    }
+
+    bool written = fwrite(output.data(), sizeof(float), output.size(), file) == output.size();
+    fclose(file);
+    return written;
+}
+
+/// Compare the output against raw interleaved floats written out before. The frames both cover are compared, so a
+/// reference can be checked at any block size, and it fails if any sample is further out than the tolerance
+static bool CompareOutput(const std::string& path, const std::vector<float>& output, int channels, float tolerance)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file)
+    {
+        printf("cannot read %s\n", path.c_str());
+        return false;
+    }
+
+    std::vector<float> reference;
+    float buffer[4096];
+    size_t read;
+    while ((read = fread(buffer, sizeof(float), 4096, file)) > 0)
+    {
+        reference.insert(reference.end(), buffer, buffer + read);
+    }
+    fclose(file);
+
+    size_t count = std::min(reference.size(), output.size());
+    float maxDiff = 0.0f;
+    size_t worst = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        float diff = fabsf(output[i] - reference[i]);
+        if (!(diff <= maxDiff))
+        {
+            maxDiff = diff;
+            worst = i;
+        }
+    }
+
+    bool matches = count > 0 && maxDiff <= tolerance;
+    printf("%-28s %zu frames against %s  max diff %g at frame %zu%s\n", "", count / channels, path.c_str(), maxDiff, worst / channels, matches ? "" : "  MISMATCH");
+    return matches;
+}
+
+/// Runs one plugin and returns false if it failed to create, errored, produced non-finite output or did not match
+/// the reference it was compared against
+static bool RunPlugin(const std::string& path, const HostSettings& settings)
+{
+    const unsigned int blockSize = settings.blockSize;
+    const int channels = settings.channels;
+
+    PluginHost host(settings.sampleRate, blockSize);
+    host.SetSpeakerMode(PluginHost::SpeakerModeForChannels(channels));
+
+    if (!host.Load(path.c_str()))
+    {
+        return false;
+    }
+
+    PluginInstance instance(&host);
+    FMOD_RESULT result = instance.Create();
+    if (result != FMOD_OK)
+    {
+        printf("%-28s create failed (%d)\n", host.GetDescription()->name, result);
+        return false;
+    }
+    ApplyParameters(host, instance, settings.parameters);
+
+    // The noise stops on the same frame whatever the block size, so runs at different block sizes hear the same input
+    std::vector<float> inbuffer(blockSize * channels), outbuffer(blockSize * channels), output;
+    unsigned int seed = 1;
+    unsigned int activeFrames = (unsigned int)(settings.sampleRate * settings.seconds);
+    unsigned int activeBlocks = (activeFrames + blockSize - 1) / blockSize;
+    unsigned int idleBlocks = 16, skippedBlocks = 0;
+    float peak = 0.0f;
+    bool finite = true;
+    bool keep = !settings.renderPath.empty() || !settings.comparePath.empty();
+
+    for (unsigned int block = 0; block < activeBlocks + idleBlocks; block++)
+    {
+        bool inputsidle = settings.idle && block >= activeBlocks;
+
+        for (size_t i = 0; i < inbuffer.size(); i++)
+        {
+            bool active = block * blockSize + i / channels < activeFrames;
+            inbuffer[i] = active ? NextNoise(seed) * 0.5f : 0.0f;
+        }
+
+        host.BeginMix();
+        result = instance.Process(inbuffer.data(), outbuffer.data(), blockSize, channels, inputsidle);
+        host.EndMix();
+
+        if (result != FMOD_OK)
+        {
+            printf("%-28s process failed (%d)\n", host.GetDescription()->name, result);
+            return false;
+        }
+
+        skippedBlocks += instance.IsIdle() ? 1 : 0;
+
+        for (size_t i = 0; i < outbuffer.size(); i++)
+        {
+            finite = finite && isfinite(outbuffer[i]);
+            peak = fmaxf(peak, fabsf(outbuffer[i]));
+        }
+
+        if (keep)
+        {
+            output.insert(output.end(), outbuffer.begin(), outbuffer.end());
+        }
+    }
+
+    instance.Release();
+
+    printf("%-28s %2d params  %u/%u blocks skipped  peak %.3f%s\n", host.GetDescription()->name, host.GetDescription()->numparameters, skippedBlocks, activeBlocks + idleBlocks, peak, finite ? "" : "  NON-FINITE OUTPUT");
+
+    bool passed = finite;
+    if (!settings.renderPath.empty())
+    {
+        passed = WriteOutput(settings.renderPath, output) && passed;
+    }
+    if (!settings.comparePath.empty())
+    {
+        passed = CompareOutput(settings.comparePath, output, channels, settings.tolerance) && passed;
+    }
+    return passed;
+}
+
+static void PrintUsage(const char* program)
+{
+    fprintf(stderr,
+            "usage: %s [options] [plugin.so...]\n"
+            "  --rate hz                mixer sample rate (default 48000)\n"
+            "  --block frames           mixer block size (default 1024)\n"
+            "  --channels n             channels in and out (default 2)\n"
+            "  --seconds s              length of the noise before the idle blocks (default 1)\n"
+            "  --no-idle                keep the input marked active through the silent blocks, so every block runs\n"
+            "  --param Name=value       set a parameter on every plugin that has it, may repeat\n"
+            "  --render file            write the output as raw interleaved floats, one plugin only\n"
+            "  --compare file           fail unless the output matches a render, one plugin only\n"
+            "  --tolerance x            largest difference --compare allows (default 1e-5)\n", program);
+}
+
+int main(int argc, char* argv[])
+{
+    HostSettings settings;
+    settings.sampleRate = 48000;
+    settings.blockSize = 1024;
+    settings.channels = 2;
+    settings.seconds = 1.0f;
+    settings.idle = true;
+    settings.tolerance = 1e-5f;
+    std::vector<std::string> paths;
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool hasValue = i + 1 < argc;
+
+        if (strcmp(argv[i], "--rate") == 0 && hasValue)
+        {
+            settings.sampleRate = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--block") == 0 && hasValue)
+        {
+            settings.blockSize = (unsigned int)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--channels") == 0 && hasValue)
+        {
+            settings.channels = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--seconds") == 0 && hasValue)
+        {
+            settings.seconds = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--no-idle") == 0)
+        {
+            settings.idle = false;
+        }
+        else if (strcmp(argv[i], "--param") == 0 && hasValue)
+        {
+            const char* text = argv[++i];
+            const char* equals = strchr(text, '=');
+            if (!equals)
+            {
+                PrintUsage(argv[0]);
+                return 1;
+            }
+
+            ParameterOverride parameter;
+            parameter.name = std::string(text, equals - text);
+            parameter.value = (float)atof(equals + 1);
+            settings.parameters.push_back(parameter);
+        }
+        else if (strcmp(argv[i], "--render") == 0 && hasValue)
+        {
+            settings.renderPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--compare") == 0 && hasValue)
+        {
+            settings.comparePath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--tolerance") == 0 && hasValue)
+        {
+            settings.tolerance = (float)atof(argv[++i]);
+        }
+        else
+        {
+            paths.push_back(argv[i]);
+        }
+    }
+
+    if (paths.empty())
+    {
+        paths = PluginHost::FindPlugins(PLUGIN_DIR);
+    }
+
+    // A render is one plugin's output, so writing or checking one needs the plugin named
+    bool rendering = !settings.renderPath.empty() || !settings.comparePath.empty();
+    if (paths.empty() || (rendering && paths.size() != 1))
+    {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    int failures = 0;
+    for (size_t i = 0; i < paths.size(); i++)
+    {
+        failures += RunPlugin(paths[i], settings) ? 0 : 1;
+    }
+
+    return failures ? 1 : 0;
+}
@@ -8,6 +8,7 @@
 //
 
 #include <math.h>
+#include <new>
 #include <stdio.h>
 #include <string>
 #include <vector>
@@ -100,7 +101,7 @@ typedef std::vector<float> DelayBuffer;
 class Plugin
 {
 public:
-    Plugin() : m_numberOfChannels(0), m_maxSize(0), m_writePos(0) { }
+    Plugin() : m_buffer(nullptr), m_maxSize(0), m_numberOfChannels(0), m_writePos(0) { }
     void Init (unsigned int numChannels);
     void Release () { delete m_buffer; }
     
@@ -175,12 +176,12 @@ void Plugin::Read(float *inbuffer, float *outbuffer, unsigned int length, int ch
 FMOD_RESULT Create_Callback                     (FMOD_DSP_STATE *dsp_state)
 {
     // create our plugin class and attach to fmod
-    Plugin* state = (Plugin* )FMOD_DSP_ALLOC(dsp_state, sizeof(Plugin));
-    dsp_state->plugindata = state;
-    if (!dsp_state->plugindata)
+    void* memory = FMOD_DSP_ALLOC(dsp_state, sizeof(Plugin));
+    if (!memory)
     {
         return FMOD_ERR_MEMORY;
     }
+    dsp_state->plugindata = new (memory) Plugin();
     
     return FMOD_OK;
 }
@@ -190,6 +191,7 @@ FMOD_RESULT Release_Callback                    (FMOD_DSP_STATE *dsp_state)
     // release our plugin class
     Plugin* state = (Plugin* )dsp_state->plugindata;
     state->Release();
+    state->~Plugin();
     FMOD_DSP_FREE(dsp_state, state);
     
     return FMOD_OK;
@@ -8,12 +8,15 @@
 //  This file is a 'blank' plugin that does not process audio and only lets it pass through
 
 #include <math.h>
+#include <new>
 #include <stdio.h>
 #include <string>
 #include <vector>
 
 #include "fmod.hpp"
 
+#include "DenormalGuard.hpp"
+
 extern "C"
 {
     F_EXPORT FMOD_DSP_DESCRIPTION* F_CALL FMODGetDSPDescription();
@@ -201,6 +204,10 @@ b0(0),
 b1(0),
 b2(0),
 m_bufferLength(0),
+m_ym1(nullptr),
+m_ym2(nullptr),
+m_xm1(nullptr),
+m_xm2(nullptr),
 m_channels(0),
 m_sampleRate(44100),
 m_frequency(PLUGIN_INIT_FREQ),
@@ -391,7 +398,7 @@ void Plugin::Read(float *inbuffer, float *outbuffer, unsigned int length, int ch
             xn = *inbuffer++;
             
             //yn = (b0*xn + b1*xm1 + b2*xm2 - a1*ym1 - a1*ym2) * (1 / a0);
-            yn = (b0 / a0) * xn + (b1 / a0) * xm1 + (b2 / a0) * xm2 - (a1 / a0) * ym1 - (a2 / a0) * ym2;
+            yn = FlushDenormal((b0 / a0) * xn + (b1 / a0) * xm1 + (b2 / a0) * xm2 - (a1 / a0) * ym1 - (a2 / a0) * ym2);
             
             (*m_xm2)[n] = xm1;
             (*m_xm1)[n] = xn;
@@ -411,12 +418,15 @@ void Plugin::Read(float *inbuffer, float *outbuffer, unsigned int length, int ch
 
 FMOD_RESULT Create_Callback                     (FMOD_DSP_STATE *dsp_state)
 {
-    Plugin* state = (Plugin* )FMOD_DSP_ALLOC(dsp_state, sizeof(Plugin));
-    dsp_state->plugindata = state;
-    if (!dsp_state->plugindata)
+    void* memory = FMOD_DSP_ALLOC(dsp_state, sizeof(Plugin));
+    if (!memory)
     {
         return FMOD_ERR_MEMORY;
     }
+    
+    // FMOD's memory is not zeroed, so the class is constructed in place to null the buffers before they are made
+    Plugin* state = new (memory) Plugin();
+    dsp_state->plugindata = state;
     state->Init(dsp_state);
     return FMOD_OK;
 }
@@ -425,6 +435,7 @@ FMOD_RESULT Release_Callback                    (FMOD_DSP_STATE *dsp_state)
 {
     Plugin* state = (Plugin* )dsp_state->plugindata;
     state->Release();
+    state->~Plugin();
     FMOD_DSP_FREE(dsp_state, state);
     
     return FMOD_OK;
@@ -466,15 +477,16 @@ FMOD_RESULT Process_Callback                    (FMOD_DSP_STATE *dsp_state, unsi
             break;
             
         case FMOD_DSP_PROCESS_PERFORM:
-            
+        {
             if (inputsidle)
             {
                 return FMOD_ERR_DSP_DONTPROCESS;
             }
             
+            DenormalGuard guard;
             state->Read(inbufferarray[0].buffers[0], outbufferarray[0].buffers[0], length, outbufferarray[0].buffernumchannels[0]);
             return FMOD_OK;
-            break;
+        }
     }
     
     return FMOD_OK;
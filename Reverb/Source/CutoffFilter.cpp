@@ -6,6 +6,7 @@
 //  Copyright © 2018 James Kelly. All rights reserved.
 //
 
+#include "DenormalGuard.hpp"
 #include "CutoffFilter.hpp"
 
 void CutoffFilter::Init(FMOD_DSP_STATE* dsp_state)
@@ -20,6 +21,8 @@ void CutoffFilter::Init(FMOD_DSP_STATE* dsp_state)
     
     m_xBuffer->Init(dsp_state, 1);
     m_yBuffer->Init(dsp_state, 1);
+    m_xBuffer->SetStorage(DELAY_STORAGE_POWER_OF_TWO);
+    m_yBuffer->SetStorage(DELAY_STORAGE_POWER_OF_TWO);
     
     m_isHighpass = false;
 }
@@ -77,7 +80,7 @@ void CutoffFilter::Read(float *inbuffer, float *outbuffer, unsigned int length,
                 
                 // Store previous values
                 m_xBuffer->WriteDelay(*inbuffer++);
-                m_yBuffer->WriteDelay(*outbuffer++);
+                m_yBuffer->WriteDelay(FlushDenormal(*outbuffer++));
                 
                 m_xBuffer->TickChannel();
                 m_yBuffer->TickChannel();
@@ -116,7 +119,7 @@ void CutoffFilter::ReadSingle(float *inSample, float *outSample, int channels)
     
     // Store previous values
     m_xBuffer->WriteDelay(*inSample);
-    m_yBuffer->WriteDelay(*outSample);
+    m_yBuffer->WriteDelay(FlushDenormal(*outSample));
     
     m_xBuffer->TickChannel();
     m_yBuffer->TickChannel();
@@ -150,8 +153,8 @@ void CutoffFilter::ReadSingle(float *inSample, float *outSample, int channels, f
     }
     
     // Store previous values
-    m_xBuffer->WriteDelay(*inSample + (*outSample * feedback));
-    m_yBuffer->WriteDelay(*outSample);
+    m_xBuffer->WriteDelay(FlushDenormal(*inSample + (*outSample * feedback)));
+    m_yBuffer->WriteDelay(FlushDenormal(*outSample));
     
     m_xBuffer->TickChannel();
     m_yBuffer->TickChannel();
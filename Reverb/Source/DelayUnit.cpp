@@ -8,9 +8,15 @@
 
 #include "DelayUnit.hpp"
 
+#include <algorithm>
+#include <stdint.h>
+#include <string.h>
+
 void DelayUnit::Init(FMOD_DSP_STATE* dsp_state)
 {
     m_writePos = 0;
+    m_writeFrame = 0;
+    m_writeChannel = 0;
     m_delayTime = DELAY_PLUGIN_INIT_DELAY_TIME_MS;
     m_feedbackAmount = DELAY_PLUGIN_FEEDBACK_INIT;
     m_dryAmount = DELAY_PLUGIN_LEVELS_INIT;
@@ -27,6 +33,8 @@ void DelayUnit::Init(FMOD_DSP_STATE* dsp_state)
 void DelayUnit::Init(FMOD_DSP_STATE* dsp_state, float max_delay_ms)
 {
     m_writePos = 0;
+    m_writeFrame = 0;
+    m_writeChannel = 0;
     m_delayTime = DELAY_PLUGIN_INIT_DELAY_TIME_MS;
     m_feedbackAmount = DELAY_PLUGIN_FEEDBACK_INIT;
     m_dryAmount = DELAY_PLUGIN_LEVELS_INIT;
@@ -40,6 +48,8 @@ void DelayUnit::Init(FMOD_DSP_STATE* dsp_state, float max_delay_ms)
 void DelayUnit::Init(FMOD_DSP_STATE* dsp_state, int max_samples)
 {
     m_writePos = 0;
+    m_writeFrame = 0;
+    m_writeChannel = 0;
     m_delayTime = 1;
     m_feedbackAmount = DELAY_PLUGIN_FEEDBACK_INIT;
     m_dryAmount = DELAY_PLUGIN_LEVELS_INIT;
@@ -52,21 +62,155 @@ void DelayUnit::Init(FMOD_DSP_STATE* dsp_state, int max_samples)
 
 void DelayUnit::CreateBuffers(int channels)
 {
-    if (m_numOfChannels != channels)
+    if (m_numOfChannels != channels || !m_delayBuffer)
+    {
+        SetLayout(channels);
+        
+        delete m_delayBuffer;
+        m_delayBuffer = new DelayBuffer(GetStorageSize(channels));
+        AttachStorage(m_delayBuffer->data());
+    }
+}
+
+void DelayUnit::CreateBuffers(int channels, float* storage)
+{
+    if (m_numOfChannels != channels || m_storageBlock != storage)
     {
-        m_numOfChannels = channels;
+        SetLayout(channels);
+        
+        delete m_delayBuffer;
+        m_delayBuffer = nullptr;
         
-        m_delayBuffer = new DelayBuffer(GetMaxBufferSize());
+        // The memory may have held a different layout, so start from silence like a fresh buffer would
+        memset(storage, 0, GetStorageSize(channels) * sizeof(float));
+        AttachStorage(storage);
+    }
+}
+
+int DelayUnit::GetStorageSize(int channels) const
+{
+    int capacity = m_maxSampleDelayTime;
+    int padding = 0;
+    
+    if (m_storage == DELAY_STORAGE_POWER_OF_TWO)
+    {
+        capacity = 1;
+        while (capacity < m_maxSampleDelayTime) capacity <<= 1;
+    }
+    else if (m_storage == DELAY_STORAGE_PLANAR)
+    {
+        padding = DELAY_UNIT_LANE_ALIGNMENT / sizeof(float);
+        capacity = padding;
+        while (capacity < m_maxSampleDelayTime) capacity <<= 1;
     }
+    
+    // History, then one allpass state per channel
+    return capacity * channels + channels + padding;
+}
+
+void DelayUnit::SetLayout(int channels)
+{
+    m_numOfChannels = channels;
+    m_writePos = 0;
+    m_writeFrame = 0;
+    m_writeChannel = 0;
+    m_writtenSamples = 0;
+    
+    if (m_storage == DELAY_STORAGE_POWER_OF_TWO)
+    {
+        // Round up so wrapping the sample index is a mask instead of a compare or a loop
+        m_capacity = 1;
+        while (m_capacity < m_maxSampleDelayTime) m_capacity <<= 1;
+        m_mask = m_capacity - 1;
+        m_frameStride = m_numOfChannels;
+        m_channelStride = 1;
+    }
+    else if (m_storage == DELAY_STORAGE_PLANAR)
+    {
+        // Every lane is at least a cache line long, so with the first lane aligned they all are
+        m_capacity = DELAY_UNIT_LANE_ALIGNMENT / sizeof(float);
+        while (m_capacity < m_maxSampleDelayTime) m_capacity <<= 1;
+        m_mask = m_capacity - 1;
+        m_frameStride = 1;
+        m_channelStride = m_capacity;
+    }
+}
+
+void DelayUnit::AttachStorage(float* storage)
+{
+    m_storageBlock = storage;
+    
+    if (m_storage == DELAY_STORAGE_PLANAR)
+    {
+        uintptr_t address = (uintptr_t)storage;
+        m_lanes = (float*)((address + DELAY_UNIT_LANE_ALIGNMENT - 1) & ~(uintptr_t)(DELAY_UNIT_LANE_ALIGNMENT - 1));
+    }
+    else
+    {
+        m_lanes = storage;
+    }
+    
+    m_allpassState = m_lanes + (IsMasked() ? m_capacity : m_maxSampleDelayTime) * m_numOfChannels;
+}
+
+void DelayUnit::SetStorage(DELAYSTORAGE storage)
+{
+    if (m_storage != storage)
+    {
+        m_storage = storage;
+        m_numOfChannels = -1;   // force CreateBuffers to rebuild with the new layout
+    }
+}
+
+void DelayUnit::Clear()
+{
+    if (m_lanes && m_numOfChannels > 0)
+    {
+        // Writing starts from the first sample after a clear, so nothing past the samples written since holds anything.
+        // Linear storage moves a channel at a time without counting, so its write position is the mark until it wraps
+        int capacity = GetCapacity();
+        int samples = std::min(std::max(m_writtenSamples, GetWriteSample()) + 1, capacity);
+        
+        if (m_storage == DELAY_STORAGE_PLANAR)
+        {
+            for (int n = 0; n < m_numOfChannels; n++)
+            {
+                memset(m_lanes + n * m_channelStride, 0, samples * sizeof(float));
+            }
+        }
+        else
+        {
+            memset(m_lanes, 0, samples * m_numOfChannels * sizeof(float));
+        }
+        memset(m_allpassState, 0, m_numOfChannels * sizeof(float));
+    }
+    
+    m_writePos = 0;
+    m_writeFrame = 0;
+    m_writeChannel = 0;
+    m_writtenSamples = 0;
 }
 
 void DelayUnit::Release()
 {
     delete m_delayBuffer;
+    m_delayBuffer = nullptr;
+    m_storageBlock = nullptr;
+    m_lanes = nullptr;
+    m_allpassState = nullptr;
+    m_numOfChannels = -1;
 }
 
 void DelayUnit::TickSample()
 {
+    m_writtenSamples = std::min(m_writtenSamples + 1, GetCapacity());
+    
+    if (IsMasked())
+    {
+        m_writeFrame = (m_writeFrame + 1) & m_mask;
+        return;
+    }
+    
     int bufferLength = GetMaxBufferSize();
     
     m_writePos += m_numOfChannels;  // move forward one samples (or move forward all channels until we are at the same channel but at sample n+1
@@ -75,14 +219,158 @@ void DelayUnit::TickSample()
 
 void DelayUnit::TickChannel()
 {
+    if (IsMasked())
+    {
+        // Move to the next channel, and on to the next sample once every channel has been written
+        if (++m_writeChannel >= m_numOfChannels)
+        {
+            m_writeChannel = 0;
+            m_writeFrame = (m_writeFrame + 1) & m_mask;
+            m_writtenSamples = std::min(m_writtenSamples + 1, m_capacity);
+        }
+        return;
+    }
+    
     int bufferLength = GetMaxBufferSize();
     m_writePos++;   // Move foward 1, or one channel
-    if (m_writePos >= bufferLength) m_writePos = 0;   // If we are at the end of the buffer, go to the start
+    if (m_writePos >= bufferLength)
+    {
+        m_writePos = 0;   // If we are at the end of the buffer, go to the start
+        m_writtenSamples = m_maxSampleDelayTime;
+    }
+}
+
+int DelayUnit::GetInterpolationTaps(float delayInSamples, int *taps, float *weights) const
+{
+    // The four point kernels reach one sample nearer than the delay, so never go under a sample
+    delayInSamples = std::max(delayInSamples, 1.0f);
+    
+    int whole = (int)delayInSamples;
+    float t = delayInSamples - whole;
+    
+    switch (m_interpolation)
+    {
+        case DELAY_INTERPOLATION_HERMITE:
+        case DELAY_INTERPOLATION_LAGRANGE:
+        {
+            // Points one nearer, at, one past and two past the whole delay
+            for (int k = 0; k < 4; k++)
+            {
+                taps[k] = whole - 1 + k;
+            }
+            
+            if (m_interpolation == DELAY_INTERPOLATION_HERMITE)
+            {
+                float t2 = t * t, t3 = t2 * t;
+                weights[0] = 0.5f * (-t + 2.0f * t2 - t3);
+                weights[1] = 0.5f * (2.0f - 5.0f * t2 + 3.0f * t3);
+                weights[2] = 0.5f * (t + 4.0f * t2 - 3.0f * t3);
+                weights[3] = 0.5f * (t3 - t2);
+            }
+            else
+            {
+                weights[0] = -t * (t - 1.0f) * (t - 2.0f) * (1.0f / 6.0f);
+                weights[1] = (t + 1.0f) * (t - 1.0f) * (t - 2.0f) * 0.5f;
+                weights[2] = -(t + 1.0f) * t * (t - 2.0f) * 0.5f;
+                weights[3] = (t + 1.0f) * t * (t - 1.0f) * (1.0f / 6.0f);
+            }
+            return 4;
+        }
+            
+        case DELAY_INTERPOLATION_THIRAN:
+        {
+            // Keep the allpass delay between a half and one and a half samples, away from the pole at Nyquist
+            if (t < 0.5f)
+            {
+                whole -= 1;
+            }
+            
+            taps[0] = whole;
+            taps[1] = whole + 1;
+            weights[0] = GetThiranCoefficient(delayInSamples);
+            weights[1] = 1.0f;
+            return 2;
+        }
+            
+        default:
+        {
+            taps[0] = whole;
+            taps[1] = whole + 1;
+            weights[0] = 1.0f - t;
+            weights[1] = t;
+            return 2;
+        }
+    }
+}
+
+float DelayUnit::GetThiranCoefficient(float delayInSamples) const
+{
+    delayInSamples = std::max(delayInSamples, 1.0f);
+    
+    int whole = (int)delayInSamples;
+    float fraction = delayInSamples - whole;
+    if (fraction < 0.5f)
+    {
+        fraction += 1.0f;
+    }
+    
+    return (1.0f - fraction) / (1.0f + fraction);
+}
+
+float DelayUnit::GetDelayedSampleInterpolated(float delayInSamples)
+{
+    if (m_interpolation == DELAY_INTERPOLATION_LINEAR)
+    {
+        int whole = (int)delayInSamples;
+        float r = delayInSamples - whole;
+        
+        float previousValue = m_lanes[GetMaskedIndex(m_writeFrame - whole, m_writeChannel)];
+        float nextValue = m_lanes[GetMaskedIndex(m_writeFrame - whole - 1, m_writeChannel)];
+        
+        return previousValue + (nextValue - previousValue) * r;
+    }
+    
+    // The delay rarely changes between reads, so the taps and weights are only worked out when it does
+    if (delayInSamples != m_interpolationDelay)
+    {
+        m_numInterpolationTaps = GetInterpolationTaps(delayInSamples, m_interpolationTaps, m_interpolationWeights);
+        m_interpolationDelay = delayInSamples;
+    }
+    
+    float value = 0.0f;
+    
+    if (IsMasked())
+    {
+        // Few enough taps to index directly instead of going through a batch
+        int channelOffset = m_writeChannel * m_channelStride;
+        for (int k = 0; k < m_numInterpolationTaps; k++)
+        {
+            value += m_lanes[((m_writeFrame - m_interpolationTaps[k]) & m_mask) * m_frameStride + channelOffset] * m_interpolationWeights[k];
+        }
+    }
+    else
+    {
+        value = GetDelayedSampleTaps(m_interpolationTaps, m_interpolationWeights, m_numInterpolationTaps);
+    }
+    
+    if (m_interpolation == DELAY_INTERPOLATION_THIRAN)
+    {
+        float& state = m_allpassState[GetWriteChannel()];
+        value -= m_interpolationWeights[0] * state;
+        state = value;
+    }
+    
+    return value;
 }
 
 float DelayUnit::GetDelayedSample()
 {
-    if (m_delayBuffer)
+    if (m_lanes && (IsMasked() || m_interpolation != DELAY_INTERPOLATION_LINEAR))
+    {
+        return GetDelayedSampleInterpolated(MS_TO_SAMPLES(m_delayTime, m_sampleRate));
+    }
+    
+    if (m_lanes)
     {
         float r, previousIndex, nextIndex;
         int bufferLength = GetMaxBufferSize();
@@ -101,8 +389,8 @@ float DelayUnit::GetDelayedSample()
         
         float previousValue, nextValue;
         
-        previousValue = (*m_delayBuffer)[(int)previousIndex];
-        nextValue = (*m_delayBuffer)[(int)nextIndex];
+        previousValue = m_lanes[(int)previousIndex];
+        nextValue = m_lanes[(int)nextIndex];
         
         return (previousValue*(1-r)+nextValue*r);
     }
@@ -111,7 +399,12 @@ float DelayUnit::GetDelayedSample()
 
 float DelayUnit::GetDelayedSampleAt(float ms)
 {
-    if (m_delayBuffer)
+    if (m_lanes && (IsMasked() || m_interpolation != DELAY_INTERPOLATION_LINEAR))
+    {
+        return GetDelayedSampleInterpolated(MS_TO_SAMPLES(ms, m_sampleRate));
+    }
+    
+    if (m_lanes)
     {
         float r, previousIndex, nextIndex;
         int bufferLength = GetMaxBufferSize();
@@ -130,8 +423,8 @@ float DelayUnit::GetDelayedSampleAt(float ms)
         
         float previousValue, nextValue;
         
-        previousValue = (*m_delayBuffer)[(int)previousIndex];
-        nextValue = (*m_delayBuffer)[(int)nextIndex];
+        previousValue = m_lanes[(int)previousIndex];
+        nextValue = m_lanes[(int)nextIndex];
         
         return (previousValue*(1-r)+nextValue*r);
     }
@@ -141,7 +434,13 @@ float DelayUnit::GetDelayedSampleAt(float ms)
 
 float DelayUnit::GetDelayedSampleAt(int sample)
 {
-    if (m_delayBuffer)
+    if (m_lanes && IsMasked())
+    {
+        // Whole samples never need interpolating
+        return m_lanes[GetMaskedIndex(m_writeFrame - sample, m_writeChannel)];
+    }
+    
+    if (m_lanes)
     {
         float r, previousIndex, nextIndex;
         int bufferLength = GetMaxBufferSize();
@@ -160,8 +459,8 @@ float DelayUnit::GetDelayedSampleAt(int sample)
         
         float previousValue, nextValue;
         
-        previousValue = (*m_delayBuffer)[(int)previousIndex];
-        nextValue = (*m_delayBuffer)[(int)nextIndex];
+        previousValue = m_lanes[(int)previousIndex];
+        nextValue = m_lanes[(int)nextIndex];
         
         return (previousValue*(1-r)+nextValue*r);
     }
@@ -171,9 +470,13 @@ float DelayUnit::GetDelayedSampleAt(int sample)
 
 void DelayUnit::WriteDelay(float value)
 {
-    if (m_delayBuffer)
+    if (m_lanes && IsMasked())
+    {
+        m_lanes[GetMaskedIndex(m_writeFrame, m_writeChannel)] = value;
+    }
+    else if (m_lanes)
     {
-        (*m_delayBuffer)[m_writePos] = value;
+        m_lanes[m_writePos] = value;
     }
 }
 
@@ -208,3 +511,448 @@ void DelayUnit::ReadSingle(float *inSample, float *outSample)
     
     TickChannel();
 }
+
+
+void DelayUnit::GetTapIndices(const int *taps, int *indices, int numTaps) const
+{
+    if (IsMasked())
+    {
+        int channelOffset = m_writeChannel * m_channelStride;
+        
+        for (int k = 0; k < numTaps; k++)
+        {
+            indices[k] = ((m_writeFrame - taps[k]) & m_mask) * m_frameStride + channelOffset;
+        }
+        return;
+    }
+    
+    int frame = m_writePos / m_numOfChannels;
+    int channel = m_writePos - (frame * m_numOfChannels);
+    
+    for (int k = 0; k < numTaps; k++)
+    {
+        indices[k] = WrapSample(frame - taps[k]) * m_numOfChannels + channel;
+    }
+}
+
+float DelayUnit::GetDelayedSampleTaps(const int *taps, const float *gains, int numTaps)
+{
+    if (!m_lanes)
+    {
+        return 0.0f;
+    }
+    
+    const float* buffer = GetStorageStart();
+    int indices[DELAY_UNIT_TAP_BATCH];
+    float sum = 0.0f;
+    
+    for (int first = 0; first < numTaps; first += DELAY_UNIT_TAP_BATCH)
+    {
+        int count = std::min(numTaps - first, DELAY_UNIT_TAP_BATCH);
+        GetTapIndices(taps + first, indices, count);
+        
+        for (int k = 0; k < count; k++)
+        {
+            sum += buffer[indices[k]] * gains[first + k];
+        }
+    }
+    
+    return sum;
+}
+
+void DelayUnit::GetDelayedSamplesAt(const int *taps, float *values, int numTaps)
+{
+    if (!m_lanes)
+    {
+        memset(values, 0, numTaps * sizeof(float));
+        return;
+    }
+    
+    const float* buffer = GetStorageStart();
+    int indices[DELAY_UNIT_TAP_BATCH];
+    
+    for (int first = 0; first < numTaps; first += DELAY_UNIT_TAP_BATCH)
+    {
+        int count = std::min(numTaps - first, DELAY_UNIT_TAP_BATCH);
+        GetTapIndices(taps + first, indices, count);
+        
+        for (int k = 0; k < count; k++)
+        {
+            values[first + k] = buffer[indices[k]];
+        }
+    }
+}
+
+int DelayUnit::WrapSample(int sample) const
+{
+    if (IsMasked())
+    {
+        return sample & m_mask;
+    }
+    
+    sample %= m_maxSampleDelayTime;
+    return sample < 0 ? sample + m_maxSampleDelayTime : sample;
+}
+
+void DelayUnit::AdvanceSamples(unsigned int length)
+{
+    m_writtenSamples = std::min(m_writtenSamples + (int)length, GetCapacity());
+    
+    if (IsMasked())
+    {
+        m_writeFrame = (m_writeFrame + length) & m_mask;
+    }
+    else
+    {
+        m_writePos = WrapSample(m_writePos / m_numOfChannels + length) * m_numOfChannels;
+    }
+}
+
+void DelayUnit::CopyFromBuffer(float *outbuffer, int start, unsigned int length) const
+{
+    if (m_storage != DELAY_STORAGE_PLANAR)
+    {
+        memcpy(outbuffer, m_lanes + start * m_numOfChannels, length * m_numOfChannels * sizeof(float));
+        return;
+    }
+    
+    // Each lane is read front to back, the interleaved output is filled one channel at a time
+    for (int n = 0; n < m_numOfChannels; n++)
+    {
+        const float* lane = m_lanes + GetMaskedIndex(start, n);
+        float* outSample = outbuffer + n;
+        
+        for (unsigned int i = 0; i < length; i++)
+        {
+            outSample[i * m_numOfChannels] = lane[i];
+        }
+    }
+}
+
+void DelayUnit::CopyToBuffer(const float *inbuffer, int start, unsigned int length)
+{
+    if (m_storage != DELAY_STORAGE_PLANAR)
+    {
+        memcpy(m_lanes + start * m_numOfChannels, inbuffer, length * m_numOfChannels * sizeof(float));
+        return;
+    }
+    
+    for (int n = 0; n < m_numOfChannels; n++)
+    {
+        float* lane = m_lanes + GetMaskedIndex(start, n);
+        const float* inSample = inbuffer + n;
+        
+        for (unsigned int i = 0; i < length; i++)
+        {
+            lane[i] = inSample[i * m_numOfChannels];
+        }
+    }
+}
+
+void DelayUnit::ReadBlock(float *outbuffer, unsigned int length)
+{
+    ReadBlockInterpolated(outbuffer, length, GetDelayTimeInSamples());
+}
+
+void DelayUnit::ReadBlock(float *outbuffer, unsigned int length, float ms)
+{
+    ReadBlockInterpolated(outbuffer, length, MS_TO_SAMPLES(ms, m_sampleRate));
+}
+
+void DelayUnit::ReadBlock(float *outbuffer, unsigned int length, int samples)
+{
+    if (!m_lanes)
+    {
+        return;
+    }
+    
+    int capacity = GetCapacity();
+    int start = WrapSample(GetWriteSample() - samples);
+    
+    // The span only splits where it runs off the end of the buffer
+    while (length)
+    {
+        unsigned int run = std::min(length, (unsigned int)(capacity - start));
+        CopyFromBuffer(outbuffer, start, run);
+        
+        outbuffer += run * m_numOfChannels;
+        length -= run;
+        start = 0;
+    }
+}
+
+void DelayUnit::ReadBlockInterpolated(float *outbuffer, unsigned int length, float delayInSamples)
+{
+    if (!m_lanes)
+    {
+        return;
+    }
+    
+    if (m_interpolation != DELAY_INTERPOLATION_LINEAR)
+    {
+        // The higher orders are a short weighted sum of whole sample taps, which vectorises across channels and samples
+        int taps[4];
+        float weights[4];
+        int numTaps = GetInterpolationTaps(delayInSamples, taps, weights);
+        ReadBlockTaps(outbuffer, length, taps, weights, numTaps);
+        
+        if (m_interpolation == DELAY_INTERPOLATION_THIRAN)
+        {
+            // The allpass feedback runs along each channel, so the inner loop goes across channels
+            float coefficient = weights[0];
+            float* state = m_allpassState;
+            
+            for (unsigned int i = 0; i < length; i++)
+            {
+                float* outSample = outbuffer + i * m_numOfChannels;
+                
+                for (int n = 0; n < m_numOfChannels; n++)
+                {
+                    outSample[n] -= coefficient * state[n];
+                    state[n] = outSample[n];
+                }
+            }
+        }
+        return;
+    }
+    
+    int whole = (int)delayInSamples;
+    float r = delayInSamples - whole;
+    
+    ReadBlock(outbuffer, length, whole);
+    
+    if (r <= 0.0f)
+    {
+        return;
+    }
+    
+    // Blend each sample towards the one a sample further back on the same channel
+    int capacity = GetCapacity();
+    int next = WrapSample(GetWriteSample() - whole - 1);
+    
+    while (length)
+    {
+        unsigned int run = std::min(length, (unsigned int)(capacity - next));
+        unsigned int count = run * m_numOfChannels;
+        
+        if (m_storage == DELAY_STORAGE_PLANAR)
+        {
+            for (int n = 0; n < m_numOfChannels; n++)
+            {
+                const float* nextValue = m_lanes + GetMaskedIndex(next, n);
+                float* outSample = outbuffer + n;
+                
+                for (unsigned int i = 0; i < run; i++)
+                {
+                    outSample[i * m_numOfChannels] += (nextValue[i] - outSample[i * m_numOfChannels]) * r;
+                }
+            }
+        }
+        else
+        {
+            const float* nextValue = m_lanes + next * m_numOfChannels;
+            
+            for (unsigned int i = 0; i < count; i++)
+            {
+                outbuffer[i] += (nextValue[i] - outbuffer[i]) * r;
+            }
+        }
+        
+        outbuffer += count;
+        length -= run;
+        next = 0;
+    }
+}
+
+void DelayUnit::ReadBlockTaps(float *outbuffer, unsigned int length, const int *taps, const float *gains, int numTaps)
+{
+    if (!m_lanes)
+    {
+        return;
+    }
+    
+    int capacity = GetCapacity();
+    int writeSample = GetWriteSample();
+    
+    if (m_storage == DELAY_STORAGE_PLANAR)
+    {
+        // Sum every tap of one channel into a contiguous run, then interleave it once
+        float laneSum[DELAY_UNIT_BLOCK_SAMPLES];
+        
+        for (unsigned int done = 0; done < length; done += DELAY_UNIT_BLOCK_SAMPLES)
+        {
+            unsigned int pass = std::min(length - done, (unsigned int)DELAY_UNIT_BLOCK_SAMPLES);
+            
+            for (int n = 0; n < m_numOfChannels; n++)
+            {
+                SumLaneTaps(n, writeSample + done, laneSum, pass, taps, gains, numTaps);
+                
+                for (unsigned int i = 0; i < pass; i++)
+                {
+                    outbuffer[(done + i) * m_numOfChannels + n] = laneSum[i];
+                }
+            }
+        }
+        return;
+    }
+    
+    // Interleaved taps are one or two straight runs through the buffer added onto the output
+    memset(outbuffer, 0, length * m_numOfChannels * sizeof(float));
+    const float* buffer = m_lanes;
+    
+    for (int k = 0; k < numTaps; k++)
+    {
+        int start = WrapSample(writeSample - taps[k]);
+        float* outSample = outbuffer;
+        unsigned int remaining = length;
+        
+        while (remaining)
+        {
+            unsigned int run = std::min(remaining, (unsigned int)(capacity - start));
+            unsigned int count = run * m_numOfChannels;
+            const float* inSample = buffer + start * m_numOfChannels;
+            
+            for (unsigned int i = 0; i < count; i++)
+            {
+                outSample[i] += inSample[i] * gains[k];
+            }
+            
+            outSample += count;
+            remaining -= run;
+            start = 0;
+        }
+    }
+}
+
+void DelayUnit::ReadLaneTaps(int channel, float *outbuffer, unsigned int length, const int *taps, const float *gains, int numTaps)
+{
+    if (!m_lanes || m_storage != DELAY_STORAGE_PLANAR)
+    {
+        return;
+    }
+    
+    SumLaneTaps(channel, GetWriteSample(), outbuffer, length, taps, gains, numTaps);
+}
+
+void DelayUnit::SumLaneTaps(int channel, int fromSample, float *sum, unsigned int length, const int *taps, const float *gains, int numTaps) const
+{
+    // Each tap is one or two straight runs through the lane, so every multiply and add is a full vector wide.
+    // Taps go in fours, so the sum is loaded and stored once for every four of them. It is kept on the stack, where
+    // the compiler knows nothing else points, a block at a time
+    static_assert(DELAY_UNIT_TAP_GROUP == 4, "one term per tap of a group");
+    
+    const float* lane = m_lanes + channel * m_channelStride;
+    int capacity = GetCapacity();
+    float laneSum[DELAY_UNIT_BLOCK_SAMPLES];
+    
+    for (unsigned int done = 0; done < length; done += DELAY_UNIT_BLOCK_SAMPLES)
+    {
+        unsigned int pass = std::min(length - done, (unsigned int)DELAY_UNIT_BLOCK_SAMPLES);
+        memset(laneSum, 0, pass * sizeof(float));
+        
+        for (int first = 0; first < numTaps; first += DELAY_UNIT_TAP_GROUP)
+        {
+            int group = std::min(numTaps - first, DELAY_UNIT_TAP_GROUP);
+            int start[DELAY_UNIT_TAP_GROUP];
+            float gain[DELAY_UNIT_TAP_GROUP];
+            
+            // A short group has its missing taps read the first one's samples with no gain
+            for (int k = 0; k < DELAY_UNIT_TAP_GROUP; k++)
+            {
+                start[k] = WrapSample(fromSample + (int)done - taps[first + (k < group ? k : 0)]);
+                gain[k] = (k < group) ? gains[first + k] : 0.0f;
+            }
+            
+            unsigned int offset = 0;
+            while (offset < pass)
+            {
+                // Split wherever one of the taps runs off the end of the lane
+                unsigned int run = pass - offset;
+                for (int k = 0; k < DELAY_UNIT_TAP_GROUP; k++)
+                {
+                    run = std::min(run, (unsigned int)(capacity - start[k]));
+                }
+                
+                const float* a = lane + start[0];
+                const float* b = lane + start[1];
+                const float* c = lane + start[2];
+                const float* d = lane + start[3];
+                float* outSample = laneSum + offset;
+                
+                for (unsigned int i = 0; i < run; i++)
+                {
+                    outSample[i] += (a[i] * gain[0]) + (b[i] * gain[1]) + (c[i] * gain[2]) + (d[i] * gain[3]);
+                }
+                
+                offset += run;
+                for (int k = 0; k < DELAY_UNIT_TAP_GROUP; k++)
+                {
+                    start[k] = (start[k] + (int)run == capacity) ? 0 : start[k] + (int)run;
+                }
+            }
+        }
+        
+        memcpy(sum + done, laneSum, pass * sizeof(float));
+    }
+}
+
+void DelayUnit::WriteBlock(const float *inbuffer, unsigned int length)
+{
+    if (!m_lanes)
+    {
+        return;
+    }
+    
+    int capacity = GetCapacity();
+    int start = GetWriteSample();
+    
+    AdvanceSamples(length);
+    
+    while (length)
+    {
+        unsigned int run = std::min(length, (unsigned int)(capacity - start));
+        CopyToBuffer(inbuffer, start, run);
+        
+        inbuffer += run * m_numOfChannels;
+        length -= run;
+        start = 0;
+    }
+}
+
+void DelayUnit::ProcessBlock(const float *inbuffer, float *outbuffer, unsigned int length)
+{
+    if (!m_lanes)
+    {
+        return;
+    }
+    
+    float delayInSamples = GetDelayTimeInSamples();
+    float dry(GetDry()), wet(GetWet()), feedback(GetFeedback());
+    
+    // A pass can only read samples written before it, so it is never longer than the nearest tap
+    int nearestTap = (int)delayInSamples - (m_interpolation == DELAY_INTERPOLATION_LINEAR ? 0 : 1);
+    unsigned int maxPass = std::max(1, std::min(nearestTap, DELAY_UNIT_BLOCK_SAMPLES / m_numOfChannels));
+    float wetBlock[DELAY_UNIT_BLOCK_SAMPLES];
+    
+    while (length)
+    {
+        unsigned int pass = std::min(length, maxPass);
+        unsigned int count = pass * m_numOfChannels;
+        
+        ReadBlockInterpolated(wetBlock, pass, delayInSamples);
+        
+        for (unsigned int i = 0; i < count; i++)
+        {
+            float drySample(inbuffer[i]), wetSample(wetBlock[i]);
+            
+            outbuffer[i] = (drySample * dry) + (wetSample * wet);
+            wetBlock[i] = drySample + (wetSample * feedback);
+        }
+        
+        WriteBlock(wetBlock, pass);
+        
+        inbuffer += count;
+        outbuffer += count;
+        length -= pass;
+    }
+}
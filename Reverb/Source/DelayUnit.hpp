@@ -16,8 +16,8 @@
 
 #include "fmod.hpp"
 
-#define MS_TO_SAMPLES(__ms__, __rate__) ((__ms__ * __rate__) / 1000.0f)
-#define SAMPLES_TO_MS(__samples__, __rate__) ((__samples__ * 1000.0f) / __rate__)
+#define MS_TO_SAMPLES(__ms__, __rate__) (((__ms__) * (__rate__)) / 1000.0f)
+#define SAMPLES_TO_MS(__samples__, __rate__) (((__samples__) * 1000.0f) / (__rate__))
 #define DECIBELS_TO_LINEAR(__dbval__)  ((__dbval__ <= DELAY_PLUGIN_LEVELS_MIN) ? 0.0f : powf(10.0f, __dbval__ / 20.0f))
 #define LINEAR_TO_DECIBELS(__linval__) ((__linval__ <= 0.0f) ? DELAY_PLUGIN_LEVELS_MIN : 20.0f * log10f((float)__linval__))
 
@@ -34,14 +34,44 @@ const float DELAY_PLUGIN_FEEDBACK_MIN = 0.0f;
 const float DELAY_PLUGIN_FEEDBACK_MAX = 100.0f;
 const float DELAY_PLUGIN_FEEDBACK_INIT = 0.0f;
 
+/// Most samples (frames * channels) a block call works on in one pass. Bounds the scratch space kept on the stack
+const int DELAY_UNIT_BLOCK_SAMPLES = 1024;
+
+/// Taps whose indices are worked out together in one multi-tap read
+const int DELAY_UNIT_TAP_BATCH = 64;
+
+/// Taps a planar multi-tap read sums in one go through the samples
+const int DELAY_UNIT_TAP_GROUP = 4;
+
+/// Planar lanes start on a cache line boundary, in bytes
+const int DELAY_UNIT_LANE_ALIGNMENT = 64;
+
 typedef std::vector<float> DelayBuffer;
 
+/// How the delay buffer is laid out and wrapped
+enum DELAYSTORAGE
+{
+    DELAY_STORAGE_LINEAR = 0,       // Exactly the requested length, wrapped with compares
+    DELAY_STORAGE_POWER_OF_TWO,     // Length rounded up to a power of two, wrapped with a bitmask
+    DELAY_STORAGE_PLANAR,           // Power of two lanes, one contiguous cache aligned lane per channel behind a shared write head
+};
+
+/// How reads between two samples are worked out
+enum DELAYINTERPOLATION
+{
+    DELAY_INTERPOLATION_LINEAR = 0,     // Straight line between the two nearest samples
+    DELAY_INTERPOLATION_HERMITE,        // Cubic Hermite through the four nearest samples
+    DELAY_INTERPOLATION_LAGRANGE,       // Third order Lagrange polynomial through the four nearest samples
+    DELAY_INTERPOLATION_THIRAN,         // First order allpass. Flat magnitude, keeps one state per channel so only for a single moving read
+};
+
 /// Basic delay line that can change its delay length at initialisation
 class DelayUnit
 {
 public:
     DelayUnit() :
     m_delayBuffer(nullptr),
+    m_storageBlock(nullptr),
     m_writePos(0),
     m_delayTime(DELAY_PLUGIN_INIT_DELAY_TIME_MS),
     m_feedbackAmount(DELAY_PLUGIN_FEEDBACK_INIT),
@@ -49,7 +79,20 @@ public:
     m_wetAmount(DELAY_PLUGIN_LEVELS_INIT),
     m_sampleRate(44100),
     m_numOfChannels(-1),
-    m_maxSampleDelayTime(2)
+    m_maxSampleDelayTime(2),
+    m_storage(DELAY_STORAGE_LINEAR),
+    m_writeFrame(0),
+    m_writeChannel(0),
+    m_writtenSamples(0),
+    m_capacity(0),
+    m_mask(0),
+    m_lanes(nullptr),
+    m_frameStride(0),
+    m_channelStride(0),
+    m_interpolation(DELAY_INTERPOLATION_LINEAR),
+    m_interpolationDelay(-1.0f),
+    m_numInterpolationTaps(0),
+    m_allpassState(nullptr)
     { }
     
     ~DelayUnit()
@@ -72,9 +115,40 @@ public:
     /// Called before read. Creates buffers
     void CreateBuffers (int);
     
+    /// Called before read. Lays the buffers out in memory owned by the caller, which must hold GetStorageSize floats.
+    /// Nothing is allocated, and the memory is cleared only when the layout changes
+    void CreateBuffers (int, float*);
+    
+    /// Number of floats CreateBuffers needs for a channel count in the current storage, including alignment
+    int GetStorageSize (int) const;
+    
+    /// Choose how the buffer is stored. Takes effect on the next CreateBuffers
+    void SetStorage (DELAYSTORAGE);
+    
+    /// Silence the buffer and rewind the write position. Only the samples written since the last clear are zeroed
+    void Clear ();
+    
+    /// Get how the buffer is stored
+    DELAYSTORAGE GetStorage () const { return m_storage; }
+    
+    /// Number of samples per channel actually allocated. Equal to the max delay unless stored as a power of two
+    int GetCapacity () const { return IsMasked() ? m_capacity : m_maxSampleDelayTime; }
+    
+    /// Start of a channel's history in planar storage, indexed by sample and wrapped with the capacity. Null for other layouts
+    const float* GetLane (int channel) const { return m_storage == DELAY_STORAGE_PLANAR && m_lanes ? m_lanes + channel * m_channelStride : nullptr; }
+    
+    /// Choose how fractional reads are interpolated. Anything above linear reads at least one sample back
+    void SetInterpolation (DELAYINTERPOLATION interpolation) { m_interpolation = interpolation; m_interpolationDelay = -1.0f; }
+    
+    /// Get how fractional reads are interpolated
+    DELAYINTERPOLATION GetInterpolation () const { return m_interpolation; }
+    
     /// Get delay time in ms
     float GetDelayTime() const {return m_delayTime; }
     
+    /// Get delay time in samples
+    float GetDelayTimeInSamples() const { return MS_TO_SAMPLES(m_delayTime, m_sampleRate); }
+    
     /// Get linear feedback (0 - 1)
     float GetFeedback() const {return ((m_feedbackAmount > DELAY_PLUGIN_FEEDBACK_MAX) ? DELAY_PLUGIN_FEEDBACK_MAX : (m_feedbackAmount < DELAY_PLUGIN_FEEDBACK_MIN) ? DELAY_PLUGIN_FEEDBACK_MIN : m_feedbackAmount) / 100;}
     
@@ -128,10 +202,97 @@ public:
     
     void ReadSingle(float* inSample, float* outSample);
     
+    /// Weighted sum of several whole sample taps on the current channel
+    float GetDelayedSampleTaps(const int* taps, const float* gains, int numTaps);
+    
+    /// Value of each of several whole sample taps on the current channel
+    void GetDelayedSamplesAt(const int* taps, float* values, int numTaps);
+    
+    // Block calls work on whole samples of interleaved audio and must be made with the write position
+    // on the first channel. A read that is further back than its length never overlaps this block's writes
+    
+    /// Read length samples starting at the set delay time behind the write position
+    void ReadBlock(float* outbuffer, unsigned int length);
+    
+    /// Read length samples starting the given ms behind the write position
+    void ReadBlock(float* outbuffer, unsigned int length, float ms);
+    
+    /// Read length samples starting the given number of samples behind the write position
+    void ReadBlock(float* outbuffer, unsigned int length, int samples);
+    
+    /// Read the weighted sum of several whole sample taps for length samples. Every tap must be further back than length
+    void ReadBlockTaps(float* outbuffer, unsigned int length, const int* taps, const float* gains, int numTaps);
+    
+    /// Read the weighted sum of several whole sample taps of one channel for length samples, side by side rather than
+    /// interleaved. Planar storage only. Every tap must be further back than length
+    void ReadLaneTaps(int channel, float* outbuffer, unsigned int length, const int* taps, const float* gains, int numTaps);
+    
+    /// Write length samples and move the write position past them
+    void WriteBlock(const float* inbuffer, unsigned int length);
+    
+    /// Same result as Read, a block at a time. Gains are worked out once per call instead of per sample
+    void ProcessBlock(const float* inbuffer, float* outbuffer, unsigned int length);
+    
 private:
-    /// Buffer of samples
+    /// True when the sample index is wrapped with a mask rather than compares
+    bool IsMasked() const { return m_storage != DELAY_STORAGE_LINEAR; }
+    
+    /// Buffer index of a sample and channel in masked storage
+    int GetMaskedIndex(int sample, int channel) const { return (sample & m_mask) * m_frameStride + channel * m_channelStride; }
+    
+    /// Interpolated read a fractional number of samples back on the current channel.
+    /// Linear interpolation needs masked storage, the higher orders work with any storage
+    float GetDelayedSampleInterpolated(float delayInSamples);
+    
+    /// Whole sample taps and their weights for a fractional delay. Returns the number of taps used.
+    /// Thiran returns the two taps of its feed forward half, the feedback is applied by the caller
+    int GetInterpolationTaps(float delayInSamples, int* taps, float* weights) const;
+    
+    /// Feedback coefficient of the Thiran allpass for a fractional delay
+    float GetThiranCoefficient(float delayInSamples) const;
+    
+    /// Channel the write position is on
+    int GetWriteChannel() const { return IsMasked() ? m_writeChannel : m_writePos % m_numOfChannels; }
+    
+    /// Copy a span of samples that does not wrap out of the buffer into interleaved audio
+    void CopyFromBuffer(float* outbuffer, int start, unsigned int length) const;
+    
+    /// Copy interleaved audio into a span of samples that does not wrap
+    void CopyToBuffer(const float* inbuffer, int start, unsigned int length);
+    
+    /// Start of the samples that tap indices count from
+    const float* GetStorageStart() const { return m_lanes; }
+    
+    /// Buffer index of each tap on the current channel. Works out the write position once for all of them
+    void GetTapIndices(const int* taps, int* indices, int numTaps) const;
+    
+    /// Sum several whole sample taps of one planar lane, counting back from a sample, into a run of length samples
+    void SumLaneTaps(int channel, int fromSample, float* sum, unsigned int length, const int* taps, const float* gains, int numTaps) const;
+    
+    /// Read a block a fractional number of samples back, interpolating each channel on its own
+    void ReadBlockInterpolated(float* outbuffer, unsigned int length, float delayInSamples);
+    
+    /// Sample index of the write position. Block calls keep it on a sample boundary
+    int GetWriteSample() const { return IsMasked() ? m_writeFrame : m_writePos / m_numOfChannels; }
+    
+    /// Wrap a sample index into the buffer
+    int WrapSample(int sample) const;
+    
+    /// Move the write position forward a number of whole samples
+    void AdvanceSamples(unsigned int length);
+    
+    /// Set the capacity and strides for a channel count and rewind the write position
+    void SetLayout(int channels);
+    
+    /// Point the lanes and allpass state into a block of GetStorageSize floats
+    void AttachStorage(float* storage);
+    
+    /// Buffer of samples when the unit owns its memory. Null when laid out in memory from the caller
     DelayBuffer* m_delayBuffer;
     
+    /// Memory the buffers were laid out in, owned or not
+    float* m_storageBlock;
+    
     /// Which index we are writing the audio into.
     /// This is not the sample index as the buffer holds multiple channels
     int m_writePos;
@@ -159,6 +320,40 @@ private:
     
     /// Maximum time of delay in samples. More accurately, the number of samples in the buffer regardless of channels
     int m_maxSampleDelayTime;
+    
+    /// Layout of the buffer
+    DELAYSTORAGE m_storage;
+    
+    /// Masked storage keeps the sample and channel apart so wrapping is a single mask on the sample index
+    int m_writeFrame;
+    int m_writeChannel;
+    
+    /// Samples the write position has moved since the buffer was last clear, up to the capacity. Everything written
+    /// since is in that many samples, and the one being written, from the start of each channel
+    int m_writtenSamples;
+    
+    /// Samples per channel in masked storage, and the mask used to wrap them
+    int m_capacity;
+    int m_mask;
+    
+    /// First sample of storage. Planar lanes are aligned inside the storage block so this can sit past its start
+    float* m_lanes;
+    
+    /// Distance between neighbouring samples and neighbouring channels in masked storage
+    int m_frameStride;
+    int m_channelStride;
+    
+    /// Interpolation used by fractional reads
+    DELAYINTERPOLATION m_interpolation;
+    
+    /// Taps and weights of the last fractional delay read one sample at a time
+    float m_interpolationDelay;
+    int m_interpolationTaps[4];
+    float m_interpolationWeights[4];
+    int m_numInterpolationTaps;
+    
+    /// Last output of the Thiran allpass on each channel
+    float* m_allpassState;
 };
 
 #endif /* DelayUnit_hpp */
@@ -0,0 +1,106 @@
+//
+//  EarlyReflections.cpp
+//  Reverb
+//
+
+#include <algorithm>
+#include <math.h>
+
+#include "EarlyReflections.hpp"
+
+void EarlyReflections::Init(int sampleRate, int nearestSample, int furthestSample, float roomSize)
+{
+    m_sampleRate = sampleRate;
+    m_nearestSample = nearestSample;
+    m_furthestSample = std::max(nearestSample, furthestSample);
+
+    delete m_pending.exchange(nullptr, std::memory_order_acq_rel);
+    delete m_retired.exchange(nullptr, std::memory_order_acq_rel);
+    delete m_active;
+
+    m_active = new EarlyTaps();
+    Build(m_active, roomSize);
+}
+
+void EarlyReflections::SetRoomSize(float roomSize)
+{
+    // Anything the mixer thread has let go of can be freed here
+    delete m_retired.exchange(nullptr, std::memory_order_acq_rel);
+
+    EarlyTaps* taps = new EarlyTaps();
+    Build(taps, roomSize);
+
+    // A table the mixer thread never took can go straight away
+    delete m_pending.exchange(taps, std::memory_order_acq_rel);
+}
+
+void EarlyReflections::Update()
+{
+    // Only take a new table once the last one let go of has been freed, so there is always somewhere to put it
+    if (m_retired.load(std::memory_order_acquire))
+    {
+        return;
+    }
+
+    EarlyTaps* taps = m_pending.exchange(nullptr, std::memory_order_acq_rel);
+    if (taps)
+    {
+        m_retired.store(m_active, std::memory_order_release);
+        m_active = taps;
+    }
+}
+
+void EarlyReflections::CopyTaps(const EarlyReflections& other)
+{
+    if (m_active->roomSize != other.m_active->roomSize || m_active->count != other.m_active->count)
+    {
+        *m_active = *other.m_active;
+    }
+}
+
+void EarlyReflections::Build(EarlyTaps* taps, float roomSize) const
+{
+    const float size = std::max(ROOM_SIZE_MIN, std::min(roomSize, ROOM_SIZE_MAX));
+    const float fraction = (size - ROOM_SIZE_MIN) / (ROOM_SIZE_MAX - ROOM_SIZE_MIN);
+    const int count = EARLY_MIN_TAPS + (int)((EARLY_MAX_TAPS - EARLY_MIN_TAPS) * fraction + 0.5f);
+
+    const float first = EARLY_FIRST_MS * size;
+    const float window = EARLY_WINDOW_MS * size;
+    const float firstCubed = first * first * first;
+    const float spanCubed = (window * window * window) - firstCubed;
+
+    taps->roomSize = roomSize;
+    taps->count = count;
+
+    for (int side = 0; side < 2; side++)
+    {
+        // Each side has its own fixed sequence, so a room always sounds the same
+        unsigned int seed = 0x9E3779B9u * (side + 1);
+        float energy = 0.0f;
+
+        for (int t = 0; t < count; t++)
+        {
+            // Reflections arrive more densely with the square of time, so the number of them by a time grows with its
+            // cube. Each tap is jittered inside its own slot of that curve, which keeps the taps in order
+            seed = (seed * 1664525u) + 1013904223u;
+            float slot = (t + ((seed >> 8) / 16777216.0f)) / count;
+            float ms = cbrtf(firstCubed + (spanCubed * slot));
+
+            int sample = (int)((ms * m_sampleRate / 1000.0f) + 0.5f);
+            taps->sample[side][t] = std::max(m_nearestSample, std::min(sample, m_furthestSample));
+
+            // Level falls with the distance travelled, and the walls on the way flip the sign at random
+            seed = (seed * 1664525u) + 1013904223u;
+            float gain = (first / ms) * ((seed & 0x80000000u) ? -1.0f : 1.0f);
+            taps->gain[side][t] = gain;
+            energy += gain * gain;
+        }
+
+        // The same energy whatever the room, so the size changes the pattern but not the level
+        const float normalise = 1.0f / sqrtf(energy);
+        for (int t = 0; t < count; t++)
+        {
+            taps->gain[side][t] *= normalise;
+        }
+    }
+}
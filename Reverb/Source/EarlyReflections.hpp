@@ -0,0 +1,89 @@
+//
+//  EarlyReflections.hpp
+//  Reverb
+//
+//  Tap tables for the discrete early reflections read off the predelay line ahead of the tank. A room size gives
+//  the spread of the taps and their gains. Tables are built on whichever thread sets the room size and handed to the
+//  mixer thread, which only ever swaps pointers
+//
+
+#ifndef EarlyReflections_hpp
+#define EarlyReflections_hpp
+
+#include <atomic>
+
+#include "RoomSize.hpp"
+
+/// Fewest and most taps on each side. Bigger rooms spread more taps over a longer window
+const int EARLY_MIN_TAPS = 16;
+const int EARLY_MAX_TAPS = 64;
+
+/// First reflection and end of the reflections in the reference room, in ms. Both scale with the room size
+const float EARLY_FIRST_MS = 5.0f;
+const float EARLY_WINDOW_MS = 50.0f;
+
+/// Longest an early reflection can be, at the largest room size
+const float EARLY_MAX_MS = EARLY_WINDOW_MS * ROOM_SIZE_MAX;
+
+/// Whole samples back and gains of every tap, a left and a right pattern so pairs of channels hear different rooms
+struct EarlyTaps
+{
+    float roomSize;
+    int count;
+    int sample[2][EARLY_MAX_TAPS];
+    float gain[2][EARLY_MAX_TAPS];
+};
+
+/// Builds the tap tables and hands them to the mixer thread. A new table goes in through a pending slot, the mixer
+/// thread takes it in Update and leaves the one it replaces in a retired slot, which is only freed by the next build
+class EarlyReflections
+{
+public:
+    EarlyReflections() :
+    m_active(nullptr),
+    m_pending(nullptr),
+    m_retired(nullptr),
+    m_sampleRate(48000),
+    m_nearestSample(1),
+    m_furthestSample(1)
+    { }
+
+    ~EarlyReflections()
+    {
+        delete m_active;
+        delete m_pending.load();
+        delete m_retired.load();
+    }
+
+    /// Set the rate and how near and far back a tap may be, and build the taps for a room size to start with.
+    /// Taps are clamped to that range, so they are never nearer than a pass of the line they read
+    void Init (int sampleRate, int nearestSample, int furthestSample, float roomSize);
+
+    /// Build the taps for a room size and queue them for the mixer thread. Allocates, so never call on the mixer thread
+    void SetRoomSize (float roomSize);
+
+    /// Take the taps last queued, if there are any. Mixer thread only
+    void Update ();
+
+    /// Taps in use. Only changes in Update and CopyTaps
+    const EarlyTaps& GetTaps () const { return *m_active; }
+
+    /// Use another's taps in use, if they are for a different room. Copies rather than allocates, so the mixer thread
+    /// can keep a shared bus in step with whichever instance sent to it
+    void CopyTaps (const EarlyReflections& other);
+
+private:
+    /// Work the taps out for a room size
+    void Build (EarlyTaps* taps, float roomSize) const;
+
+    /// Table the mixer thread is reading, the next one for it to take, and the last one it let go of
+    EarlyTaps* m_active;
+    std::atomic<EarlyTaps*> m_pending;
+    std::atomic<EarlyTaps*> m_retired;
+
+    int m_sampleRate;
+    int m_nearestSample;
+    int m_furthestSample;
+};
+
+#endif /* EarlyReflections_hpp */
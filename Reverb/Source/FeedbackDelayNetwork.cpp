@@ -0,0 +1,354 @@
+//
+//  FeedbackDelayNetwork.cpp
+//  Reverb
+//
+
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "DenormalGuard.hpp"
+#include "FeedbackDelayNetwork.hpp"
+#include "FixedDelay.hpp"
+#include "RoomSize.hpp"
+
+/// Samples of the plate's loop that each multiply by Decay covers, so both tanks ring for as long at the same Decay
+#define FDN_DECAY_SAMPLES 6500.0f
+
+/// Gain on the sum of a row of lines, so the network comes out about as loud as the plate
+#define FDN_OUTPUT_GAIN 0.42f
+
+/// Line lengths for 16 lines: primes spread over the same range as the plate's delays.
+/// 8 lines take every other one. The shortest is far longer than a pass, so a whole pass can be read at once
+static const int s_lineLengths[FDN_MAX_LINES] =
+{
+    1009, 1103, 1201, 1307, 1423, 1549, 1693, 1847,
+    2011, 2179, 2381, 2591, 2819, 3067, 3343, 3637
+};
+
+/// Length of a line in a network of a number of lines, in the reference room
+static int GetLineLength(int lines, int line)
+{
+    return s_lineLengths[line * (FDN_MAX_LINES / lines)];
+}
+
+/// Samples in each lane of a line, enough for it in the largest room
+static int GetLineCapacity(int lines, int line)
+{
+    return FixedDelayCapacity(RoomSizeMaxLength(GetLineLength(lines, line)));
+}
+
+/// Read a pass of a run's lane from a number of samples back, scaled by a gain
+static void ReadLine(const float* lane, unsigned int writeFrame, int sample, int mask, float gain, float* x, int length, int width)
+{
+    int start = (int)((writeFrame - sample) & mask);
+    int first = std::min(length, mask + 1 - start) * width;
+    int count = length * width;
+    const float* tap = lane + start * width;
+
+    for (int k = 0; k < first; k++)
+    {
+        x[k] = tap[k] * gain;
+    }
+    for (int k = first; k < count; k++)
+    {
+        x[k] = lane[k - first] * gain;
+    }
+}
+
+void FeedbackDelayNetwork::SetLines(int lines)
+{
+    lines = (lines > 8) ? FDN_MAX_LINES : 8;
+    if (m_lines != lines)
+    {
+        m_lines = lines;
+        m_numOfChannels = -1;   // force CreateBuffers to rebuild with the new lines
+        m_decay = -1.0f;
+    }
+}
+
+void FeedbackDelayNetwork::SetStorage(DELAYSTORAGE storage)
+{
+    if (storage == DELAY_STORAGE_LINEAR)
+    {
+        storage = DELAY_STORAGE_POWER_OF_TWO;   // every lane is a power of two
+    }
+
+    if (m_storage != storage)
+    {
+        m_storage = storage;
+        m_numOfChannels = -1;   // force CreateBuffers to rebuild with the new layout
+    }
+}
+
+int FeedbackDelayNetwork::GetStorageSize(int lines, int channels)
+{
+    const int lineFloats = DELAY_UNIT_LANE_ALIGNMENT / sizeof(float);
+
+    int size = lines * DELAY_UNIT_BLOCK_SAMPLES;
+    for (int l = 0; l < lines; l++)
+    {
+        size += GetLineCapacity(lines, l) * channels;
+    }
+    return size + lineFloats;
+}
+
+int FeedbackDelayNetwork::GetTotalLength(int lines, float size)
+{
+    int length = 0;
+    for (int l = 0; l < lines; l++)
+    {
+        length += RoomSizeTap(GetLineLength(lines, l), size);
+    }
+    return length;
+}
+
+void FeedbackDelayNetwork::CreateBuffers(int channels, float* storage)
+{
+    if (m_numOfChannels == channels && m_storageBlock == storage)
+    {
+        return;
+    }
+
+    memset(storage, 0, GetStorageSize(m_lines, channels) * sizeof(float));
+
+    m_numOfChannels = channels;
+    m_storageBlock = storage;
+    m_writeFrame = 0;
+    m_writtenFrames = 0;
+    m_decay = -1.0f;    // the lengths may have changed, so the gains are worked out again
+
+    bool planar = m_storage == DELAY_STORAGE_PLANAR;
+    m_frameStride = planar ? 1 : channels;
+
+    // Scratch first, then each line's lanes, all from the first cache line
+    uintptr_t address = (uintptr_t)storage;
+    float* next = (float*)((address + DELAY_UNIT_LANE_ALIGNMENT - 1) & ~(uintptr_t)(DELAY_UNIT_LANE_ALIGNMENT - 1));
+    m_scratch = next;
+    next += m_lines * DELAY_UNIT_BLOCK_SAMPLES;
+
+    for (int l = 0; l < m_lines; l++)
+    {
+        int capacity = GetLineCapacity(m_lines, l);
+
+        m_line[l].lanes = next;
+        m_channelStride[l] = planar ? capacity : 1;
+        next += capacity * channels;
+    }
+    SetLengths();
+}
+
+void FeedbackDelayNetwork::SetLengths()
+{
+    // A half rate line wraps inside the start of its lane, so the lanes stay where they were laid out. Every line
+    // wraps where it would in the largest room, so a new size only moves where it is read
+    for (int l = 0; l < m_lines; l++)
+    {
+        int reference = GetLineLength(m_lines, l);
+        int fromLength = RoomSizeTap(reference, m_fromScale);
+        int length = RoomSizeTap(reference, m_toScale);
+        int longest = RoomSizeMaxLength(reference);
+        if (m_halfRate)
+        {
+            fromLength /= 2;
+            length /= 2;
+            longest = (longest + 1) / 2;
+        }
+
+        m_line[l].fromLength = fromLength;
+        m_line[l].length = length;
+        m_line[l].mask = FixedDelayCapacity(longest) - 1;
+    }
+}
+
+void FeedbackDelayNetwork::SetHalfRate(bool halfRate)
+{
+    if (m_halfRate == halfRate)
+    {
+        return;
+    }
+    m_halfRate = halfRate;
+    m_decay = -1.0f;    // each line's gain covers a different number of samples
+
+    if (m_numOfChannels > 0)
+    {
+        SetLengths();
+    }
+}
+
+void FeedbackDelayNetwork::SetScale(float fromScale, float toScale)
+{
+    if (m_fromScale == fromScale && m_toScale == toScale)
+    {
+        return;
+    }
+    m_fromScale = fromScale;
+    m_toScale = toScale;
+    m_decay = -1.0f;    // each line's gain covers a different number of samples
+
+    if (m_numOfChannels > 0)
+    {
+        SetLengths();
+    }
+}
+
+void FeedbackDelayNetwork::Clear()
+{
+    if (m_storageBlock && m_numOfChannels > 0)
+    {
+        // Writing starts from the first frame after a clear, whatever each line's wrap is, so nothing past the frames
+        // written since can hold anything
+        for (int l = 0; l < m_lines; l++)
+        {
+            int capacity = GetLineCapacity(m_lines, l);
+            int frames = std::min(m_writtenFrames, capacity);
+
+            if (m_storage == DELAY_STORAGE_PLANAR)
+            {
+                for (int n = 0; n < m_numOfChannels; n++)
+                {
+                    memset(m_line[l].lanes + n * m_channelStride[l], 0, frames * sizeof(float));
+                }
+            }
+            else
+            {
+                memset(m_line[l].lanes, 0, frames * m_numOfChannels * sizeof(float));
+            }
+        }
+    }
+
+    m_writeFrame = 0;
+    m_writtenFrames = 0;
+}
+
+void FeedbackDelayNetwork::SetDecay(float decay)
+{
+    if (decay == m_decay)
+    {
+        return;
+    }
+    m_decay = decay;
+
+    // Every line loses the same level per sample, so longer lines lose more per trip. Half rate samples last twice as long.
+    // The Hadamard matrix needs 1/sqrt(lines) to keep its energy, which is folded in here too
+    const float normalise = 1.0f / sqrtf((float)m_lines);
+    const float decaySamples = m_halfRate ? FDN_DECAY_SAMPLES / 2 : FDN_DECAY_SAMPLES;
+    for (int l = 0; l < m_lines; l++)
+    {
+        m_fromGain[l] = powf(decay, m_line[l].fromLength / decaySamples) * normalise;
+        m_gain[l] = powf(decay, m_line[l].length / decaySamples) * normalise;
+    }
+}
+
+void FeedbackDelayNetwork::Process(int run, const float* inbuffer, float* outbuffer, int length, int outputs, float fade, float fadeStep)
+{
+    const int lines = m_lines;
+    const int width = m_frameStride;
+    const int count = length * width;
+    const unsigned int writeFrame = m_writeFrame;
+
+    // Read a pass of every line, scaled for the decay. A line changing length is read at both and crossfaded
+    for (int l = 0; l < lines; l++)
+    {
+        const Line& line = m_line[l];
+        const float* lane = line.lanes + run * m_channelStride[l];
+        float* x = m_scratch + l * DELAY_UNIT_BLOCK_SAMPLES;
+
+        ReadLine(lane, writeFrame, line.fromLength, line.mask, m_fromGain[l], x, length, width);
+        if (line.length != line.fromLength)
+        {
+            float to[DELAY_UNIT_BLOCK_SAMPLES];
+            ReadLine(lane, writeFrame, line.length, line.mask, m_gain[l], to, length, width);
+
+            for (int i = 0; i < length; i++)
+            {
+                const float mix = std::min(fade + (fadeStep * i), 1.0f);
+                for (int c = 0; c < width; c++)
+                {
+                    int k = i * width + c;
+                    x[k] += (to[k] - x[k]) * mix;
+                }
+            }
+        }
+    }
+
+    // Outputs past the line count each take one line ahead of the matrix, from the last line back. Brought back up by
+    // sqrt(lines) to the level of a row. A line is partly made of the rows, but far less than a repeated row would be
+    if (outputs > lines)
+    {
+        const float lineGain = FDN_OUTPUT_GAIN * sqrtf((float)lines);
+        for (int o = lines; o < outputs; o++)
+        {
+            const float* x = m_scratch + (lines - 1 - (o - lines) % lines) * DELAY_UNIT_BLOCK_SAMPLES;
+            for (int i = 0; i < length; i++)
+            {
+                outbuffer[i * outputs + o] = x[i] * lineGain;
+            }
+        }
+    }
+
+    // Hadamard matrix as butterflies. Each stage pairs lines a power of two apart, a pass at a time
+    for (int half = 1; half < lines; half *= 2)
+    {
+        for (int base = 0; base < lines; base += half * 2)
+        {
+            for (int l = base; l < base + half; l++)
+            {
+                float* a = m_scratch + l * DELAY_UNIT_BLOCK_SAMPLES;
+                float* b = a + half * DELAY_UNIT_BLOCK_SAMPLES;
+                for (int k = 0; k < count; k++)
+                {
+                    float sum = a[k] + b[k];
+                    float difference = a[k] - b[k];
+                    a[k] = sum;
+                    b[k] = difference;
+                }
+            }
+        }
+    }
+
+    // Each line now holds one row of the matrix over the line outputs, which is what the outputs are made of
+    if (outputs == 1)
+    {
+        const float* x = m_scratch + (lines - 1) * DELAY_UNIT_BLOCK_SAMPLES;
+        for (int k = 0; k < count; k++)
+        {
+            outbuffer[k] = x[k] * FDN_OUTPUT_GAIN;
+        }
+    }
+    else
+    {
+        const int rows = std::min(outputs, lines);
+        for (int o = 0; o < rows; o++)
+        {
+            const float* x = m_scratch + o * DELAY_UNIT_BLOCK_SAMPLES;
+            for (int i = 0; i < length; i++)
+            {
+                outbuffer[i * outputs + o] = x[i] * FDN_OUTPUT_GAIN;
+            }
+        }
+    }
+
+    // Feed the input into every line with alternating signs as the pass is written back
+    for (int l = 0; l < lines; l++)
+    {
+        const Line& line = m_line[l];
+        float* lane = line.lanes + run * m_channelStride[l];
+        const float* x = m_scratch + l * DELAY_UNIT_BLOCK_SAMPLES;
+        const float sign = (l & 1) ? -1.0f : 1.0f;
+
+        int start = (int)(writeFrame & line.mask);
+        int first = std::min(length, line.mask + 1 - start) * width;
+        float* head = lane + start * width;
+
+        for (int k = 0; k < first; k++)
+        {
+            head[k] = FlushDenormal(x[k] + (inbuffer[k] * sign));
+        }
+        for (int k = first; k < count; k++)
+        {
+            lane[k - first] = FlushDenormal(x[k] + (inbuffer[k] * sign));
+        }
+    }
+}
@@ -0,0 +1,145 @@
+//
+//  FeedbackDelayNetwork.hpp
+//  Reverb
+//
+//  Feedback delay network tank. Every line's output is scaled for the decay, mixed through a Hadamard matrix and
+//  written back with the input added. The matrix is a fast Walsh-Hadamard transform, so a pass of every line is
+//  mixed with log2(lines) stages of butterflies, each a plain loop over the pass
+//
+
+#ifndef FeedbackDelayNetwork_hpp
+#define FeedbackDelayNetwork_hpp
+
+#include "fmod.hpp"
+#include "DelayUnit.hpp"
+
+/// Most lines a network can have
+const int FDN_MAX_LINES = 16;
+
+/// Samples in the longest lane of any network, the power of two that holds the longest line in the largest room
+const int FDN_MAX_CAPACITY = 8192;
+
+/// Delay line network with a lossless feedback matrix and a gain per line for the decay.
+/// Stored like FixedDelay: planar by default, one lane per channel behind a shared write head, or every channel of
+/// each frame interleaved so one run covers them all. CreateBuffers must be called before Process
+class FeedbackDelayNetwork
+{
+public:
+    FeedbackDelayNetwork() :
+    m_lines(8),
+    m_storage(DELAY_STORAGE_PLANAR),
+    m_numOfChannels(-1),
+    m_storageBlock(nullptr),
+    m_scratch(nullptr),
+    m_frameStride(1),
+    m_writeFrame(0),
+    m_writtenFrames(0),
+    m_decay(-1.0f),
+    m_halfRate(false),
+    m_fromScale(1.0f),
+    m_toScale(1.0f)
+    { }
+
+    /// Use 8 or 16 lines. Takes effect on the next CreateBuffers
+    void SetLines (int lines);
+
+    /// Lines in the network
+    int GetLines () const { return m_lines; }
+
+    /// Choose planar or interleaved power of two storage. Takes effect on the next CreateBuffers
+    void SetStorage (DELAYSTORAGE storage);
+
+    /// Samples in one run of a Process call for every frame
+    int GetRunWidth () const { return m_frameStride; }
+
+    /// Number of floats CreateBuffers needs for a line count and channel count, including the scratch for a pass
+    static int GetStorageSize (int lines, int channels);
+
+    /// Lay the lines out in memory owned by the caller, which must hold GetStorageSize floats. Nothing is allocated,
+    /// and the memory is cleared only when the layout changes
+    void CreateBuffers (int channels, float* storage);
+
+    /// Samples through every line once in a room of a size, the longest a tail can take to pass through the network
+    static int GetTotalLength (int lines, float size);
+
+    /// Run at half the mixer's rate, with every line half as long so it lasts as long. The lines keep their memory but
+    /// not their order, so Clear them before the next Process
+    void SetHalfRate (bool halfRate);
+
+    /// Scale every line's length by a room size, fading from the lengths of one to those of another. The lines have
+    /// the memory for the largest room, so nothing moves and nothing is allocated
+    void SetScale (float fromScale, float toScale);
+
+    /// Silence every line and rewind the write position. Only the frames written since the last clear are zeroed
+    void Clear ();
+
+    /// Gain each line loses a Decay's worth of level over. Recomputes the line gains only when it or the scale changes
+    void SetDecay (float decay);
+
+    /// Run one run of a pass through the network: read every line, write the line outputs mixed through the output
+    /// rows, then feed them back through the matrix with the input added. With one output the row is the same for
+    /// every channel of the run. With more, the run must be one channel wide and each output gets its own row,
+    /// interleaved. Outputs past the line count take a line straight, before the matrix, so they differ from the rows
+    /// too. The pass must be no longer than the shortest line.
+    /// While the scale is fading, each line is read at both lengths and crossfaded, fade of the way to the new length
+    /// at the first frame and fadeStep further each frame
+    void Process (int run, const float* inbuffer, float* outbuffer, int length, int outputs, float fade, float fadeStep);
+
+    /// Move every line on by a pass once all runs are done
+    void AdvanceFrames (int length)
+    {
+        m_writeFrame += length;
+        m_writtenFrames = (m_writtenFrames < FDN_MAX_CAPACITY - length) ? m_writtenFrames + length : FDN_MAX_CAPACITY;
+    }
+
+private:
+    /// Work out each line's lengths and wrap for the line count, rate and scale, keeping its lanes where they are
+    void SetLengths ();
+
+    /// One line's lane, the length being faded from and the one being faded to, and its wrap
+    struct Line
+    {
+        float* lanes;
+        int fromLength;
+        int length;
+        int mask;
+    };
+
+    int m_lines;
+    DELAYSTORAGE m_storage;
+    int m_numOfChannels;
+    float* m_storageBlock;
+
+    Line m_line[FDN_MAX_LINES];
+
+    /// Gain on each line's output for the decay at the length being faded from and the one being faded to, with the
+    /// matrix's normalisation folded in
+    float m_fromGain[FDN_MAX_LINES];
+    float m_gain[FDN_MAX_LINES];
+
+    /// A pass of every line, read out and mixed in place
+    float* m_scratch;
+
+    /// Distance between neighbouring samples of a lane, and between neighbouring channels
+    int m_frameStride;
+    int m_channelStride[FDN_MAX_LINES];
+
+    /// Shared write position. Wraps at a power of two, so it stays right against every line's mask
+    unsigned int m_writeFrame;
+
+    /// Frames the write position has moved since the lines were last clear, up to the longest lane. Everything
+    /// written since is in that many frames from the start of each lane
+    int m_writtenFrames;
+
+    /// Decay the gains were worked out for
+    float m_decay;
+
+    /// Whether each line holds half rate samples
+    bool m_halfRate;
+
+    /// Room sizes the lines are being faded from and to. The same once a fade is done
+    float m_fromScale;
+    float m_toScale;
+};
+
+#endif /* FeedbackDelayNetwork_hpp */
@@ -0,0 +1,314 @@
+//
+//  FixedDelay.hpp
+//  Reverb
+//
+//  Delay line whose length is known at compile time. Taps that are constants read with one masked
+//  load, with no interpolation and no checks on the length at run time
+//
+
+#ifndef FixedDelay_hpp
+#define FixedDelay_hpp
+
+#include <algorithm>
+#include <stdint.h>
+#include <string.h>
+
+#include "fmod.hpp"
+#include "DelayUnit.hpp"
+
+/// Smallest power of two that holds length samples
+constexpr int FixedDelayCapacity(int length, int capacity = 1)
+{
+    return capacity >= length ? capacity : FixedDelayCapacity(length, capacity * 2);
+}
+
+/// Delay line of Length samples per channel with whole sample taps, and the memory for taps up to MaxLength back.
+/// Stored planar by default, one lane per channel behind a shared write head, and used the same way as DelayUnit:
+/// read taps and write on the current channel, then TickChannel. Whole blocks can be read and written a run at a time
+/// while the write position is on the first channel. A run is one channel in planar storage, and every channel of
+/// each frame, interleaved, in power of two storage.
+/// CreateBuffers must be called before any read or write
+template <int Length, int MaxLength = Length>
+class FixedDelay
+{
+public:
+    static_assert(Length > 0, "FixedDelay needs at least one sample");
+    static_assert(MaxLength >= Length, "FixedDelay must hold its own length");
+
+    /// Samples per channel actually allocated. The wrap is a mask on this, or on less of it after SetWrap
+    static constexpr int CAPACITY = FixedDelayCapacity(MaxLength);
+    static constexpr int MASK = CAPACITY - 1;
+
+    FixedDelay() :
+    m_delayBuffer(nullptr),
+    m_storageBlock(nullptr),
+    m_lanes(nullptr),
+    m_lane(nullptr),
+    m_numOfChannels(-1),
+    m_storage(DELAY_STORAGE_PLANAR),
+    m_frameStride(1),
+    m_channelStride(CAPACITY),
+    m_writeFrame(0),
+    m_writeChannel(0),
+    m_mask(MASK),
+    m_writtenFrames(0)
+    { }
+
+    ~FixedDelay()
+    {
+        delete m_delayBuffer;
+    }
+
+    /// Initialise the line. The length is fixed so only the position is reset
+    void Init (FMOD_DSP_STATE*)
+    {
+        m_writeFrame = 0;
+        m_writeChannel = 0;
+        m_writtenFrames = 0;
+        m_lane = m_lanes;
+    }
+
+    /// Release resources
+    void Release ()
+    {
+        delete m_delayBuffer;
+        m_delayBuffer = nullptr;
+        m_storageBlock = nullptr;
+        m_lanes = nullptr;
+        m_lane = nullptr;
+        m_numOfChannels = -1;
+    }
+
+    /// Choose planar or interleaved power of two storage. Takes effect on the next CreateBuffers
+    void SetStorage (DELAYSTORAGE storage)
+    {
+        if (storage == DELAY_STORAGE_LINEAR)
+        {
+            storage = DELAY_STORAGE_POWER_OF_TWO;   // the length is always a power of two
+        }
+
+        if (m_storage != storage)
+        {
+            m_storage = storage;
+            m_numOfChannels = -1;   // force CreateBuffers to rebuild with the new layout
+        }
+    }
+
+    /// Get how the lanes are stored
+    DELAYSTORAGE GetStorage () const { return m_storage; }
+
+    /// Samples in one run of a block call for every frame
+    int GetRunWidth () const { return m_frameStride; }
+
+    /// Called before read. Creates buffers
+    void CreateBuffers (int channels)
+    {
+        if (m_numOfChannels != channels || !m_delayBuffer)
+        {
+            delete m_delayBuffer;
+            m_delayBuffer = new DelayBuffer(GetStorageSize(channels));
+            AttachStorage(channels, m_delayBuffer->data());
+        }
+    }
+
+    /// Called before read. Lays the lanes out in memory owned by the caller, which must hold GetStorageSize floats.
+    /// Nothing is allocated, and the memory is cleared only when the layout changes
+    void CreateBuffers (int channels, float* storage)
+    {
+        if (m_numOfChannels != channels || m_storageBlock != storage)
+        {
+            delete m_delayBuffer;
+            m_delayBuffer = nullptr;
+
+            memset(storage, 0, GetStorageSize(channels) * sizeof(float));
+            AttachStorage(channels, storage);
+        }
+    }
+
+    /// Number of floats CreateBuffers needs for a channel count. Pads so the first lane can start on a cache line
+    static int GetStorageSize (int channels) { return CAPACITY * channels + DELAY_UNIT_LANE_ALIGNMENT / sizeof(float); }
+
+    /// Get maximum number of samples in buffer
+    int GetMaxDelayTimeInSamples () const { return MaxLength; }
+
+    /// Samples in the line at the length it was made for. Taps can reach past it up to the maximum
+    int GetLength () const { return Length; }
+
+    /// Wrap each lane at the smallest power of two that holds length samples instead of the whole capacity, so
+    /// shorter taps cycle through less memory. Taps must then be no longer than length. What is in the lanes is out
+    /// of order afterwards, so Clear them before they are read. The wrap never moves a write past the frames
+    /// counted since the last clear, so Clear still covers everything written
+    void SetWrap (int length)
+    {
+        int wrap = FixedDelayCapacity(std::max(length, 1));
+        m_mask = ((wrap < CAPACITY) ? wrap : CAPACITY) - 1;     // not std::min, which would need CAPACITY defined out of line
+        m_writeFrame &= m_mask;
+    }
+
+    /// Samples each lane wraps at
+    int GetWrap () const { return m_mask + 1; }
+
+    /// Silence every lane and rewind the write position. Writing starts from the first frame after a clear, so only
+    /// the frames written since the last one can hold anything, and only those are zeroed. A line that has gone
+    /// round its whole capacity costs the same as clearing all of it
+    void Clear ()
+    {
+        if (m_lanes && m_numOfChannels > 0)
+        {
+            // The frame being written may have some channels in it before TickChannel moves on
+            int frames = (m_writtenFrames < CAPACITY) ? m_writtenFrames + 1 : CAPACITY;
+            if (m_storage == DELAY_STORAGE_PLANAR)
+            {
+                for (int n = 0; n < m_numOfChannels; n++)
+                {
+                    memset(m_lanes + n * m_channelStride, 0, frames * sizeof(float));
+                }
+            }
+            else
+            {
+                memset(m_lanes, 0, frames * m_frameStride * sizeof(float));
+            }
+        }
+
+        m_writeFrame = 0;
+        m_writeChannel = 0;
+        m_writtenFrames = 0;
+        m_lane = m_lanes;
+    }
+
+    /// Advance the write position by one channel
+    void TickChannel ()
+    {
+        m_lane += m_channelStride;
+
+        if (++m_writeChannel >= m_numOfChannels)
+        {
+            m_writeChannel = 0;
+            m_lane = m_lanes;
+            m_writeFrame = (m_writeFrame + 1) & m_mask;
+            m_writtenFrames += (m_writtenFrames < CAPACITY) ? 1 : 0;
+        }
+    }
+
+    /// Get the value a constant number of samples back
+    template <int Tap>
+    float GetDelayedSampleAt () const
+    {
+        static_assert(Tap > 0 && Tap <= MaxLength, "tap must be inside the delay line");
+        return m_lane[((m_writeFrame - Tap) & m_mask) * m_frameStride];
+    }
+
+    /// Get the value at number of samples back. Must be between 1 and MaxLength
+    float GetDelayedSampleAt (int sample) const
+    {
+        return m_lane[((m_writeFrame - sample) & m_mask) * m_frameStride];
+    }
+
+    /// Write the sample into the delay buffer
+    void WriteDelay (float value)
+    {
+        m_lane[m_writeFrame * m_frameStride] = value;
+    }
+
+    /// Copy a run's samples from a constant number of frames back, GetRunWidth per frame of the block.
+    /// The block must be no longer than the tap so every sample was written before it.
+    /// In interleaved storage every channel is one run, so channel must be 0
+    template <int Tap>
+    void ReadBlock (int channel, float* outbuffer, int length) const
+    {
+        static_assert(Tap > 0 && Tap <= MaxLength, "tap must be inside the delay line");
+        ReadBlock(channel, Tap, outbuffer, length);
+    }
+
+    /// Copy a run's samples from a number of frames back. Must be between the block length and MaxLength
+    void ReadBlock (int channel, int sample, float* outbuffer, int length) const
+    {
+        const float* lane = m_lanes + channel * m_channelStride;
+        int start = ((m_writeFrame - sample) & m_mask) * m_frameStride;
+        int count = length * m_frameStride;
+        int first = std::min(count, (m_mask + 1) * m_frameStride - start);
+
+        memcpy(outbuffer, lane + start, first * sizeof(float));
+        memcpy(outbuffer + first, lane, (count - first) * sizeof(float));
+    }
+
+    /// Start of a run's lane. Interleaved storage has one lane holding every channel
+    const float* GetLane (int channel) const { return m_lanes + channel * m_channelStride; }
+
+    /// Where a run's sample a number of frames back is, and how many frames follow it in the lane before it wraps
+    const float* GetTapSpan (int channel, int sample, int* frames) const
+    {
+        int start = (m_writeFrame - sample) & m_mask;
+        *frames = m_mask + 1 - start;
+        return GetLane(channel) + start * m_frameStride;
+    }
+
+    /// Write a block of one run's samples at the write position. Call AdvanceFrames once every run is written
+    void WriteBlock (int channel, const float* inbuffer, int length)
+    {
+        float* lane = m_lanes + channel * m_channelStride;
+        int start = m_writeFrame * m_frameStride;
+        int count = length * m_frameStride;
+        int first = std::min(count, (m_mask + 1) * m_frameStride - start);
+
+        memcpy(lane + start, inbuffer, first * sizeof(float));
+        memcpy(lane, inbuffer + first, (count - first) * sizeof(float));
+    }
+
+    /// Move the write position forward a number of whole samples. Block calls need it on the first channel
+    void AdvanceFrames (int length)
+    {
+        m_writeFrame = (m_writeFrame + length) & m_mask;
+        m_writtenFrames = (m_writtenFrames < CAPACITY - length) ? m_writtenFrames + length : CAPACITY;
+    }
+
+private:
+    /// Lay the lanes out from the first cache line in the storage and rewind the write position
+    void AttachStorage (int channels, float* storage)
+    {
+        m_numOfChannels = channels;
+        m_writeFrame = 0;
+        m_writeChannel = 0;
+        m_writtenFrames = 0;
+        m_storageBlock = storage;
+
+        bool planar = m_storage == DELAY_STORAGE_PLANAR;
+        m_frameStride = planar ? 1 : channels;
+        m_channelStride = planar ? CAPACITY : 1;
+
+        uintptr_t address = (uintptr_t)storage;
+        m_lanes = (float*)((address + DELAY_UNIT_LANE_ALIGNMENT - 1) & ~(uintptr_t)(DELAY_UNIT_LANE_ALIGNMENT - 1));
+        m_lane = m_lanes;
+    }
+
+    /// Holds the lanes, with room to align them, when the line owns its memory
+    DelayBuffer* m_delayBuffer;
+
+    /// Memory the lanes were laid out in, owned or not
+    float* m_storageBlock;
+
+    /// First lane, and the lane of the channel being written
+    float* m_lanes;
+    float* m_lane;
+
+    /// Number of channels in one sample
+    int m_numOfChannels;
+
+    /// Layout of the lanes, and the distance between neighbouring samples and neighbouring channels
+    DELAYSTORAGE m_storage;
+    int m_frameStride;
+    int m_channelStride;
+
+    /// Shared write position in samples, and the channel within it
+    int m_writeFrame;
+    int m_writeChannel;
+
+    /// Wrap of the lanes in use, a power of two no bigger than the capacity
+    int m_mask;
+
+    /// Frames the write position has moved since the lanes were last clear, up to the capacity. Everything written
+    /// since is in that many frames from the start of each lane
+    int m_writtenFrames;
+};
+
+#endif /* FixedDelay_hpp */
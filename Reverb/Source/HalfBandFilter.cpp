@@ -0,0 +1,200 @@
+//
+//  HalfBandFilter.cpp
+//  Reverb
+//
+
+#include <stdint.h>
+#include <string.h>
+
+#include "HalfBandFilter.hpp"
+
+/// Full rate frames of history decimating needs, the length of the filter less one.
+/// Interpolating needs half as many half rate frames
+#define HALF_BAND_HISTORY (HALF_BAND_CENTRE * 2)
+
+/// Taps either side of the centre, from the end in. The centre tap is a half.
+/// Windowed sinc with a Blackman window, scaled so the filter passes DC at unity. Flat to a fifth of the rate
+/// and below -70dB from a third of it
+static const float s_taps[HALF_BAND_TAPS] =
+{
+    1.129850605e-04f, -1.356996447e-03f, 5.418578841e-03f, -1.546356790e-02f,
+    3.738034462e-02f, -8.794558450e-02f, 3.118542403e-01f
+};
+
+void HalfBandFilter::SetStorage(DELAYSTORAGE storage)
+{
+    if (storage == DELAY_STORAGE_LINEAR)
+    {
+        storage = DELAY_STORAGE_POWER_OF_TWO;   // only planar or interleaved matter here
+    }
+
+    if (m_storage != storage)
+    {
+        m_storage = storage;
+        m_numOfChannels = -1;   // force CreateBuffers to rebuild with the new layout
+    }
+}
+
+int HalfBandFilter::GetStorageSize(int channels)
+{
+    const int lineFloats = DELAY_UNIT_LANE_ALIGNMENT / sizeof(float);
+    // History, then room for a pass with its history, and the pass split into kept frames and the ones between
+    return (HALF_BAND_HISTORY * channels * 3) + (DELAY_UNIT_BLOCK_SAMPLES * 2) + lineFloats;
+}
+
+void HalfBandFilter::CreateBuffers(int channels, float* storage)
+{
+    if (m_numOfChannels == channels && m_storageBlock == storage)
+    {
+        return;
+    }
+
+    memset(storage, 0, GetStorageSize(channels) * sizeof(float));
+
+    m_numOfChannels = channels;
+    m_storageBlock = storage;
+    m_phase = 0;
+    m_frameStride = (m_storage == DELAY_STORAGE_PLANAR) ? 1 : channels;
+
+    uintptr_t address = (uintptr_t)storage;
+    m_history = (float*)((address + DELAY_UNIT_LANE_ALIGNMENT - 1) & ~(uintptr_t)(DELAY_UNIT_LANE_ALIGNMENT - 1));
+    m_scratch = m_history + HALF_BAND_HISTORY * channels;
+}
+
+void HalfBandFilter::Clear()
+{
+    ClearHistory();
+    m_phase = 0;
+}
+
+void HalfBandFilter::ClearHistory()
+{
+    if (m_history)
+    {
+        memset(m_history, 0, HALF_BAND_HISTORY * m_numOfChannels * sizeof(float));
+    }
+}
+
+/// Gather every other frame of a run, starting from one, into a run of frames side by side
+static void GatherFrames(const float* inbuffer, float* outbuffer, int frames, int width)
+{
+    for (int i = 0; i < frames; i++)
+    {
+        for (int c = 0; c < width; c++)
+        {
+            outbuffer[i * width + c] = inbuffer[i * 2 * width + c];
+        }
+    }
+}
+
+/// Spread a run of frames side by side out to every other frame, starting from one
+static void ScatterFrames(const float* inbuffer, float* outbuffer, int frames, int width)
+{
+    for (int i = 0; i < frames; i++)
+    {
+        for (int c = 0; c < width; c++)
+        {
+            outbuffer[i * 2 * width + c] = inbuffer[i * width + c];
+        }
+    }
+}
+
+/// Filter samples side by side with each pair of taps either side of the centre, adding them to what is there.
+/// Pair j is j samples in from the newest end of the filter and from the oldest. The pairs are written out so the
+/// whole filter is one loop over the samples, which vectorises
+static void AddTaps(const float* oldest, const float* newest, float* outbuffer, int count, int width, float gain)
+{
+    static_assert(HALF_BAND_TAPS == 7, "one term per pair of taps");
+
+    const float t0 = s_taps[0] * gain, t1 = s_taps[1] * gain, t2 = s_taps[2] * gain, t3 = s_taps[3] * gain;
+    const float t4 = s_taps[4] * gain, t5 = s_taps[5] * gain, t6 = s_taps[6] * gain;
+
+    const float* a0 = newest;
+    const float* a1 = newest - width;
+    const float* a2 = newest - width * 2;
+    const float* a3 = newest - width * 3;
+    const float* a4 = newest - width * 4;
+    const float* a5 = newest - width * 5;
+    const float* a6 = newest - width * 6;
+
+    const float* b0 = oldest;
+    const float* b1 = oldest + width;
+    const float* b2 = oldest + width * 2;
+    const float* b3 = oldest + width * 3;
+    const float* b4 = oldest + width * 4;
+    const float* b5 = oldest + width * 5;
+    const float* b6 = oldest + width * 6;
+
+    // Summed on the stack, where the compiler knows nothing else points, then added in
+    float sum[DELAY_UNIT_BLOCK_SAMPLES];
+    for (int k = 0; k < count; k++)
+    {
+        sum[k] = ((a0[k] + b0[k]) * t0) + ((a1[k] + b1[k]) * t1) + ((a2[k] + b2[k]) * t2) + ((a3[k] + b3[k]) * t3)
+            + ((a4[k] + b4[k]) * t4) + ((a5[k] + b5[k]) * t5) + ((a6[k] + b6[k]) * t6);
+    }
+    for (int k = 0; k < count; k++)
+    {
+        outbuffer[k] += sum[k];
+    }
+}
+
+int HalfBandFilter::Decimate(int run, const float* inbuffer, float* outbuffer, int length)
+{
+    const int width = m_frameStride;
+    const int historyCount = HALF_BAND_HISTORY * width;
+    const int halfFrames = GetHalfFrames(length);
+    float* history = m_history + run * historyCount;
+
+    // Frame n of the pass is at HALF_BAND_HISTORY + n of the history and pass together
+    float* x = m_scratch;
+    memcpy(x, history, historyCount * sizeof(float));
+    memcpy(x + historyCount, inbuffer, length * width * sizeof(float));
+
+    // Every tap but the centre falls on a kept frame, so the kept frames and the ones between are split apart.
+    // Each tap is then a run of samples side by side, and works on every channel and frame of the pass at once
+    const int first = 1 - m_phase;
+    float* kept = x + historyCount + length * width;
+    float* between = kept + (HALF_BAND_CENTRE + halfFrames) * width;
+    GatherFrames(x + first * width, kept, HALF_BAND_CENTRE + halfFrames, width);
+    GatherFrames(x + (first + HALF_BAND_CENTRE) * width, between, halfFrames, width);
+
+    const int count = halfFrames * width;
+    for (int k = 0; k < count; k++)
+    {
+        outbuffer[k] = between[k] * 0.5f;
+    }
+    AddTaps(kept, kept + HALF_BAND_CENTRE * width, outbuffer, count, width, 1.0f);
+
+    memcpy(history, x + length * width, historyCount * sizeof(float));
+    return halfFrames;
+}
+
+void HalfBandFilter::Interpolate(int run, const float* inbuffer, float* outbuffer, int length)
+{
+    const int width = m_frameStride;
+    const int historyCount = HALF_BAND_CENTRE * width;
+    const int halfFrames = GetHalfFrames(length);
+    float* history = m_history + run * HALF_BAND_HISTORY * width;
+
+    // Half rate sample m of the pass is at HALF_BAND_CENTRE + m of the history and pass together
+    float* u = m_scratch;
+    memcpy(u, history, historyCount * sizeof(float));
+    memcpy(u + historyCount, inbuffer, halfFrames * width * sizeof(float));
+
+    // The kept frames take every other tap, doubled for the zeros stuffed between the half rate samples
+    const int count = halfFrames * width;
+    float* filtered = u + historyCount + count;
+    memset(filtered, 0, count * sizeof(float));
+    AddTaps(u, u + historyCount, filtered, count, width, 2.0f);
+
+    // On the frames in between the zeros fall on every tap but the centre, so those are a delayed copy.
+    // The first frame of the pass is kept on phase 1, and sits between kept frames on phase 0
+    const int first = 1 - m_phase;
+    const int between = length - halfFrames;
+    const float* centre = u + (HALF_BAND_CENTRE - HALF_BAND_TAPS + m_phase) * width;
+
+    memcpy(history, u + count, historyCount * sizeof(float));
+
+    ScatterFrames(filtered, outbuffer + first * width, halfFrames, width);
+    ScatterFrames(centre, outbuffer + m_phase * width, between, width);
+}
@@ -0,0 +1,93 @@
+//
+//  HalfBandFilter.hpp
+//  Reverb
+//
+//  Polyphase half-band filter for running part of the reverb at half the mixer's rate. Every other tap of a
+//  half-band lowpass is zero apart from the centre, so decimating by two only works out the samples that are kept,
+//  and interpolating only multiplies the samples that are not stuffed zeros
+//
+
+#ifndef HalfBandFilter_hpp
+#define HalfBandFilter_hpp
+
+#include "fmod.hpp"
+#include "DelayUnit.hpp"
+
+/// Non zero taps on each side of the centre
+const int HALF_BAND_TAPS = 7;
+
+/// Full rate samples between the centre and either end of the filter
+const int HALF_BAND_CENTRE = HALF_BAND_TAPS * 2 - 1;
+
+/// Decimates one signal by two, or interpolates one back up by two, a run at a time.
+/// Stored like FixedDelay: planar by default, a run per channel, or every channel of each frame interleaved in one run.
+/// The filter keeps track of which full rate frames the half rate samples line up with, so passes can be any length.
+/// CreateBuffers must be called before either is run
+class HalfBandFilter
+{
+public:
+    HalfBandFilter() :
+    m_storage(DELAY_STORAGE_PLANAR),
+    m_numOfChannels(-1),
+    m_storageBlock(nullptr),
+    m_history(nullptr),
+    m_scratch(nullptr),
+    m_frameStride(1),
+    m_phase(0)
+    { }
+
+    /// Choose planar or interleaved storage. Takes effect on the next CreateBuffers
+    void SetStorage (DELAYSTORAGE storage);
+
+    /// Samples in one run for every frame
+    int GetRunWidth () const { return m_frameStride; }
+
+    /// Number of floats CreateBuffers needs for a channel count, including the scratch for a pass
+    static int GetStorageSize (int channels);
+
+    /// Lay the history out in memory owned by the caller, which must hold GetStorageSize floats. Nothing is allocated,
+    /// and the memory is cleared only when the layout changes
+    void CreateBuffers (int channels, float* storage);
+
+    /// Forget the signal so far and start again from the first frame
+    void Clear ();
+
+    /// Forget the signal so far but stay on the same frame, so the filter keeps in step with the one it is paired with
+    void ClearHistory ();
+
+    /// Full rate frames a signal comes out later for going down through one filter and back up through another
+    static int GetLatency () { return HALF_BAND_CENTRE * 2; }
+
+    /// Half rate samples the next pass of full rate frames makes
+    int GetHalfFrames (int length) const { return (length + m_phase) / 2; }
+
+    /// Filter one run of a pass of full rate frames and keep every other one. Returns the number of half rate frames
+    /// written. The output can be the input
+    int Decimate (int run, const float* inbuffer, float* outbuffer, int length);
+
+    /// Stuff one run of half rate frames with zeros up to a pass of full rate frames and filter them. Reads
+    /// GetHalfFrames of the input. The output can be the input
+    void Interpolate (int run, const float* inbuffer, float* outbuffer, int length);
+
+    /// Move on by a pass of full rate frames once all runs are done
+    void AdvanceFrames (int length) { m_phase ^= length & 1; }
+
+private:
+    DELAYSTORAGE m_storage;
+    int m_numOfChannels;
+    float* m_storageBlock;
+
+    /// Last frames each run was given, a run after another
+    float* m_history;
+
+    /// The history and a pass after it, so every tap of a pass reads from one buffer
+    float* m_scratch;
+
+    /// Distance between neighbouring frames of a run
+    int m_frameStride;
+
+    /// 1 when the first frame of the next pass is kept
+    int m_phase;
+};
+
+#endif /* HalfBandFilter_hpp */
@@ -7,15 +7,26 @@
 //
 //  Delay plugin
 
+#include <algorithm>
+#include <chrono>
 #include <math.h>
+#include <new>
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <string>
 #include <vector>
 
 #include "fmod.hpp"
 
+#include "DenormalGuard.hpp"
 #include "DelayUnit.hpp"
+#include "EarlyReflections.hpp"
+#include "FixedDelay.hpp"
 #include "CutoffFilter.hpp"
+#include "FeedbackDelayNetwork.hpp"
+#include "HalfBandFilter.hpp"
+#include "RoomSize.hpp"
 
 extern "C"
 {
@@ -60,10 +71,179 @@ enum
     PARAM_DECAY,
     PARAM_DRY,
     PARAM_WET,
+    PARAM_SHARED_TANK,
+    PARAM_IDLE_FLOOR,
+    PARAM_SHARED_BUS,
+    PARAM_ALGORITHM,
+    PARAM_QUALITY,
+    PARAM_CPU_BUDGET,
+    PARAM_FREEZE,
+    PARAM_ROOM_SIZE,
+    PARAM_EARLY_LEVEL,
     NUM_PARAMS
 };
 
-static FMOD_DSP_PARAMETER_DESC p_inputDiffuse1, p_inputDiffuse2, p_decayDiffuse1, p_decayDiffuse2, p_bandwidth, p_decay, p_dry, p_wet;
+/// Tank the diffused input runs through
+enum
+{
+    REVERB_ALGORITHM_PLATE = 0,     // Dattorro's figure of eight
+    REVERB_ALGORITHM_FDN_8,         // feedback delay network of 8 lines
+    REVERB_ALGORITHM_FDN_16,        // feedback delay network of 16 lines
+    NUM_REVERB_ALGORITHMS
+};
+
+static const char* s_algorithmNames[NUM_REVERB_ALGORITHMS] = { "Plate", "FDN 8", "FDN 16" };
+
+/// How much of the reverb runs, and at what rate. Auto picks one of the others to stay inside the CPU budget
+enum
+{
+    REVERB_QUALITY_AUTO = 0,
+    REVERB_QUALITY_FULL,            // all four input diffusers
+    REVERB_QUALITY_REDUCED,         // the first pair of input diffusers only
+    REVERB_QUALITY_MINIMAL,         // no input diffusion, the tank does all of it
+    REVERB_QUALITY_HALF_RATE,       // no input diffusion, and the tank at half the mixer's rate
+    NUM_REVERB_QUALITIES
+};
+
+static const char* s_qualityNames[NUM_REVERB_QUALITIES] = { "Auto", "Full", "Reduced", "Minimal", "Half Rate" };
+
+/// Weight of each block in the running average of the share of real time an instance uses
+#define REVERB_QUALITY_SMOOTHING 0.1f
+
+/// Auto only steps down again once this long has passed since the last step, so the average has caught up
+#define REVERB_QUALITY_SETTLE_MS 100
+
+/// Auto steps back up once the average has stayed under this share of the budget for this long
+#define REVERB_QUALITY_RISE_FRACTION 0.6f
+#define REVERB_QUALITY_RISE_MS 1000
+
+/// Channels the delay memory is sized for when the mixer's speaker mode does not say
+#define REVERB_DEFAULT_MAX_CHANNELS 8
+
+/// Longest run of frames each stage processes on its own. The shortest loop in the reverb is the 107 sample
+/// diffuser, so inside a run this long every delayed read was written by an earlier run. Smaller rooms shorten it
+#define REVERB_SUB_BLOCK 107
+
+/// Time a change of room size crossfades the diffusers and tank over, from reading each line at the old length to
+/// reading it at the new one
+#define REVERB_SIZE_FADE_MS 50
+
+/// Fewest channels that run the tank with every channel in SIMD lanes. Below this each channel runs on its own.
+/// Even a stereo pair comes out ahead, since it halves the copies in and out of the delays
+#define REVERB_VECTOR_CHANNELS 2
+
+/// Output taps of the shared tank, in each of the plate's left and right sets
+#define REVERB_TANK_TAPS 7
+
+/// Gain on the sum of the shared tank's taps
+#define REVERB_TANK_TAP_GAIN 0.6f
+
+/// How far along a line each further pair of channels moves its taps, as a fraction of the line
+#define REVERB_TANK_TAP_SPREAD 0.381966f
+
+/// Shared buses each FMOD system offers. An instance sending to one has no tank of its own running
+#define REVERB_SHARED_BUSES 4
+
+/// FMOD systems that can have shared buses at once, one per systemobject index
+#define REVERB_MAX_SYSTEMS 8
+
+/// Tank lines the shared tank's output is tapped from
+enum
+{
+    TANK_LINE_DELAY_1 = 0,
+    TANK_LINE_DIFFUSE_3,
+    TANK_LINE_DELAY_3,
+    TANK_LINE_DELAY_2,
+    TANK_LINE_DIFFUSE_4,
+    TANK_LINE_DELAY_4,
+    NUM_TANK_LINES
+};
+
+/// One output tap of the shared tank: the line, how many samples back, and its sign
+struct TankTap
+{
+    int line;
+    int sample;
+    float gain;
+};
+
+/// Dattorro's plate output taps. Each side is built mostly from the opposite side of the tank.
+/// No tap is shorter than a pass, so a whole pass of a tap can be read at once
+static const TankTap s_leftTankTaps[REVERB_TANK_TAPS] =
+{
+    { TANK_LINE_DELAY_2,     266,  1.0f },
+    { TANK_LINE_DELAY_2,     2974, 1.0f },
+    { TANK_LINE_DIFFUSE_4,   1913, -1.0f },
+    { TANK_LINE_DELAY_4,     1996, 1.0f },
+    { TANK_LINE_DELAY_1,     1990, -1.0f },
+    { TANK_LINE_DIFFUSE_3,   187,  -1.0f },
+    { TANK_LINE_DELAY_3,     1066, -1.0f }
+};
+
+static const TankTap s_rightTankTaps[REVERB_TANK_TAPS] =
+{
+    { TANK_LINE_DELAY_1,     353,  1.0f },
+    { TANK_LINE_DELAY_1,     3627, 1.0f },
+    { TANK_LINE_DIFFUSE_3,   1228, -1.0f },
+    { TANK_LINE_DELAY_3,     2673, 1.0f },
+    { TANK_LINE_DELAY_2,     2111, -1.0f },
+    { TANK_LINE_DIFFUSE_4,   335,  -1.0f },
+    { TANK_LINE_DELAY_4,     121,  -1.0f }
+};
+
+/// Samples back a tap is at the room size being faded from and the one being faded to. The same once a fade is done
+struct FadedTap
+{
+    int from;
+    int to;
+};
+
+/// How far a pass is through a fade between room sizes at its first frame, and how much further it goes each frame
+struct SizeFade
+{
+    float start;
+    float step;
+};
+
+/// Diffuser or tank line of a number of samples in the reference room, with the memory to reach the largest room
+template <int Length>
+using RoomDelay = FixedDelay<Length, RoomSizeMaxLength(Length)>;
+
+/// Where one output tap of the shared tank is for the current pass
+struct TankSpan
+{
+    const float* sample;    // first sample of the pass
+    int frames;             // samples that follow before the lane wraps
+    const float* lane;      // where it carries on after the wrap
+    int capacity;           // samples in the lane
+};
+
+class Plugin;
+
+/// One reverb tank shared by every instance sending to it. Sends are summed over a mix and the tank runs once after it.
+/// Its output comes back a mix block later through the first send to process, so the mix hears it once however many
+/// voices send. Everything here is only touched on the mixer thread
+struct ReverbBus
+{
+    Plugin* tank;       // created with the system, so picking the bus never allocates
+    float* input;       // sends summed over the current mix
+    float* output;      // the tank's output for the last mix
+    bool sent;          // whether any send had input this mix
+    bool returned;      // whether a send has mixed the output in this mix
+    Plugin* returner;   // the send that mixed it in most recently. Only compared, never followed
+};
+
+/// The shared buses of one FMOD system, created when the plugin is registered with it
+struct ReverbSystem
+{
+    int channels;               // mixer channels every bus runs at
+    unsigned int blockSize;     // frames in a mix
+    ReverbBus buses[REVERB_SHARED_BUSES];
+};
+
+static ReverbSystem* s_reverbSystems[REVERB_MAX_SYSTEMS];
+
+static FMOD_DSP_PARAMETER_DESC p_inputDiffuse1, p_inputDiffuse2, p_decayDiffuse1, p_decayDiffuse2, p_bandwidth, p_decay, p_dry, p_wet, p_sharedTank, p_idleFloor, p_sharedBus, p_algorithm, p_quality, p_cpuBudget, p_freeze, p_roomSize, p_earlyLevel;
 
 
 FMOD_DSP_PARAMETER_DESC* PluginsParameters[NUM_PARAMS] =
@@ -75,7 +255,16 @@ FMOD_DSP_PARAMETER_DESC* PluginsParameters[NUM_PARAMS] =
     &p_bandwidth,
     &p_decay,
     &p_dry,
-    &p_wet
+    &p_wet,
+    &p_sharedTank,
+    &p_idleFloor,
+    &p_sharedBus,
+    &p_algorithm,
+    &p_quality,
+    &p_cpuBudget,
+    &p_freeze,
+    &p_roomSize,
+    &p_earlyLevel
 };
 
 
@@ -125,6 +314,15 @@ extern "C"
         FMOD_DSP_INIT_PARAMDESC_FLOAT(p_decay, "Decay", "", "Amount of filterting of input to reverb", 0.0f, 0.999f, 0.0f);
         FMOD_DSP_INIT_PARAMDESC_FLOAT(p_dry, "Dry", "dB", "Dry volume", -80.0f, 10.0f, 0.0f);
         FMOD_DSP_INIT_PARAMDESC_FLOAT(p_wet, "Wet", "dB", "Wet volume", -80.0f, 10.0f, 0.0f);
+        FMOD_DSP_INIT_PARAMDESC_BOOL(p_sharedTank, "Shared Tank", "On/Off", "Feed every channel into one tank and tap each output from it, instead of a tank per channel", false, 0);
+        FMOD_DSP_INIT_PARAMDESC_FLOAT(p_idleFloor, "Idle Floor", "dB", "Level the tail must fall below before silent input stops processing", -140.0f, -40.0f, -90.0f);
+        FMOD_DSP_INIT_PARAMDESC_INT(p_sharedBus, "Shared Bus", "", "Send to one of the system's shared reverbs instead of running a tank. 0 runs this instance's own tank", 0, REVERB_SHARED_BUSES, 0, false, 0);
+        FMOD_DSP_INIT_PARAMDESC_INT(p_algorithm, "Algorithm", "", "Tank the diffused input runs through: the plate, or a feedback delay network of 8 or 16 lines", 0, NUM_REVERB_ALGORITHMS - 1, REVERB_ALGORITHM_PLATE, false, s_algorithmNames);
+        FMOD_DSP_INIT_PARAMDESC_INT(p_quality, "Quality", "", "How much of the input diffusion runs. Half Rate also runs the tank at half the mixer's rate. Auto steps down when the CPU budget is exceeded and back up once there is room", 0, NUM_REVERB_QUALITIES - 1, REVERB_QUALITY_FULL, false, s_qualityNames);
+        FMOD_DSP_INIT_PARAMDESC_FLOAT(p_cpuBudget, "CPU Budget", "%", "Share of each block's real time this instance may use before Auto quality steps down", 0.1f, 50.0f, 5.0f);
+        FMOD_DSP_INIT_PARAMDESC_BOOL(p_freeze, "Freeze", "On/Off", "Hold the tail at its current level and stop taking input. Only the tank runs while frozen", false, 0);
+        FMOD_DSP_INIT_PARAMDESC_FLOAT(p_roomSize, "Room Size", "x", "Size of the room against the reference room. Scales every diffuser and tank line, crossfading to the new lengths, and spreads the early reflections further apart in bigger rooms", ROOM_SIZE_MIN, ROOM_SIZE_MAX, 1.0f);
+        FMOD_DSP_INIT_PARAMDESC_FLOAT(p_earlyLevel, "Early Level", "dB", "Volume of the early reflections ahead of the tank, on top of the wet volume. Off at the bottom of the range", -80.0f, 10.0f, -80.0f);
         return &PluginCallbacks;
     }
 }
@@ -133,6 +331,30 @@ extern "C"
 //     PLUGIN CLASS     //
 // ==================== //
 
+/// Number of channels the mixer sends in a speaker mode
+static int GetSpeakerModeChannels(FMOD_SPEAKERMODE speakermode)
+{
+    switch (speakermode)
+    {
+        case FMOD_SPEAKERMODE_MONO:
+            return 1;
+        case FMOD_SPEAKERMODE_STEREO:
+            return 2;
+        case FMOD_SPEAKERMODE_QUAD:
+            return 4;
+        case FMOD_SPEAKERMODE_SURROUND:
+            return 5;
+        case FMOD_SPEAKERMODE_5POINT1:
+            return 6;
+        case FMOD_SPEAKERMODE_7POINT1:
+            return 8;
+        case FMOD_SPEAKERMODE_7POINT1POINT4:
+            return 12;
+        default:
+            return REVERB_DEFAULT_MAX_CHANNELS;
+    }
+}
+
 
 class Plugin
 {
@@ -154,66 +376,191 @@ public:
     m_reverbDiffuse4(nullptr),
     m_reverbDelay3(nullptr),
     m_reverbDelay4(nullptr),
-    m_bandwidth(0)
+    m_network(nullptr),
+    m_early(nullptr),
+    m_decimator(nullptr),
+    m_interpolator(nullptr),
+    m_arena(nullptr),
+    m_arenaLanes(nullptr),
+    m_arenaChannels(0),
+    m_tankShared(false),
+    m_tankAlgorithm(REVERB_ALGORITHM_PLATE),
+    m_tankHalfRate(false),
+    m_frozen(false),
+    m_sizeFrom(1.0f),
+    m_sizeTo(1.0f),
+    m_sizeFade(0),
+    m_sizeFadeStep(0),
+    m_passFade(),
+    m_tailHoldSamples(0),
+    m_silentSamples(0),
+    m_bandwidth(0),
+    m_decay(0),
+    m_damping(0),
+    m_inputDiffuse1(0),
+    m_inputDiffuse2(0),
+    m_decayDiffuse1(0),
+    m_decayDiffuse2(0),
+    m_dry(0),
+    m_wet(0),
+    m_sharedTank(false),
+    m_idleFloor(0),
+    m_sharedBus(0),
+    m_algorithm(REVERB_ALGORITHM_PLATE),
+    m_quality(REVERB_QUALITY_FULL),
+    m_cpuBudget(0),
+    m_freeze(false),
+    m_roomSize(0),
+    m_earlyLevel(0),
+    m_tier(REVERB_QUALITY_FULL),
+    m_sampleRate(0),
+    m_cpuUsage(0),
+    m_stepSamples(0),
+    m_riseSamples(0),
+    m_bus(nullptr),
+    m_busChannels(0),
+    m_busFrames(0)
     { }
     
+    /// Frees whatever Release has not. The arena needs the dsp_state, so Release must run first
     ~Plugin()
     {
-        delete m_predelay;
-        delete m_diffuseDelay11;
-        delete m_inputZ;
-        delete m_diffuseDelay11;
-        delete m_diffuseDelay12;
-        delete m_diffuseDelay21;
-        delete m_diffuseDelay22;
-        
-        delete m_reverbDiffuse1;
-        delete m_reverbDiffuse2;
-        delete m_reverbDelay1;
-        delete m_reverbDelay2;
-        delete m_reverbFilter1;
-        delete m_reverbFilter2;
-        delete m_reverbDiffuse3;
-        delete m_reverbDiffuse4;
-        delete m_reverbDelay3;
-        delete m_reverbDelay4;
+        DeleteUnits();
     }
     
     /// Start the plugin and load resources
-    void Init (FMOD_DSP_STATE*);
+    FMOD_RESULT Init (FMOD_DSP_STATE*);
     /// Release resources
-    void Release ();
-    /// Called when the event is restarted
+    void Release (FMOD_DSP_STATE*);
+    /// Called when the event is restarted. Silences every delay so the old tail is not heard again
     void Reset(FMOD_DSP_STATE*);
     /// Called before read to set up memory that needs to know the number of channels
-    void Query(FMOD_DSP_STATE*, int);
+    FMOD_RESULT Query(FMOD_DSP_STATE*, int);
     /// Main DSP processing
     void Read(float* inbuffer, float* outbuffer, unsigned int length, int channels);
     /// Set parameter floats
     void SetParameterFloat(int index, float value);
     /// Get paramter floats
     void GetParameterFloat(int index, float* value);
+    /// Set parameter bools
+    void SetParameterBool(int index, bool value);
+    /// Get parameter bools
+    void GetParameterBool(int index, bool* value);
+    /// Set parameter ints
+    void SetParameterInt(int index, int value);
+    /// Get parameter ints
+    void GetParameterInt(int index, int* value);
+    /// Run a shared bus's tank for one mix with this instance's delays, wet only
+    void ReadBus(ReverbSystem* system, ReverbBus* bus, FMOD_DSP_STATE* dsp_state);
+    /// Called after an Auto quality read with the time it took, to step the quality down or back up
+    void UpdateQuality(double seconds, unsigned int length);
+    /// Called after read to follow the tail once the input has gone idle
+    void UpdateTail(const float* outbuffer, unsigned int length, int channels, bool inputsidle);
+    /// True once the output has stayed below the idle floor for long enough that silent input gives silent output
+    bool IsTailSilent() const { return m_silentSamples >= m_tailHoldSamples; }
     
 private:
     // Input
     DelayUnit* m_predelay;
-    DelayUnit* m_inputZ;
+    FixedDelay<1>* m_inputZ;
     // Diffuse
-    DelayUnit* m_diffuseDelay11;
-    DelayUnit* m_diffuseDelay12;
-    DelayUnit* m_diffuseDelay21;
-    DelayUnit* m_diffuseDelay22;
+    RoomDelay<143>* m_diffuseDelay11;
+    RoomDelay<108>* m_diffuseDelay12;
+    RoomDelay<380>* m_diffuseDelay21;
+    RoomDelay<278>* m_diffuseDelay22;
     // Reverb
-    DelayUnit* m_reverbDiffuse1;
-    DelayUnit* m_reverbDiffuse2;
-    DelayUnit* m_reverbDelay1;
-    DelayUnit* m_reverbDelay2;
-    DelayUnit* m_reverbFilter1;
-    DelayUnit* m_reverbFilter2;
-    DelayUnit* m_reverbDiffuse3;
-    DelayUnit* m_reverbDiffuse4;
-    DelayUnit* m_reverbDelay3;
-    DelayUnit* m_reverbDelay4;
+    RoomDelay<673>* m_reverbDiffuse1;
+    RoomDelay<909>* m_reverbDiffuse2;
+    RoomDelay<4454>* m_reverbDelay1;
+    RoomDelay<4454>* m_reverbDelay2;
+    FixedDelay<1>* m_reverbFilter1;
+    FixedDelay<1>* m_reverbFilter2;
+    RoomDelay<1801>* m_reverbDiffuse3;
+    RoomDelay<2657>* m_reverbDiffuse4;
+    RoomDelay<3721>* m_reverbDelay3;
+    RoomDelay<3164>* m_reverbDelay4;
+    // Network tank, run instead of the plate
+    FeedbackDelayNetwork* m_network;
+    // Taps of the early reflections off the predelay
+    EarlyReflections* m_early;
+    // Down to the tank's rate and back up, when it runs at half rate
+    HalfBandFilter* m_decimator;
+    HalfBandFilter* m_interpolator;
+    
+    /// Sum a pass of early reflections for every output channel off the predelay, interleaved and scaled by gain.
+    /// Called before the pass is written to the predelay
+    void ReadEarly(float* early, int pass, int channels, float gain);
+    /// Filter and diffuse one run of a pass of predelayed input, ready for either tank. At half rate the diffused input
+    /// is every other frame
+    void RunInput(int run, int pass, float* inputBlock, float* diffused);
+    /// Run one run of a pass of diffused input through the plate, to the last diffuser's output
+    void RunTank(int run, int pass, const float* diffused, float* outputBlock);
+    /// Move every delay on by a pass once all runs are done. Everything after the input filter moves on by the
+    /// frames of the pass it ran
+    void AdvanceTank(int pass, int tankPass);
+    /// Samples back a tap of the diffusers or the plate is at the rate they run at, in the rooms being faded between.
+    /// Taken a number of samples back in the reference room
+    FadedTap GetTap(int sample) const;
+    /// Length of a line the shared tank is tapped from, in the reference room
+    int GetTankLineLength(int line) const;
+    /// Move a fade between room sizes on by a pass, and take the new size once it is done
+    void AdvanceSize(int pass);
+    /// Find a shared tank line's samples from a number of samples back
+    TankSpan GetTankSpan(int line, int sample) const;
+    /// Store every tank delay planar, for a channel at a time, or interleaved, for every channel at once
+    void SetTankStorage(DELAYSTORAGE);
+    /// Allocate the arena for a number of channels, replacing any old one
+    FMOD_RESULT AllocateArena(FMOD_DSP_STATE*, int);
+    /// Find the shared bus picked for this instance. Returns null if there is none
+    ReverbBus* AttachBus(FMOD_DSP_STATE*, int);
+    /// Add the input to the shared bus and pass it on dry. The first send of a mix also mixes in what the bus made of
+    /// the last one
+    void ReadSend(float* inbuffer, float* outbuffer, unsigned int length, int channels);
+    /// Run the input network at a quality, silencing any diffusers coming back into use
+    void SetTier(int tier);
+    /// Run the diffusers and tank at the mixer's rate or half of it. Whatever they held is dropped
+    void SetTankRate(bool halfRate);
+    /// Work the tail hold out for the predelay, room size, tank and quality in use. A silent tail stays silent
+    void UpdateTailHold();
+    /// Silence the diffusers, the running tank and the resamplers. Each delay only zeroes what it wrote since it was
+    /// last clear
+    void ClearTank();
+    /// Delete every delay, filter and table the instance owns, leaving the pointers null so it is safe to repeat
+    void DeleteUnits();
+    /// Walk the delays in processing order. Returns the floats the arena needs for maxChannels,
+    /// and when given an arena lays every delay out in it for channels, or a single channel for a shared tank
+    int LayoutDelays(int maxChannels, int channels, float* arena);
+    
+    // Every delay's memory, in the order the tank touches it. Allocated once at create
+    void* m_arena;
+    float* m_arenaLanes;
+    int m_arenaChannels;
+    
+    /// Whether the tank was last laid out shared, and which tank. Only change in Query so Read always matches the layout
+    bool m_tankShared;
+    int m_tankAlgorithm;
+    
+    /// Whether the diffusers and tank run at half the mixer's rate. Follows the quality
+    bool m_tankHalfRate;
+    
+    /// Whether the tank is holding its tail with nothing fed in. Only changes in Query so a pass never half freezes
+    bool m_frozen;
+    
+    /// Room sizes the diffusers and tank are fading from and to, how far through the fade they are, and how much
+    /// further each frame takes it. A new size is only picked up in Query once the last fade is done
+    float m_sizeFrom;
+    float m_sizeTo;
+    float m_sizeFade;
+    float m_sizeFadeStep;
+    
+    /// Fade between room sizes over the pass being run, per frame at the tank's rate
+    SizeFade m_passFade;
+    
+    /// Samples of idle input the output must stay below the idle floor before nothing is left in any line: one trip through
+    /// every line in use, at the lengths they are in use at
+    int m_tailHoldSamples;
+    /// Samples of idle input the output has been below the idle floor
+    int m_silentSamples;
     
     // Parameters
     float m_bandwidth;
@@ -221,288 +568,1318 @@ private:
     float m_inputDiffuse1, m_inputDiffuse2;
     float m_decayDiffuse1, m_decayDiffuse2;
     float m_dry, m_wet;
+    bool m_sharedTank;
+    float m_idleFloor;
+    int m_sharedBus;
+    int m_algorithm;
+    int m_quality;
+    float m_cpuBudget;
+    bool m_freeze;
+    float m_roomSize;
+    float m_earlyLevel;
+    
+    /// Quality the input network is running at, never Auto
+    int m_tier;
+    
+    /// Mixer rate, the running average share of real time used, samples since the last step and samples the average
+    /// has been low enough to step back up. Only used for Auto
+    int m_sampleRate;
+    float m_cpuUsage;
+    int m_stepSamples;
+    int m_riseSamples;
+    
+    /// Bus this instance sends to instead of running its own tank, and the channels and frames it runs at. Only changes in Query
+    ReverbBus* m_bus;
+    int m_busChannels;
+    unsigned int m_busFrames;
+    
+};
+
+FMOD_RESULT Plugin::Init(FMOD_DSP_STATE* dsp_state)
+{
+    m_bandwidth = 0.5;
+    m_sharedTank = false;
+    m_tankShared = false;
+    m_idleFloor = -90.0f;
+    m_algorithm = REVERB_ALGORITHM_PLATE;
+    m_tankAlgorithm = REVERB_ALGORITHM_PLATE;
+    m_quality = REVERB_QUALITY_FULL;
+    m_cpuBudget = 5.0f;
+    m_tier = REVERB_QUALITY_FULL;
+    m_tankHalfRate = false;
+    m_freeze = false;
+    m_frozen = false;
+    m_cpuUsage = 0.0f;
+    m_stepSamples = 0;
+    m_riseSamples = 0;
+    
+    m_sampleRate = 48000;
+    FMOD_DSP_GETSAMPLERATE(dsp_state, &m_sampleRate);
+    
+    DeleteUnits();
+    
+    m_predelay = new DelayUnit();
+    m_inputZ = new FixedDelay<1>();
+    m_diffuseDelay11 = new RoomDelay<143>();
+    m_diffuseDelay12 = new RoomDelay<108>();
+    m_diffuseDelay21 = new RoomDelay<380>();
+    m_diffuseDelay22 = new RoomDelay<278>();
+    
+    m_reverbDiffuse1 = new RoomDelay<673>();
+    m_reverbDiffuse2 = new RoomDelay<909>();
+    m_reverbDelay1 = new RoomDelay<4454>();
+    m_reverbDelay2 = new RoomDelay<4454>();
+    m_reverbFilter1 = new FixedDelay<1>();
+    m_reverbFilter2 = new FixedDelay<1>();
+    m_reverbDiffuse3 = new RoomDelay<1801>();
+    m_reverbDiffuse4 = new RoomDelay<2657>();
+    m_reverbDelay3 = new RoomDelay<3721>();
+    m_reverbDelay4 = new RoomDelay<3164>();
+    m_network = new FeedbackDelayNetwork();
+    m_early = new EarlyReflections();
+    m_decimator = new HalfBandFilter();
+    m_interpolator = new HalfBandFilter();
+    
+    // The predelay is read a block at a time, so wrap it with a mask and keep each channel contiguous
+    m_predelay->SetStorage(DELAY_STORAGE_PLANAR);
+    
+    // Predelay, long enough for the latest early reflection to be tapped from it
+    m_predelay->Init(dsp_state, EARLY_MAX_MS);
+    m_predelay->SetDelayTime(10.0f);
+    m_predelay->SetFeedback(0.0f);
+    
+    // Early reflections. They are read before each pass is written, so no tap is nearer than the longest pass, which
+    // is the shortest loop in the largest room
+    m_roomSize = 1.0f;
+    m_earlyLevel = 0.0f;
+    m_early->Init(m_sampleRate, RoomSizeMaxLength(REVERB_SUB_BLOCK), m_predelay->GetMaxDelayTimeInSamples(), m_roomSize);
+    
+    // Every line has the memory for the largest room, so the size only moves where they are read
+    m_sizeFrom = m_roomSize;
+    m_sizeTo = m_roomSize;
+    m_sizeFade = 0.0f;
+    m_sizeFadeStep = 1000.0f / (REVERB_SIZE_FADE_MS * m_sampleRate);
+    m_passFade = { 0.0f, 0.0f };
+    
+    // Input filter
+    m_inputZ->Init(dsp_state);
+    
+    // 4 diffuse delays
+    m_diffuseDelay11->Init(dsp_state);
+    
+    m_diffuseDelay12->Init(dsp_state);
+    
+    m_diffuseDelay21->Init(dsp_state);
+    
+    m_diffuseDelay22->Init(dsp_state);
+    
+    // Reverb diffuse
+    
+    m_reverbDiffuse1->Init(dsp_state);
+    
+    m_reverbDiffuse2->Init(dsp_state);
+    
+    // Reverb delays
+    
+    m_reverbDelay1->Init(dsp_state);
+    
+    m_reverbDelay2->Init(dsp_state);
+    
+    // Reverb filters
+    
+    m_reverbFilter1->Init(dsp_state);
+    
+    m_reverbFilter2->Init(dsp_state);
+    
+    // Reverb diffuse 2
+    
+    m_reverbDiffuse3->Init(dsp_state);
+    
+    m_reverbDiffuse4->Init(dsp_state);
+    
+    // Reverb delays 2
+    
+    m_reverbDelay3->Init(dsp_state);
+    
+    m_reverbDelay4->Init(dsp_state);
+    
+    // The lines start empty
+    UpdateTailHold();
+    m_silentSamples = m_tailHoldSamples;
+    
+    // Size the arena for the widest signal the mixer will send, so Query only has to lay the delays out
+    FMOD_SPEAKERMODE mixerMode = FMOD_SPEAKERMODE_DEFAULT;
+    FMOD_SPEAKERMODE outputMode = FMOD_SPEAKERMODE_DEFAULT;
+    int maxChannels = REVERB_DEFAULT_MAX_CHANNELS;
+    
+    if (FMOD_DSP_GETSPEAKERMODE(dsp_state, &mixerMode, &outputMode) == FMOD_OK)
+    {
+        maxChannels = GetSpeakerModeChannels(mixerMode);
+    }
+    
+    return AllocateArena(dsp_state, maxChannels);
+}
+
+void Plugin::DeleteUnits()
+{
+    delete m_predelay;
+    delete m_inputZ;
+    delete m_diffuseDelay11;
+    delete m_diffuseDelay12;
+    delete m_diffuseDelay21;
+    delete m_diffuseDelay22;
+    
+    delete m_reverbDiffuse1;
+    delete m_reverbDiffuse2;
+    delete m_reverbDelay1;
+    delete m_reverbDelay2;
+    delete m_reverbFilter1;
+    delete m_reverbFilter2;
+    delete m_reverbDiffuse3;
+    delete m_reverbDiffuse4;
+    delete m_reverbDelay3;
+    delete m_reverbDelay4;
+    delete m_network;
+    delete m_early;
+    delete m_decimator;
+    delete m_interpolator;
+    
+    m_predelay = nullptr;
+    m_inputZ = nullptr;
+    m_diffuseDelay11 = nullptr;
+    m_diffuseDelay12 = nullptr;
+    m_diffuseDelay21 = nullptr;
+    m_diffuseDelay22 = nullptr;
+    
+    m_reverbDiffuse1 = nullptr;
+    m_reverbDiffuse2 = nullptr;
+    m_reverbDelay1 = nullptr;
+    m_reverbDelay2 = nullptr;
+    m_reverbFilter1 = nullptr;
+    m_reverbFilter2 = nullptr;
+    m_reverbDiffuse3 = nullptr;
+    m_reverbDiffuse4 = nullptr;
+    m_reverbDelay3 = nullptr;
+    m_reverbDelay4 = nullptr;
+    m_network = nullptr;
+    m_early = nullptr;
+    m_decimator = nullptr;
+    m_interpolator = nullptr;
+}
+
+FMOD_RESULT Plugin::AllocateArena(FMOD_DSP_STATE* dsp_state, int maxChannels)
+{
+    // Extra cache line so the first delay can start on one
+    unsigned int bytes = LayoutDelays(maxChannels, 0, nullptr) * sizeof(float) + DELAY_UNIT_LANE_ALIGNMENT;
+    void* arena = FMOD_DSP_ALLOC(dsp_state, bytes);
+    if (!arena)
+    {
+        return FMOD_ERR_MEMORY;
+    }
+    
+    if (m_arena)
+    {
+        FMOD_DSP_FREE(dsp_state, m_arena);
+    }
+    
+    uintptr_t address = (uintptr_t)arena;
+    m_arena = arena;
+    m_arenaLanes = (float*)((address + DELAY_UNIT_LANE_ALIGNMENT - 1) & ~(uintptr_t)(DELAY_UNIT_LANE_ALIGNMENT - 1));
+    m_arenaChannels = maxChannels;
+    
+    return FMOD_OK;
+}
+
+/// Give a delay its slice of the arena, keeping every slice on a cache line
+template <typename Delay>
+static void PlaceDelay(Delay* delay, int maxChannels, int channels, float* arena, int& offset)
+{
+    if (arena)
+    {
+        delay->CreateBuffers(channels, arena + offset);
+    }
+    
+    const int lineFloats = DELAY_UNIT_LANE_ALIGNMENT / sizeof(float);
+    offset += (delay->GetStorageSize(maxChannels) + lineFloats - 1) & ~(lineFloats - 1);
+}
+
+int Plugin::LayoutDelays(int maxChannels, int channels, float* arena)
+{
+    int offset = 0;
+    int tankChannels = m_tankShared ? 1 : channels;
+    
+    // Input
+    PlaceDelay(m_predelay, maxChannels, tankChannels, arena, offset);
+    PlaceDelay(m_inputZ, maxChannels, tankChannels, arena, offset);
+    
+    // Diffusion
+    PlaceDelay(m_diffuseDelay11, maxChannels, tankChannels, arena, offset);
+    PlaceDelay(m_diffuseDelay12, maxChannels, tankChannels, arena, offset);
+    PlaceDelay(m_diffuseDelay21, maxChannels, tankChannels, arena, offset);
+    PlaceDelay(m_diffuseDelay22, maxChannels, tankChannels, arena, offset);
+    
+    // Resamplers either side of the diffusers and tank. Every output channel comes back up, even from a shared tank
+    PlaceDelay(m_decimator, maxChannels, tankChannels, arena, offset);
+    PlaceDelay(m_interpolator, maxChannels, channels, arena, offset);
+    
+    // Only one tank runs at a time, so both start in the same place and the arena is sized for the larger
+    float* plateArena = (m_tankAlgorithm == REVERB_ALGORITHM_PLATE) ? arena : nullptr;
+    int tankOffset = offset;
+    
+    if (arena && !plateArena)
+    {
+        m_network->CreateBuffers(tankChannels, arena + offset);
+    }
+    
+    // First side of the tank
+    PlaceDelay(m_reverbDiffuse1, maxChannels, tankChannels, plateArena, offset);
+    PlaceDelay(m_reverbDelay1, maxChannels, tankChannels, plateArena, offset);
+    PlaceDelay(m_reverbFilter1, maxChannels, tankChannels, plateArena, offset);
+    PlaceDelay(m_reverbDiffuse3, maxChannels, tankChannels, plateArena, offset);
+    PlaceDelay(m_reverbDelay3, maxChannels, tankChannels, plateArena, offset);
+    
+    // Other side
+    PlaceDelay(m_reverbDiffuse2, maxChannels, tankChannels, plateArena, offset);
+    PlaceDelay(m_reverbDelay2, maxChannels, tankChannels, plateArena, offset);
+    PlaceDelay(m_reverbFilter2, maxChannels, tankChannels, plateArena, offset);
+    PlaceDelay(m_reverbDiffuse4, maxChannels, tankChannels, plateArena, offset);
+    PlaceDelay(m_reverbDelay4, maxChannels, tankChannels, plateArena, offset);
+    
+    return std::max(offset, tankOffset + FeedbackDelayNetwork::GetStorageSize(FDN_MAX_LINES, maxChannels));
+}
+
+void Plugin::Release(FMOD_DSP_STATE* dsp_state)
+{
+    DeleteUnits();
+    
+    if (m_arena)
+    {
+        FMOD_DSP_FREE(dsp_state, m_arena);
+        m_arena = nullptr;
+        m_arenaLanes = nullptr;
+    }
+}
+
+void Plugin::Reset(FMOD_DSP_STATE* dsp_state)
+{
+    // A send has no tank of its own, and the bus's tank carries every other instance's tail too
+    if (m_bus)
+    {
+        return;
+    }
+    
+    // Most of the arena is never touched at the channel count and tank in use, so clear only what was written
+    m_predelay->Clear();
+    m_inputZ->Clear();
+    ClearTank();
+    
+    // Nothing is left to ring out, or to fade out of
+    m_silentSamples = m_tailHoldSamples;
+    m_sizeFrom = m_sizeTo;
+    m_sizeFade = 0.0f;
+}
+
+FMOD_RESULT Plugin::Query(FMOD_DSP_STATE* dsp_state, int channels)
+{
+    // Take any early reflections built since the last mix. A send passes its own on to the bus
+    m_early->Update();
+    
+    // A send has nothing of its own to lay out
+    m_bus = m_sharedBus ? AttachBus(dsp_state, m_sharedBus - 1) : nullptr;
+    if (m_bus)
+    {
+        return FMOD_OK;
+    }
+    
+    // Only a signal wider than the mixer's speaker mode needs a bigger arena
+    if (channels > m_arenaChannels)
+    {
+        FMOD_RESULT result = AllocateArena(dsp_state, channels);
+        if (result != FMOD_OK)
+        {
+            return result;
+        }
+    }
+    
+    // A shared tank, and the predelay feeding it, is one channel whatever the input is
+    m_tankShared = m_sharedTank;
+    int tankChannels = m_tankShared ? 1 : channels;
+    
+    // The tanks share memory, so the other one's contents are cleared out rather than played back.
+    // Switching tanks starts the reverb over, much like a reset
+    if (m_tankAlgorithm != m_algorithm)
+    {
+        m_tankAlgorithm = m_algorithm;
+        memset(m_arenaLanes, 0, LayoutDelays(m_arenaChannels, 0, nullptr) * sizeof(float));
+    }
+    m_network->SetLines(m_tankAlgorithm == REVERB_ALGORITHM_FDN_16 ? 16 : 8);
+    
+    // With enough channels to fill a vector, interleave them so each stage runs every channel in SIMD lanes
+    SetTankStorage(tankChannels >= REVERB_VECTOR_CHANNELS ? DELAY_STORAGE_POWER_OF_TWO : DELAY_STORAGE_PLANAR);
+    
+    // A shared tank's output channels come back up together, interleaved like the channels of a tank per channel
+    m_interpolator->SetStorage(channels >= REVERB_VECTOR_CHANNELS ? DELAY_STORAGE_POWER_OF_TWO : DELAY_STORAGE_PLANAR);
+    
+    LayoutDelays(m_arenaChannels, channels, m_arenaLanes);
+    
+    // Nothing in front of the tank runs while it is frozen, so what it held from before would come out stale
+    if (m_frozen && !m_freeze)
+    {
+        m_predelay->Clear();
+        m_inputZ->Clear();
+        m_diffuseDelay11->Clear();
+        m_diffuseDelay12->Clear();
+        m_diffuseDelay21->Clear();
+        m_diffuseDelay22->Clear();
+        m_decimator->ClearHistory();    // the interpolator kept running, so the phase is still right
+    }
+    m_frozen = m_freeze;
+    
+    // A new room size starts fading in once the last one has finished, so a pass only ever reads two sizes. With no
+    // tail ringing there is nothing to fade, so a new or reset instance starts at its size
+    const float roomSize = std::max(ROOM_SIZE_MIN, std::min(m_roomSize, ROOM_SIZE_MAX));
+    if (IsTailSilent())
+    {
+        m_sizeFrom = roomSize;
+        m_sizeTo = roomSize;
+        m_sizeFade = 0.0f;
+    }
+    else if (m_sizeFrom == m_sizeTo && m_sizeTo != roomSize)
+    {
+        m_sizeTo = roomSize;
+        m_sizeFade = 0.0f;
+    }
+    
+    // A fixed quality takes effect here. Auto moves between reads
+    if (m_quality != REVERB_QUALITY_AUTO)
+    {
+        SetTier(m_quality);
+    }
+    
+    UpdateTailHold();
+    return FMOD_OK;
+}
+
+ReverbBus* Plugin::AttachBus(FMOD_DSP_STATE* dsp_state, int index)
+{
+    int systemobject = dsp_state->systemobject;
+    ReverbSystem* system = (systemobject >= 0 && systemobject < REVERB_MAX_SYSTEMS) ? s_reverbSystems[systemobject] : nullptr;
+    if (!system)
+    {
+        return nullptr;
+    }
+    
+    ReverbBus* bus = &system->buses[index];
+    m_busChannels = system->channels;
+    m_busFrames = system->blockSize;
+    return bus;
+}
+
+void Plugin::ReadSend(float* inbuffer, float* outbuffer, unsigned int length, int channels)
+{
+    // The bus's tank follows the settings of whichever send reached it last. Sends on the same preset agree
+    Plugin* tank = m_bus->tank;
+    tank->m_bandwidth = m_bandwidth;
+    tank->m_decay = m_decay;
+    tank->m_damping = m_damping;
+    tank->m_inputDiffuse1 = m_inputDiffuse1;
+    tank->m_inputDiffuse2 = m_inputDiffuse2;
+    tank->m_decayDiffuse1 = m_decayDiffuse1;
+    tank->m_decayDiffuse2 = m_decayDiffuse2;
+    tank->m_sharedTank = m_sharedTank;
+    tank->m_idleFloor = m_idleFloor;
+    tank->m_algorithm = m_algorithm;
+    tank->m_quality = m_quality;
+    tank->m_cpuBudget = m_cpuBudget;
+    tank->m_freeze = m_freeze;
+    tank->m_roomSize = m_roomSize;
+    tank->m_earlyLevel = m_earlyLevel;
+    tank->m_early->CopyTaps(*m_early);
+    
+    // Channels fold onto the bus's channels when the counts differ. Anything past the mixer's block is only sent dry
+    const int busChannels = m_busChannels;
+    float* send = m_bus->input;
+    const float* bus = m_bus->output;
+    unsigned int frames = std::min(length, m_busFrames);
+    
+    for (unsigned int k = 0; k < length * channels; k++)
+    {
+        outbuffer[k] = inbuffer[k] * m_dry;
+    }
+    
+    for (unsigned int i = 0; i < frames; i++)
+    {
+        for (int c = 0; c < channels; c++)
+        {
+            send[i * busChannels + (c % busChannels)] += inbuffer[i * channels + c];
+        }
+    }
+    
+    // Only the first send of the mix brings the bus back, at its own wet level. Every other send is dry
+    if (m_bus->returned)
+    {
+        return;
+    }
+    m_bus->returned = true;
+    m_bus->returner = this;
+    
+    for (unsigned int i = 0; i < frames; i++)
+    {
+        for (int c = 0; c < channels; c++)
+        {
+            outbuffer[i * channels + c] += bus[i * busChannels + (c % busChannels)] * m_wet;
+        }
+    }
+}
+
+void Plugin::ReadBus(ReverbSystem* system, ReverbBus* bus, FMOD_DSP_STATE* dsp_state)
+{
+    // Dry is left to the sends, and the wet level to the send that mixes the bus in
+    m_dry = 0.0f;
+    m_wet = 1.0f;
+    
+    // Every send has had this mix's output by now, so the first send of the next mix returns the next
+    bus->returned = false;
+    
+    // Nothing sent and nothing left ringing, so the bus is silent without running the tank
+    if (!bus->sent && IsTailSilent())
+    {
+        memset(bus->output, 0, system->blockSize * system->channels * sizeof(float));
+        return;
+    }
+    
+    if (Query(dsp_state, system->channels) != FMOD_OK)
+    {
+        return;
+    }
+    
+    Read(bus->input, bus->output, system->blockSize, system->channels);
+    UpdateTail(bus->output, system->blockSize, system->channels, !bus->sent);
+    
+    memset(bus->input, 0, system->blockSize * system->channels * sizeof(float));
+    bus->sent = false;
+}
+
+void Plugin::SetTankStorage(DELAYSTORAGE storage)
+{
+    m_inputZ->SetStorage(storage);
+    m_diffuseDelay11->SetStorage(storage);
+    m_diffuseDelay12->SetStorage(storage);
+    m_diffuseDelay21->SetStorage(storage);
+    m_diffuseDelay22->SetStorage(storage);
+    m_decimator->SetStorage(storage);
+    
+    m_reverbDiffuse1->SetStorage(storage);
+    m_reverbDelay1->SetStorage(storage);
+    m_reverbFilter1->SetStorage(storage);
+    m_reverbDiffuse3->SetStorage(storage);
+    m_reverbDelay3->SetStorage(storage);
+    m_reverbDiffuse2->SetStorage(storage);
+    m_reverbDelay2->SetStorage(storage);
+    m_reverbFilter2->SetStorage(storage);
+    m_reverbDiffuse4->SetStorage(storage);
+    m_reverbDelay4->SetStorage(storage);
+    
+    m_network->SetStorage(storage);
+}
+
+/// Read one run of a block from a tap. While the room size is fading it is read at both sizes and crossfaded a frame
+/// at a time
+template <typename Delay>
+static void ReadFadedBlock(const Delay* delay, FadedTap tap, const SizeFade& fade, int run, float* outbuffer, int length)
+{
+    delay->ReadBlock(run, tap.from, outbuffer, length);
+    if (tap.to == tap.from)
+    {
+        return;
+    }
+    
+    const int width = delay->GetRunWidth();
+    float to[DELAY_UNIT_BLOCK_SAMPLES];
+    delay->ReadBlock(run, tap.to, to, length);
+    
+    for (int i = 0; i < length; i++)
+    {
+        const float mix = std::min(fade.start + (fade.step * i), 1.0f);
+        for (int c = 0; c < width; c++)
+        {
+            int k = i * width + c;
+            outbuffer[k] += (to[k] - outbuffer[k]) * mix;
+        }
+    }
+}
+
+/// Allpass diffuser over one run of a block, tapped a number of samples back. The delayed sample is fed back through
+/// -gain and forward through gain, so the tank's diffusers, which use the opposite signs, pass a negated gain
+template <typename Delay>
+static void AllpassBlock(Delay* delay, FadedTap tap, const SizeFade& fade, int run, const float* inbuffer, float* outbuffer, int length, float gain)
+{
+    float delayed[DELAY_UNIT_BLOCK_SAMPLES];
+    float top[DELAY_UNIT_BLOCK_SAMPLES];
+    int count = length * delay->GetRunWidth();
+    
+    ReadFadedBlock(delay, tap, fade, run, delayed, length);
+    for (int i = 0; i < count; i++)
+    {
+        top[i] = FlushDenormal((-delayed[i] * gain) + inbuffer[i]);
+        outbuffer[i] = delayed[i] + (top[i] * gain);
+    }
+    delay->WriteBlock(run, top, length);
+}
+
+void Plugin::ReadEarly(float* early, int pass, int channels, float gain)
+{
+    const EarlyTaps& taps = m_early->GetTaps();
+    float run[DELAY_UNIT_BLOCK_SAMPLES];
+    
+    // Pairs of channels take the left and right patterns. A shared tank's predelay is one channel every output taps
+    for (int n = 0; n < channels; n++)
+    {
+        int side = n & 1;
+        m_predelay->ReadLaneTaps(m_tankShared ? 0 : n, run, pass, taps.sample[side], taps.gain[side], taps.count);
+        
+        for (int i = 0; i < pass; i++)
+        {
+            early[i * channels + n] = run[i] * gain;
+        }
+    }
+}
+
+void Plugin::RunInput(int run, int pass, float* inputBlock, float* diffused)
+{
+    const int width = m_inputZ->GetRunWidth();
+    
+    float state[DELAY_UNIT_BLOCK_SAMPLES];
+    
+    const float inputFeedback = 1 - m_bandwidth;
+    
+    // Filter predelay before diffusion. Only the last output of each channel is needed as history
+    m_inputZ->ReadBlock<1>(run, state, 1);
+    for (int i = 0; i < pass; i++)
+    {
+        float* frame = inputBlock + i * width;
+        for (int c = 0; c < width; c++)
+        {
+            state[c] = FlushDenormal((state[c] * inputFeedback) + frame[c]);
+            frame[c] = state[c];
+        }
+    }
+    m_inputZ->WriteBlock(run, state, 1);
+    
+    // At half rate everything after the input filter runs on every other frame
+    if (m_tankHalfRate)
+    {
+        pass = m_decimator->Decimate(run, inputBlock, inputBlock, pass);
+    }
+    
+    // DIFFUSION
+    
+    if (m_tier >= REVERB_QUALITY_MINIMAL)
+    {
+        memcpy(diffused, inputBlock, pass * width * sizeof(float));
+        return;
+    }
+    
+    AllpassBlock(m_diffuseDelay11, GetTap(142), m_passFade, run, inputBlock, diffused, pass, m_inputDiffuse1);
+    AllpassBlock(m_diffuseDelay12, GetTap(107), m_passFade, run, diffused, diffused, pass, m_inputDiffuse1);
+    
+    if (m_tier == REVERB_QUALITY_FULL)
+    {
+        AllpassBlock(m_diffuseDelay21, GetTap(379), m_passFade, run, diffused, diffused, pass, m_inputDiffuse2);
+        AllpassBlock(m_diffuseDelay22, GetTap(277), m_passFade, run, diffused, diffused, pass, m_inputDiffuse2);
+    }
+}
+
+void Plugin::RunTank(int run, int pass, const float* diffused, float* outputBlock)
+{
+    const int width = m_reverbDelay4->GetRunWidth();
+    const int count = pass * width;
+    
+    // One run of the pass after each stage
+    float leftSide[DELAY_UNIT_BLOCK_SAMPLES];
+    float delayed[DELAY_UNIT_BLOCK_SAMPLES];
+    float state[DELAY_UNIT_BLOCK_SAMPLES];
+    
+    // At half rate each tap is half as many samples back, and the damping filter's pole is squared so it rolls off
+    // from the same frequency. Frozen, nothing is lost on the way round, so the tail holds
+    const float decay = m_frozen ? 1.0f : m_decay;
+    const float damping = m_frozen ? 0.0f : (m_tankHalfRate ? m_damping * m_damping : m_damping);
+    const float delayGain = 1 - damping;
+    
+    // REVERB
+    
+    ReadFadedBlock(m_reverbDelay4, GetTap(3163), m_passFade, run, delayed, pass);
+    for (int i = 0; i < count; i++)
+    {
+        leftSide[i] = diffused[i] + (delayed[i] * decay);
+    }
+    
+    // diffuse 1
+    AllpassBlock(m_reverbDiffuse1, GetTap(672), m_passFade, run, leftSide, leftSide, pass, -m_decayDiffuse1);
+    
+    // reverb delay 1 and filter 1
+    ReadFadedBlock(m_reverbDelay1, GetTap(4453), m_passFade, run, delayed, pass);
+    m_reverbDelay1->WriteBlock(run, leftSide, pass);
+    
+    m_reverbFilter1->ReadBlock<1>(run, state, 1);
+    for (int i = 0; i < pass; i++)
+    {
+        for (int c = 0; c < width; c++)
+        {
+            int k = i * width + c;
+            leftSide[k] = FlushDenormal(((state[c] * damping) + (delayed[k] * delayGain)) * decay);
+        }
+    }
+    
+    // diffuse 3 (second diffuse on left side)
+    AllpassBlock(m_reverbDiffuse3, GetTap(1800), m_passFade, run, leftSide, leftSide, pass, m_decayDiffuse2);
+    
+    // reverb delay 3
+    ReadFadedBlock(m_reverbDelay3, GetTap(3720), m_passFade, run, delayed, pass);
+    m_reverbDelay3->WriteBlock(run, leftSide, pass);
+    
+    // OTHER SIDE
+    
+    for (int i = 0; i < count; i++)
+    {
+        outputBlock[i] = (delayed[i] * decay) + diffused[i];
+    }
+    
+    // diffuse 2
+    AllpassBlock(m_reverbDiffuse2, GetTap(908), m_passFade, run, outputBlock, outputBlock, pass, -m_decayDiffuse1);
+    
+    // reverb delay 2 and filter 2
+    ReadFadedBlock(m_reverbDelay2, GetTap(4217), m_passFade, run, delayed, pass);
+    m_reverbDelay2->WriteBlock(run, outputBlock, pass);
+    
+    m_reverbFilter2->ReadBlock<1>(run, state, 1);
+    for (int i = 0; i < pass; i++)
+    {
+        for (int c = 0; c < width; c++)
+        {
+            int k = i * width + c;
+            outputBlock[k] = FlushDenormal(((state[c] * damping) + (delayed[k] * delayGain)) * decay);
+        }
+    }
+    
+    // diffuse 4
+    AllpassBlock(m_reverbDiffuse4, GetTap(2656), m_passFade, run, outputBlock, outputBlock, pass, m_decayDiffuse2);
+    
+    // reverb delay 4
+    m_reverbDelay4->WriteBlock(run, outputBlock, pass);
+}
+
+void Plugin::AdvanceTank(int pass, int tankPass)
+{
+    // Frozen, nothing in front of the tank was run
+    if (!m_frozen)
+    {
+        m_inputZ->AdvanceFrames(pass);
+        m_diffuseDelay11->AdvanceFrames(tankPass);
+        m_diffuseDelay12->AdvanceFrames(tankPass);
+        m_diffuseDelay21->AdvanceFrames(tankPass);
+        m_diffuseDelay22->AdvanceFrames(tankPass);
+    }
+    
+    if (m_tankHalfRate)
+    {
+        m_decimator->AdvanceFrames(pass);
+        m_interpolator->AdvanceFrames(pass);
+    }
+    
+    if (m_tankAlgorithm != REVERB_ALGORITHM_PLATE)
+    {
+        m_network->AdvanceFrames(tankPass);
+        return;
+    }
+    
+    m_reverbDiffuse1->AdvanceFrames(tankPass);
+    m_reverbDelay1->AdvanceFrames(tankPass);
+    m_reverbFilter1->AdvanceFrames(tankPass);
+    m_reverbDiffuse3->AdvanceFrames(tankPass);
+    m_reverbDelay3->AdvanceFrames(tankPass);
+    m_reverbDiffuse2->AdvanceFrames(tankPass);
+    m_reverbDelay2->AdvanceFrames(tankPass);
+    m_reverbFilter2->AdvanceFrames(tankPass);
+    m_reverbDiffuse4->AdvanceFrames(tankPass);
+    m_reverbDelay4->AdvanceFrames(tankPass);
+}
+
+FadedTap Plugin::GetTap(int sample) const
+{
+    FadedTap tap;
+    tap.from = RoomSizeTap(sample, m_sizeFrom);
+    tap.to = (m_sizeTo == m_sizeFrom) ? tap.from : RoomSizeTap(sample, m_sizeTo);
+    
+    if (m_tankHalfRate)
+    {
+        tap.from /= 2;
+        tap.to /= 2;
+    }
+    return tap;
+}
+
+void Plugin::AdvanceSize(int pass)
+{
+    if (m_sizeFrom == m_sizeTo)
+    {
+        return;
+    }
+    
+    m_sizeFade += pass * m_sizeFadeStep;
+    if (m_sizeFade >= 1.0f)
+    {
+        m_sizeFrom = m_sizeTo;
+        m_sizeFade = 0.0f;
+    }
+}
+
+int Plugin::GetTankLineLength(int line) const
+{
+    switch (line)
+    {
+        case TANK_LINE_DELAY_1:
+            return m_reverbDelay1->GetLength();
+        case TANK_LINE_DIFFUSE_3:
+            return m_reverbDiffuse3->GetLength();
+        case TANK_LINE_DELAY_3:
+            return m_reverbDelay3->GetLength();
+        case TANK_LINE_DELAY_2:
+            return m_reverbDelay2->GetLength();
+        case TANK_LINE_DIFFUSE_4:
+            return m_reverbDiffuse4->GetLength();
+        case TANK_LINE_DELAY_4:
+        default:
+            return m_reverbDelay4->GetLength();
+    }
+}
+
+/// Span of a tap on the first lane of a delay
+template <typename Delay>
+static TankSpan GetDelaySpan(const Delay* delay, int sample)
+{
+    TankSpan span;
+    span.sample = delay->GetTapSpan(0, sample, &span.frames);
+    span.lane = delay->GetLane(0);
+    span.capacity = delay->GetWrap();
+    return span;
+}
+
+/// Sum a pass of a shared tank's taps for one output channel, frames stride apart in the output. Splits the pass
+/// wherever one of the taps wraps, and moves every span on past it
+static void SumTankTaps(TankSpan* spans, const float* gains, int length, float* outbuffer, int stride)
+{
+    for (int i = 0; i < length; )
+    {
+        int run = length - i;
+        for (int t = 0; t < REVERB_TANK_TAPS; t++)
+        {
+            run = std::min(run, spans[t].frames);
+        }
+        
+        for (int k = 0; k < run; k++)
+        {
+            float sum = 0;
+            for (int t = 0; t < REVERB_TANK_TAPS; t++)
+            {
+                sum += spans[t].sample[k] * gains[t];
+            }
+            outbuffer[(i + k) * stride] = sum;
+        }
+        
+        for (int t = 0; t < REVERB_TANK_TAPS; t++)
+        {
+            spans[t].sample += run;
+            spans[t].frames -= run;
+            if (spans[t].frames == 0)
+            {
+                spans[t].sample = spans[t].lane;
+                spans[t].frames = spans[t].capacity;
+            }
+        }
+        
+        i += run;
+    }
+}
+
+TankSpan Plugin::GetTankSpan(int line, int sample) const
+{
+    switch (line)
+    {
+        case TANK_LINE_DELAY_1:
+            return GetDelaySpan(m_reverbDelay1, sample);
+        case TANK_LINE_DIFFUSE_3:
+            return GetDelaySpan(m_reverbDiffuse3, sample);
+        case TANK_LINE_DELAY_3:
+            return GetDelaySpan(m_reverbDelay3, sample);
+        case TANK_LINE_DELAY_2:
+            return GetDelaySpan(m_reverbDelay2, sample);
+        case TANK_LINE_DIFFUSE_4:
+            return GetDelaySpan(m_reverbDiffuse4, sample);
+        case TANK_LINE_DELAY_4:
+        default:
+            return GetDelaySpan(m_reverbDelay4, sample);
+    }
+}
+
+void Plugin::Read(float *inbuffer, float *outbuffer, unsigned int length, int channels)
+{
+    if (m_bus)
+    {
+        ReadSend(inbuffer, outbuffer, length, channels);
+        return;
+    }
+    
+    // Auto quality times the whole read against the block's real time
+    const bool timed = m_quality == REVERB_QUALITY_AUTO;
+    const unsigned int blockLength = length;
+    std::chrono::steady_clock::time_point start;
+    if (timed)
+    {
+        start = std::chrono::steady_clock::now();
+    }
+    
+    // The predelay has no feedback, so it can run a pass at a time as long as a pass is no longer than its delay.
+    // Every other stage runs a pass at a time too, which is safe while a pass is no longer than the shortest loop
+    // A shared tank sums the input to mono before the predelay, so the predelay is a single channel too
+    const int tankChannels = m_tankShared ? 1 : channels;
+    const float downmix = 0.5f / channels;
+    const bool network = m_tankAlgorithm != REVERB_ALGORITHM_PLATE;
+    
+    float predelayed[DELAY_UNIT_BLOCK_SAMPLES];
+    float predelayInput[DELAY_UNIT_BLOCK_SAMPLES];
+    
+    // Even a shared tank writes every output channel of a pass at once, so the pass is short enough for all of them
+    unsigned int maxPass = std::max(1, std::min((int)m_predelay->GetDelayTimeInSamples(), DELAY_UNIT_BLOCK_SAMPLES / channels));
+    
+    // The shortest loop scales with the room, and while the size fades it is read in both rooms. A fade only ever
+    // finishes during a read, so this holds for the whole block
+    const int shortestLoop = std::min(RoomSizeTap(REVERB_SUB_BLOCK, m_sizeFrom), RoomSizeTap(REVERB_SUB_BLOCK, m_sizeTo));
+    maxPass = std::min(maxPass, (unsigned int)shortestLoop);
+    
+    // At half rate the shortest loop is half as long, and a pass can start on a kept frame
+    if (m_tankHalfRate)
+    {
+        maxPass = std::min(maxPass, (unsigned int)(shortestLoop / 2) * 2);
+    }
+    
+    // The tank runs either one channel at a time, or every channel at once with the samples interleaved
+    const int width = m_inputZ->GetRunWidth();
+    const int runs = tankChannels / width;
+    
+    float inputBlock[DELAY_UNIT_BLOCK_SAMPLES];
+    float diffused[DELAY_UNIT_BLOCK_SAMPLES];
+    float outputBlock[DELAY_UNIT_BLOCK_SAMPLES];
+    
+    // Early reflections come off the predelay, so there are none while frozen either
+    const float earlyGain = m_frozen ? 0.0f : m_earlyLevel * m_wet;
+    float early[DELAY_UNIT_BLOCK_SAMPLES];
+    
+    // Frozen, the tank is fed silence. Nothing writes the diffused input then, so it is only cleared once
+    if (m_frozen)
+    {
+        memset(diffused, 0, sizeof(diffused));
+    }
+    
+    while (length)
+    {
+        int pass = (int)std::min(length, maxPass);
+        
+        // At half rate the diffusers and tank only run on every other frame of the pass
+        int tankPass = m_tankHalfRate ? m_decimator->GetHalfFrames(pass) : pass;
+        
+        // Every tap crossfades at the same rate in time, so each half rate frame goes twice as far
+        m_passFade.start = m_sizeFade;
+        m_passFade.step = m_tankHalfRate ? m_sizeFadeStep * 2 : m_sizeFadeStep;
+        
+        if (network)
+        {
+            m_network->SetScale(m_sizeFrom, m_sizeTo);
+            m_network->SetDecay(m_frozen ? 1.0f : m_decay);
+        }
+        
+        // Frozen, nothing in front of the tank runs
+        if (!m_frozen)
+        {
+            m_predelay->ReadBlock(predelayed, pass);
+            if (earlyGain > 0.0f)
+            {
+                ReadEarly(early, pass, channels, earlyGain);
+            }
+            
+            if (m_tankShared)
+            {
+                for (int i = 0; i < pass; i++)
+                {
+                    float sum = 0;
+                    for (int c = 0; c < channels; c++)
+                    {
+                        sum += inbuffer[i * channels + c];
+                    }
+                    predelayInput[i] = sum * downmix;   // Half the average of the channels
+                }
+            }
+            else
+            {
+                for (int k = 0; k < pass * channels; k++)
+                {
+                    predelayInput[k] = inbuffer[k] * 0.5f;  // Half whatever goes into the predelay
+                }
+            }
+            m_predelay->WriteBlock(predelayInput, pass);
+        }
+        
+        if (m_tankShared && network)
+        {
+            if (!m_frozen)
+            {
+                for (int i = 0; i < pass; i++)
+                {
+                    inputBlock[i] = predelayed[i] * m_bandwidth;
+                }
+                RunInput(0, pass, inputBlock, diffused);
+            }
+            
+            // Each output channel is its own row of the matrix over the one network's lines
+            m_network->Process(0, diffused, outputBlock, tankPass, channels, m_passFade.start, m_passFade.step);
+            if (m_tankHalfRate)
+            {
+                m_interpolator->Interpolate(0, outputBlock, outputBlock, pass);
+            }
+            
+            for (int k = 0; k < pass * channels; k++)
+            {
+                outbuffer[k] = (inbuffer[k] * m_dry) + (outputBlock[k] * m_wet);
+            }
+        }
+        else if (m_tankShared)
+        {
+            // Multiply bandwidth before the filter
+            if (!m_frozen)
+            {
+                for (int i = 0; i < pass; i++)
+                {
+                    inputBlock[i] = predelayed[i] * m_bandwidth;
+                }
+                RunInput(0, pass, inputBlock, diffused);
+            }
+            
+            RunTank(0, tankPass, diffused, outputBlock);
+            
+            // Every output channel sums its own taps of the tank. Pairs take the plate's left and right taps,
+            // and each further pair moves its taps along the lines so no two channels are the same. The taps are
+            // placed in the reference room and move with the lines as the room changes size
+            for (int n = 0; n < channels; n++)
+            {
+                const TankTap* taps = (n & 1) ? s_rightTankTaps : s_leftTankTaps;
+                int pair = n / 2;
+                bool fading = false;
+                
+                TankSpan spans[REVERB_TANK_TAPS];
+                TankSpan toSpans[REVERB_TANK_TAPS];
+                float gains[REVERB_TANK_TAPS];
+                for (int t = 0; t < REVERB_TANK_TAPS; t++)
+                {
+                    int span = GetTankLineLength(taps[t].line) - REVERB_SUB_BLOCK;
+                    int sample = REVERB_SUB_BLOCK + (taps[t].sample - REVERB_SUB_BLOCK + pair * (int)(span * REVERB_TANK_TAP_SPREAD)) % span;
+                    FadedTap tap = GetTap(sample);
+                    
+                    spans[t] = GetTankSpan(taps[t].line, tap.from);
+                    toSpans[t] = GetTankSpan(taps[t].line, tap.to);
+                    gains[t] = taps[t].gain * REVERB_TANK_TAP_GAIN * m_wet;
+                    fading = fading || (tap.to != tap.from);
+                }
+                
+                SumTankTaps(spans, gains, tankPass, outputBlock + n, channels);
+                
+                // While the room changes size the taps in the new room are summed too, and crossfaded in
+                if (fading)
+                {
+                    float to[DELAY_UNIT_BLOCK_SAMPLES];
+                    SumTankTaps(toSpans, gains, tankPass, to, 1);
+                    
+                    for (int i = 0; i < tankPass; i++)
+                    {
+                        const float mix = std::min(m_passFade.start + (m_passFade.step * i), 1.0f);
+                        float& sample = outputBlock[i * channels + n];
+                        sample += (to[i] - sample) * mix;
+                    }
+                }
+            }
+            
+            if (m_tankHalfRate)
+            {
+                m_interpolator->Interpolate(0, outputBlock, outputBlock, pass);
+            }
+            
+            for (int k = 0; k < pass * channels; k++)
+            {
+                outbuffer[k] = (inbuffer[k] * m_dry) + outputBlock[k];
+            }
+        }
+        else
+        {
+            for (int n = 0; n < runs; n++)
+            {
+                // Predelay, multiplying bandwidth before the filter
+                if (!m_frozen)
+                {
+                    for (int i = 0; i < pass; i++)
+                    {
+                        for (int c = 0; c < width; c++)
+                        {
+                            inputBlock[i * width + c] = predelayed[i * channels + n + c] * m_bandwidth;
+                        }
+                    }
+                    RunInput(n, pass, inputBlock, diffused);
+                }
+                
+                if (network)
+                {
+                    m_network->Process(n, diffused, outputBlock, tankPass, 1, m_passFade.start, m_passFade.step);
+                }
+                else
+                {
+                    RunTank(n, tankPass, diffused, outputBlock);
+                }
+                
+                if (m_tankHalfRate)
+                {
+                    m_interpolator->Interpolate(n, outputBlock, outputBlock, pass);
+                }
+                
+                for (int i = 0; i < pass; i++)
+                {
+                    for (int c = 0; c < width; c++)
+                    {
+                        int k = i * channels + n + c;
+                        outbuffer[k] = (inbuffer[k] * m_dry) + (outputBlock[i * width + c] * m_wet);
+                    }
+                }
+            }
+        }
+        
+        if (earlyGain > 0.0f)
+        {
+            for (int k = 0; k < pass * channels; k++)
+            {
+                outbuffer[k] += early[k];
+            }
+        }
+        
+        AdvanceTank(pass, tankPass);
+        AdvanceSize(pass);
+        
+        inbuffer += pass * channels;
+        outbuffer += pass * channels;
+        length -= pass;
+    }
+        
+        //m_delay->Read(inbuffer, outbuffer, length, channels);
+        //m_cutoff->Read(outbuffer, outbuffer, length, channels);
     
-};
+    if (timed)
+    {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        UpdateQuality(elapsed.count(), blockLength);
+    }
+}
 
-void Plugin::Init(FMOD_DSP_STATE* dsp_state)
+void Plugin::SetTier(int tier)
 {
-    m_bandwidth = 0.5;
-    
-    delete m_predelay;
-    delete m_inputZ;
-    delete m_diffuseDelay11;
-    delete m_diffuseDelay12;
-    delete m_diffuseDelay21;
-    delete m_diffuseDelay22;
-    
-    delete m_reverbDiffuse1;
-    delete m_reverbDiffuse2;
-    delete m_reverbDelay1;
-    delete m_reverbDelay2;
-    delete m_reverbFilter1;
-    delete m_reverbFilter2;
-    delete m_reverbDiffuse3;
-    delete m_reverbDiffuse4;
-    delete m_reverbDelay3;
-    delete m_reverbDelay4;
-    
-    m_predelay = new DelayUnit();
-    m_inputZ = new DelayUnit();
-    m_diffuseDelay11 = new DelayUnit();
-    m_diffuseDelay12 = new DelayUnit();
-    m_diffuseDelay21 = new DelayUnit();
-    m_diffuseDelay22 = new DelayUnit();
-    
-    m_reverbDiffuse1 = new DelayUnit();
-    m_reverbDiffuse2 = new DelayUnit();
-    m_reverbDelay1 = new DelayUnit();
-    m_reverbDelay2 = new DelayUnit();
-    m_reverbFilter1 = new DelayUnit();
-    m_reverbFilter2 = new DelayUnit();
-    m_reverbDiffuse3 = new DelayUnit();
-    m_reverbDiffuse4 = new DelayUnit();
-    m_reverbDelay3 = new DelayUnit();
-    m_reverbDelay4 = new DelayUnit();
-    
-    // Predelay
-    m_predelay->Init(dsp_state, 20.0f);
-    m_predelay->SetDelayTime(10.0f);
-    m_predelay->SetFeedback(0.0f);
-    
-    // Input filter
-    m_inputZ->Init(dsp_state, 1);
-    m_inputZ->SetFeedback(0.0f);
-    
-    // 4 diffuse delays
-    m_diffuseDelay11->Init(dsp_state, 143);
-    m_diffuseDelay11->SetFeedback(0);
-    
-    m_diffuseDelay12->Init(dsp_state, 108);
-    m_diffuseDelay12->SetFeedback(0);
-    
-    m_diffuseDelay21->Init(dsp_state, 380);
-    m_diffuseDelay21->SetFeedback(0);
-    
-    m_diffuseDelay22->Init(dsp_state, 278);
-    m_diffuseDelay22->SetFeedback(0);
-    
-    // Reverb diffuse
-    
-    m_reverbDiffuse1->Init(dsp_state, 673);
-    m_reverbDiffuse1->SetFeedback(0.0f);
-    
-    m_reverbDiffuse2->Init(dsp_state, 909);
-    m_reverbDiffuse2->SetFeedback(0.0f);
-    
-    // Reverb delays
-    
-    m_reverbDelay1->Init(dsp_state, 909);
-    m_reverbDelay1->SetFeedback(0.0f);
-    
-    m_reverbDelay2->Init(dsp_state, 4454);
-    m_reverbDelay2->SetFeedback(0.0f);
-    
-    // Reverb filters
-    
-    m_reverbFilter1->Init(dsp_state, 1);
-    m_reverbFilter1->SetFeedback(0.0f);
+    // Diffusers that were skipped still hold whatever was in them when they stopped
+    if (tier < REVERB_QUALITY_MINIMAL && m_tier >= REVERB_QUALITY_MINIMAL)
+    {
+        m_diffuseDelay11->Clear();
+        m_diffuseDelay12->Clear();
+    }
+    if (tier == REVERB_QUALITY_FULL && m_tier != REVERB_QUALITY_FULL)
+    {
+        m_diffuseDelay21->Clear();
+        m_diffuseDelay22->Clear();
+    }
+    m_tier = tier;
     
-    m_reverbFilter2->Init(dsp_state, 1);
-    m_reverbFilter2->SetFeedback(0.0f);
+    // Only the last step changes rate, which has to empty the tank, so Auto keeps the tail through the others
+    SetTankRate(tier == REVERB_QUALITY_HALF_RATE);
+    UpdateTailHold();
+}
+
+/// Wrap a plate line at its length in the largest room at the tank's rate
+template <typename Delay>
+static void SetDelayRate(Delay* delay, bool halfRate)
+{
+    int length = delay->GetMaxDelayTimeInSamples();
+    delay->SetWrap(halfRate ? (length + 1) / 2 : length);
+}
+
+void Plugin::SetTankRate(bool halfRate)
+{
+    if (m_tankHalfRate == halfRate)
+    {
+        return;
+    }
+    m_tankHalfRate = halfRate;
     
-    // Reverb diffuse 2
+    // Half rate lines wrap inside the start of their memory, so they touch half as much of it
+    SetDelayRate(m_reverbDiffuse1, halfRate);
+    SetDelayRate(m_reverbDelay1, halfRate);
+    SetDelayRate(m_reverbFilter1, halfRate);
+    SetDelayRate(m_reverbDiffuse3, halfRate);
+    SetDelayRate(m_reverbDelay3, halfRate);
+    SetDelayRate(m_reverbDiffuse2, halfRate);
+    SetDelayRate(m_reverbDelay2, halfRate);
+    SetDelayRate(m_reverbFilter2, halfRate);
+    SetDelayRate(m_reverbDiffuse4, halfRate);
+    SetDelayRate(m_reverbDelay4, halfRate);
+    m_network->SetHalfRate(halfRate);
     
-    m_reverbDiffuse3->Init(dsp_state, 1801);
-    m_reverbDiffuse3->SetFeedback(0.0f);
+    // What the diffusers and tank hold was written at the other rate, so it would play back at the wrong pitch
+    ClearTank();
+}
+
+void Plugin::UpdateTailHold()
+{
+    // A tail is gone once a full trip through every line in use has come out below the floor. Each line counts at
+    // its length in the room, the larger of the two while the size fades. Half rate lines last as long in time
+    const float size = std::max(m_sizeFrom, m_sizeTo);
     
-    m_reverbDiffuse4->Init(dsp_state, 2657);
-    m_reverbDiffuse4->SetFeedback(0.0f);
+    // The predelay is read as far back as the latest early reflection
+    int predelaySamples = (int)m_predelay->GetDelayTimeInSamples();
+    const EarlyTaps& early = m_early->GetTaps();
+    for (int side = 0; side < 2; side++)
+    {
+        for (int t = 0; t < early.count; t++)
+        {
+            predelaySamples = std::max(predelaySamples, early.sample[side][t]);
+        }
+    }
     
-    // Reverb delays 2
+    int diffuseSamples = 0;
+    if (m_tier < REVERB_QUALITY_MINIMAL)
+    {
+        diffuseSamples += RoomSizeTap(m_diffuseDelay11->GetLength(), size) + RoomSizeTap(m_diffuseDelay12->GetLength(), size);
+    }
+    if (m_tier == REVERB_QUALITY_FULL)
+    {
+        diffuseSamples += RoomSizeTap(m_diffuseDelay21->GetLength(), size) + RoomSizeTap(m_diffuseDelay22->GetLength(), size);
+    }
     
-    m_reverbDelay3->Init(dsp_state, 3721);
-    m_reverbDelay3->SetFeedback(0.0f);
+    int tankSamples;
+    if (m_tankAlgorithm == REVERB_ALGORITHM_PLATE)
+    {
+        tankSamples = RoomSizeTap(m_reverbDiffuse1->GetLength(), size) + RoomSizeTap(m_reverbDelay1->GetLength(), size)
+            + m_reverbFilter1->GetLength() + RoomSizeTap(m_reverbDiffuse3->GetLength(), size)
+            + RoomSizeTap(m_reverbDelay3->GetLength(), size) + RoomSizeTap(m_reverbDiffuse2->GetLength(), size)
+            + RoomSizeTap(m_reverbDelay2->GetLength(), size) + m_reverbFilter2->GetLength()
+            + RoomSizeTap(m_reverbDiffuse4->GetLength(), size) + RoomSizeTap(m_reverbDelay4->GetLength(), size);
+    }
+    else
+    {
+        tankSamples = FeedbackDelayNetwork::GetTotalLength(m_network->GetLines(), size);
+    }
     
-    m_reverbDelay4->Init(dsp_state, 3164);
-    m_reverbDelay4->SetFeedback(0.0f);
+    const bool silent = IsTailSilent();
+    m_tailHoldSamples = predelaySamples + m_inputZ->GetLength() + diffuseSamples + tankSamples
+        + (m_tankHalfRate ? HalfBandFilter::GetLatency() : 0);
+    if (silent)
+    {
+        m_silentSamples = m_tailHoldSamples;
+    }
 }
 
-void Plugin::Release()
+void Plugin::ClearTank()
 {
-    delete m_predelay;
-    delete m_inputZ;
-    delete m_diffuseDelay11;
-    delete m_diffuseDelay12;
-    delete m_diffuseDelay21;
-    delete m_diffuseDelay22;
+    // Only the running tank is laid out, and the other shares its memory
+    m_diffuseDelay11->Clear();
+    m_diffuseDelay12->Clear();
+    m_diffuseDelay21->Clear();
+    m_diffuseDelay22->Clear();
     
-    delete m_reverbDiffuse1;
-    delete m_reverbDiffuse2;
-    delete m_reverbDelay1;
-    delete m_reverbDelay2;
-    delete m_reverbFilter1;
-    delete m_reverbFilter2;
-    delete m_reverbDiffuse3;
-    delete m_reverbDiffuse4;
-    delete m_reverbDelay3;
-    delete m_reverbDelay4;
-}
-
-void Plugin::Reset(FMOD_DSP_STATE* dsp_state)
-{
-
+    if (m_tankAlgorithm == REVERB_ALGORITHM_PLATE)
+    {
+        m_reverbDiffuse1->Clear();
+        m_reverbDelay1->Clear();
+        m_reverbFilter1->Clear();
+        m_reverbDiffuse3->Clear();
+        m_reverbDelay3->Clear();
+        m_reverbDiffuse2->Clear();
+        m_reverbDelay2->Clear();
+        m_reverbFilter2->Clear();
+        m_reverbDiffuse4->Clear();
+        m_reverbDelay4->Clear();
+    }
+    else
+    {
+        m_network->Clear();
+    }
+    
+    m_decimator->Clear();
+    m_interpolator->Clear();
 }
 
-void Plugin::Query(FMOD_DSP_STATE* dsp_state, int channels)
+void Plugin::UpdateQuality(double seconds, unsigned int length)
 {
-
-    m_predelay->CreateBuffers(channels);
-    m_inputZ->CreateBuffers(channels);
-    m_diffuseDelay11->CreateBuffers(channels);
-    m_diffuseDelay12->CreateBuffers(channels);
-    m_diffuseDelay21->CreateBuffers(channels);
-    m_diffuseDelay22->CreateBuffers(channels);
+    if (!length)
+    {
+        return;
+    }
     
-    m_reverbDiffuse1->CreateBuffers(channels);
-    m_reverbDiffuse2->CreateBuffers(channels);
-    m_reverbDiffuse3->CreateBuffers(channels);
-    m_reverbDiffuse4->CreateBuffers(channels);
+    // Share of the block's real time the read took, averaged over the last few blocks
+    float usage = (float)(seconds * m_sampleRate / length);
+    m_cpuUsage += (usage - m_cpuUsage) * REVERB_QUALITY_SMOOTHING;
     
-    m_reverbDelay1->CreateBuffers(channels);
-    m_reverbDelay2->CreateBuffers(channels);
-    m_reverbDelay3->CreateBuffers(channels);
-    m_reverbDelay4->CreateBuffers(channels);
+    const float budget = m_cpuBudget / 100.0f;
+    const int settleSamples = (int)MS_TO_SAMPLES(REVERB_QUALITY_SETTLE_MS, m_sampleRate);
+    const int riseSamples = (int)MS_TO_SAMPLES(REVERB_QUALITY_RISE_MS, m_sampleRate);
     
-    m_reverbFilter1->CreateBuffers(channels);
-    m_reverbFilter2->CreateBuffers(channels);
-        
+    m_stepSamples = std::min(m_stepSamples + (int)length, riseSamples);
+    m_riseSamples = (m_cpuUsage < budget * REVERB_QUALITY_RISE_FRACTION) ? std::min(m_riseSamples + (int)length, riseSamples) : 0;
     
+    // Over budget steps down as soon as the average has settled from the last step. Stepping up waits until there
+    // has been plenty of room for a while, so a quality that only just fits is not tried again every block
+    if (m_cpuUsage > budget && m_tier < REVERB_QUALITY_HALF_RATE && m_stepSamples >= settleSamples)
+    {
+        SetTier(m_tier + 1);
+        m_stepSamples = 0;
+        m_riseSamples = 0;
+    }
+    else if (m_tier > REVERB_QUALITY_FULL && m_riseSamples >= riseSamples)
+    {
+        SetTier(m_tier - 1);
+        m_stepSamples = 0;
+        m_riseSamples = 0;
+    }
 }
 
-void Plugin::Read(float *inbuffer, float *outbuffer, unsigned int length, int channels)
+void Plugin::UpdateTail(const float* outbuffer, unsigned int length, int channels, bool inputsidle)
 {
-
-    float in(0), out(0), delayedIn(0), reverbSample(0);
+    // A send's own output is only its dry input, so nothing of it rings on once the input stops. Until then it keeps
+    // the bus's tank fed, and the send returning the bus keeps going while the bus does, or the bus's tail would stop
+    // with it
+    if (m_bus)
+    {
+        m_bus->sent = m_bus->sent || !inputsidle;
+        bool returning = m_bus->returner == this && !m_bus->tank->IsTailSilent();
+        m_silentSamples = (!inputsidle || returning) ? 0 : m_tailHoldSamples;
+        return;
+    }
     
+    // While there is input the tail is still being fed, so only idle input is worth measuring
+    if (!inputsidle)
+    {
+        m_silentSamples = 0;
+        return;
+    }
     
-    for (int i = 0; i < length; i++)
+    // With silent input the output is only the tail
+    float peak = 0.0f;
+    for (unsigned int k = 0; k < length * channels; k++)
     {
-        for (int n = 0; n < channels; n++)
-        {
-            in = *inbuffer;
-            out = *outbuffer;
-            
-            // Predelay
-            delayedIn = m_predelay->GetDelayedSample() * m_bandwidth;   // Multiply bandwidth before filter
-            m_predelay->WriteDelay(in * 0.5f);  // Half whatever goes into the predelay
-            m_predelay->TickChannel();
-            
-            // Filter predelay before diffusion
-            float outZ = (m_inputZ->GetDelayedSampleAt(1) * (1 - m_bandwidth)) + delayedIn;
-            m_inputZ->WriteDelay(outZ);
-            m_inputZ->TickChannel();
-            
-            // DIFFUSION
-            
-            // 1
-            float outDiffuse1 = m_diffuseDelay11->GetDelayedSampleAt(142);
-            float diffuse1Top = (-outDiffuse1 * m_inputDiffuse1) + outZ;
-            float diffuse1Bottom = outDiffuse1 + (diffuse1Top * m_inputDiffuse1);
-            m_diffuseDelay11->WriteDelay(diffuse1Top);
-            m_diffuseDelay11->TickChannel();
-            
-            // 2
-            float outDiffuse2 = m_diffuseDelay12->GetDelayedSampleAt(107);
-            float diffuse2Top = (-outDiffuse2 * m_inputDiffuse1) + diffuse1Bottom;
-            float diffuse2Bottom = outDiffuse2 + (diffuse2Top * m_inputDiffuse1);
-            m_diffuseDelay12->WriteDelay(diffuse2Top);
-            m_diffuseDelay12->TickChannel();
-            
-            // 3
-            float outDiffuse3 = m_diffuseDelay21->GetDelayedSampleAt(379);
-            float diffuse3Top = (-outDiffuse3 * m_inputDiffuse2) + diffuse2Bottom;
-            float diffuse3Bottom = outDiffuse3 + (diffuse3Top * m_inputDiffuse2);
-            m_diffuseDelay21->WriteDelay(diffuse3Top);
-            m_diffuseDelay21->TickChannel();
-            
-            // 4
-            float outDiffuse4 = m_diffuseDelay22->GetDelayedSampleAt(277);
-            float diffuse4Top = (-outDiffuse4 * m_inputDiffuse2) + diffuse3Bottom;
-            float diffuse4Bottom = outDiffuse4 + (diffuse4Top * m_inputDiffuse2);
-            m_diffuseDelay22->WriteDelay(diffuse4Top);
-            m_diffuseDelay22->TickChannel();
-            
-            // REVERB
-            
-            reverbSample = diffuse4Bottom + (m_reverbDelay4->GetDelayedSampleAt(3163) * m_decay);
-            
-            // diffuse 1
-            float reverbDiffuse1 = m_reverbDiffuse1->GetDelayedSampleAt(672);
-            float reverb1Top = (reverbDiffuse1 * m_decayDiffuse1) + reverbSample;
-            float reverb1Bottom = (-reverb1Top * m_decayDiffuse1) + reverbDiffuse1;
-            m_reverbDiffuse1->WriteDelay(reverb1Top);
-            m_reverbDiffuse1->TickChannel();
-            
-            // reverb delay 1
-            float reverbDelay1 = m_reverbDelay1->GetDelayedSampleAt(4453) * (1 - m_damping);
-            m_reverbDelay1->WriteDelay(reverb1Bottom);
-            m_reverbDelay1->TickChannel();
-            
-            // reverb filter 1
-            float outZ1 = ((m_reverbFilter1->GetDelayedSampleAt(1) * m_damping) + reverbDelay1) * m_decay;
-            
-            // diffuse 3 (second diffuse on left side)
-            float reverbDiffuse3 = m_reverbDiffuse3->GetDelayedSampleAt(1800);
-            float reverb3Top = (-reverbDiffuse3 * m_decayDiffuse2) + outZ1;
-            float reverb3Bottom = reverbDiffuse3 + (reverb3Top * m_decayDiffuse2);
-            m_reverbDiffuse3->WriteDelay(reverb3Top);
-            m_reverbDiffuse3->TickChannel();
-            
-            // reverb delay 3
-            float reverbDelay3 = m_reverbDelay3->GetDelayedSampleAt(3720);
-            m_reverbDelay3->WriteDelay(reverb3Bottom);
-            m_reverbDelay3->TickChannel();
-            
-            // OTHER SIDE
-            
-            // diffuse 2
-            reverbSample = (reverbDelay3 * m_decay) + diffuse4Bottom;
-            
-            float reverbDiffuse2 = m_reverbDiffuse1->GetDelayedSampleAt(908);
-            float reverb2Top = (reverbDiffuse2 * m_decayDiffuse1) + reverbSample;
-            float reverb2Bottom = (-reverb2Top * m_decayDiffuse1) + reverbDiffuse2;
-            m_reverbDiffuse2->WriteDelay(reverb2Top);
-            m_reverbDiffuse2->TickChannel();
-            
-            // reverb delay 2
-            float reverbDelay2 = m_reverbDelay2->GetDelayedSampleAt(4217) * (1 - m_damping);
-            m_reverbDelay2->WriteDelay(reverb2Bottom);
-            m_reverbDelay2->TickChannel();
-            
-            // filter 2
-            float outZ2 = ((m_reverbFilter2->GetDelayedSampleAt(1) * m_damping) + reverbDelay2) * m_decay;
-            
-            // diffuse 4
-            float reverbDiffuse4 = m_reverbDiffuse4->GetDelayedSampleAt(2656);
-            float reverb4Top = (-reverbDiffuse4 * m_decayDiffuse2) + outZ2;
-            float reverb4Bottom = reverbDiffuse4 + (reverb4Top * m_decayDiffuse2);
-            m_reverbDiffuse4->WriteDelay(reverb4Top);
-            m_reverbDiffuse4->TickChannel();
-            
-            // reverb delay 4
-            m_reverbDelay4->WriteDelay(reverb4Bottom);
-            m_reverbDelay4->TickChannel();
-            
-            *outbuffer = (in * m_dry) + (reverb4Bottom * m_wet);
-            
-            inbuffer++;
-            outbuffer++;
-        }
+        peak = std::max(peak, fabsf(outbuffer[k]));
     }
-        
-        //m_delay->Read(inbuffer, outbuffer, length, channels);
-        //m_cutoff->Read(outbuffer, outbuffer, length, channels);
-
+    
+    m_silentSamples = (peak >= powf(10.0f, m_idleFloor / 20.0f)) ? 0 : std::min(m_silentSamples + (int)length, m_tailHoldSamples);
 }
 
 void Plugin::SetParameterFloat(int index, float value)
@@ -540,6 +1917,23 @@ void Plugin::SetParameterFloat(int index, float value)
             m_wet = DECIBELS_TO_LINEAR(value);
             break;
             
+        case PARAM_IDLE_FLOOR:
+            m_idleFloor = value;
+            break;
+            
+        case PARAM_CPU_BUDGET:
+            m_cpuBudget = value;
+            break;
+            
+        case PARAM_ROOM_SIZE:
+            m_roomSize = value;
+            m_early->SetRoomSize(value);
+            break;
+            
+        case PARAM_EARLY_LEVEL:
+            m_earlyLevel = DECIBELS_TO_LINEAR(value);
+            break;
+            
         default:
             break;
     }
@@ -580,12 +1974,100 @@ void Plugin::GetParameterFloat(int index, float *value)
             *value = LINEAR_TO_DECIBELS(m_wet);
             break;
             
+        case PARAM_IDLE_FLOOR:
+            *value = m_idleFloor;
+            break;
+            
+        case PARAM_CPU_BUDGET:
+            *value = m_cpuBudget;
+            break;
+            
+        case PARAM_ROOM_SIZE:
+            *value = m_roomSize;
+            break;
+            
+        case PARAM_EARLY_LEVEL:
+            *value = LINEAR_TO_DECIBELS(m_earlyLevel);
+            break;
+            
+        default:
+            break;
+    }
+}
+
+
+
+void Plugin::SetParameterBool(int index, bool value)
+{
+    switch (index) {
+        case PARAM_SHARED_TANK:
+            m_sharedTank = value;
+            break;
+            
+        case PARAM_FREEZE:
+            m_freeze = value;
+            break;
+            
+        default:
+            break;
+    }
+}
+
+void Plugin::GetParameterBool(int index, bool* value)
+{
+    switch (index) {
+        case PARAM_SHARED_TANK:
+            *value = m_sharedTank;
+            break;
+            
+        case PARAM_FREEZE:
+            *value = m_freeze;
+            break;
+            
         default:
             break;
     }
 }
 
+void Plugin::SetParameterInt(int index, int value)
+{
+    switch (index) {
+        case PARAM_SHARED_BUS:
+            m_sharedBus = value;
+            break;
+            
+        case PARAM_ALGORITHM:
+            m_algorithm = std::max(0, std::min(value, NUM_REVERB_ALGORITHMS - 1));
+            break;
+            
+        case PARAM_QUALITY:
+            m_quality = std::max(0, std::min(value, NUM_REVERB_QUALITIES - 1));
+            break;
+            
+        default:
+            break;
+    }
+}
 
+void Plugin::GetParameterInt(int index, int* value)
+{
+    switch (index) {
+        case PARAM_SHARED_BUS:
+            *value = m_sharedBus;
+            break;
+            
+        case PARAM_ALGORITHM:
+            *value = m_algorithm;
+            break;
+            
+        case PARAM_QUALITY:
+            *value = m_quality;
+            break;
+            
+        default:
+            break;
+    }
+}
 
 // ======================= //
 // CALLBACK IMPLEMENTATION //
@@ -594,21 +2076,33 @@ void Plugin::GetParameterFloat(int index, float *value)
 FMOD_RESULT Create_Callback                     (FMOD_DSP_STATE *dsp_state)
 {
     // create our plugin class and attach to fmod
-    Plugin* state = (Plugin* )FMOD_DSP_ALLOC(dsp_state, sizeof(Plugin));
-    state->Init(dsp_state);
-    dsp_state->plugindata = state;
-    if (!dsp_state->plugindata)
+    void* memory = FMOD_DSP_ALLOC(dsp_state, sizeof(Plugin));
+    if (!memory)
     {
         return FMOD_ERR_MEMORY;
     }
-    return FMOD_OK;
+    
+    // FMOD's memory is not zeroed, so the class is constructed in place to null everything it owns
+    Plugin* state = new (memory) Plugin();
+    dsp_state->plugindata = state;
+    
+    FMOD_RESULT result = state->Init(dsp_state);
+    if (result != FMOD_OK)
+    {
+        state->Release(dsp_state);
+        state->~Plugin();
+        FMOD_DSP_FREE(dsp_state, state);
+        dsp_state->plugindata = nullptr;
+    }
+    return result;
 }
 
 FMOD_RESULT Release_Callback                    (FMOD_DSP_STATE *dsp_state)
 {
     // release our plugin class
     Plugin* state = (Plugin* )dsp_state->plugindata;
-    state->Release();
+    state->Release(dsp_state);
+    state->~Plugin();
     FMOD_DSP_FREE(dsp_state, state);
     
     return FMOD_OK;
@@ -637,20 +2131,21 @@ FMOD_RESULT Process_Callback                    (FMOD_DSP_STATE *dsp_state, unsi
                 
             }
             
-            if (inputsidle)
+            // Silent input still has to run until the tail has died away
+            if (inputsidle && state->IsTailSilent())
             {
                 return FMOD_ERR_DSP_DONTPROCESS;
             }
-            state->Query(dsp_state, outbufferarray[0].buffernumchannels[0]);
-            
-            break;
+            return state->Query(dsp_state, outbufferarray[0].buffernumchannels[0]);
             
         case FMOD_DSP_PROCESS_PERFORM:
-            
+        {
+            DenormalGuard guard;
             state->Read(inbufferarray[0].buffers[0], outbufferarray[0].buffers[0], length, outbufferarray[0].buffernumchannels[0]);
+            state->UpdateTail(outbufferarray[0].buffers[0], length, outbufferarray[0].buffernumchannels[0], inputsidle);
             
             return FMOD_OK;
-            break;
+        }
     }
     
     return FMOD_OK;
@@ -663,7 +2158,9 @@ FMOD_RESULT SetPosition_Callback                (FMOD_DSP_STATE *dsp_state, unsi
 
 FMOD_RESULT ShouldIProcess_Callback             (FMOD_DSP_STATE *dsp_state, FMOD_BOOL inputsidle, unsigned int length, FMOD_CHANNELMASK inmask, int inchannels, FMOD_SPEAKERMODE speakermode)
 {
-    if (inputsidle)
+    Plugin* state = (Plugin* )dsp_state->plugindata;
+    
+    if (inputsidle && state->IsTailSilent())
     {
         return FMOD_ERR_DSP_DONTPROCESS;
     }
@@ -679,11 +2176,15 @@ FMOD_RESULT SetFloat_Callback                   (FMOD_DSP_STATE *dsp_state, int
 
 FMOD_RESULT SetInt_Callback                     (FMOD_DSP_STATE *dsp_state, int index, int value)
 {
+    Plugin* state = (Plugin* )dsp_state->plugindata;
+    state->SetParameterInt(index, value);
     return FMOD_OK;
 }
 
 FMOD_RESULT SetBool_Callback                    (FMOD_DSP_STATE *dsp_state, int index, FMOD_BOOL value)
 {
+    Plugin* state = (Plugin* )dsp_state->plugindata;
+    state->SetParameterBool(index, value != 0);
     return FMOD_OK;
 }
 
@@ -701,11 +2202,17 @@ FMOD_RESULT GetFloat_Callback                   (FMOD_DSP_STATE *dsp_state, int
 
 FMOD_RESULT GetInt_Callback                     (FMOD_DSP_STATE *dsp_state, int index, int *value, char *valuestr)
 {
+    Plugin* state = (Plugin* )dsp_state->plugindata;
+    state->GetParameterInt(index, value);
     return FMOD_OK;
 }
 
 FMOD_RESULT GetBool_Callback                    (FMOD_DSP_STATE *dsp_state, int index, FMOD_BOOL *value, char *valuestr)
 {
+    Plugin* state = (Plugin* )dsp_state->plugindata;
+    bool result = false;
+    state->GetParameterBool(index, &result);
+    *value = result;
     return FMOD_OK;
 }
 
@@ -716,15 +2223,116 @@ FMOD_RESULT GetData_Callback                    (FMOD_DSP_STATE *dsp_state, int
 
 FMOD_RESULT SystemRegister_Callback             (FMOD_DSP_STATE *dsp_state)
 {
+    int systemobject = dsp_state->systemobject;
+    if (systemobject < 0 || systemobject >= REVERB_MAX_SYSTEMS || s_reverbSystems[systemobject])
+    {
+        return FMOD_OK;     // no shared buses, every instance runs its own tank
+    }
+    
+    ReverbSystem* system = (ReverbSystem* )FMOD_DSP_ALLOC(dsp_state, sizeof(ReverbSystem));
+    if (!system)
+    {
+        return FMOD_ERR_MEMORY;
+    }
+    memset(system, 0, sizeof(ReverbSystem));
+    
+    // Buses run at the mixer's own width and block, which is what every send in a mix sees
+    FMOD_SPEAKERMODE mixerMode = FMOD_SPEAKERMODE_DEFAULT;
+    FMOD_SPEAKERMODE outputMode = FMOD_SPEAKERMODE_DEFAULT;
+    system->channels = REVERB_DEFAULT_MAX_CHANNELS;
+    if (FMOD_DSP_GETSPEAKERMODE(dsp_state, &mixerMode, &outputMode) == FMOD_OK)
+    {
+        system->channels = GetSpeakerModeChannels(mixerMode);
+    }
+    
+    if (FMOD_DSP_GETBLOCKSIZE(dsp_state, &system->blockSize) != FMOD_OK || !system->blockSize)
+    {
+        system->blockSize = DELAY_UNIT_BLOCK_SAMPLES;
+    }
+    
+    // Everything a bus needs is made here, against the system rather than any one instance, so an instance picking
+    // a bus on the mixer thread only has to look it up
+    s_reverbSystems[systemobject] = system;
+    unsigned int samples = system->blockSize * system->channels;
+    for (int i = 0; i < REVERB_SHARED_BUSES; i++)
+    {
+        ReverbBus* bus = &system->buses[i];
+        bus->input = (float* )FMOD_DSP_ALLOC(dsp_state, samples * 2 * sizeof(float));
+        if (!bus->input)
+        {
+            SystemDeregister_Callback(dsp_state);
+            return FMOD_ERR_MEMORY;
+        }
+        memset(bus->input, 0, samples * 2 * sizeof(float));
+        bus->output = bus->input + samples;
+        
+        // Sized like any instance, from the mixer's speaker mode, so the bus never has to grow its arena
+        void* memory = FMOD_DSP_ALLOC(dsp_state, sizeof(Plugin));
+        if (!memory)
+        {
+            SystemDeregister_Callback(dsp_state);
+            return FMOD_ERR_MEMORY;
+        }
+        
+        bus->tank = new (memory) Plugin();
+        FMOD_RESULT result = bus->tank->Init(dsp_state);
+        if (result != FMOD_OK)
+        {
+            SystemDeregister_Callback(dsp_state);
+            return result;
+        }
+    }
+    
     return FMOD_OK;
 }
 
 FMOD_RESULT SystemDeregister_Callback           (FMOD_DSP_STATE *dsp_state)
 {
+    int systemobject = dsp_state->systemobject;
+    if (systemobject < 0 || systemobject >= REVERB_MAX_SYSTEMS || !s_reverbSystems[systemobject])
+    {
+        return FMOD_OK;
+    }
+    
+    ReverbSystem* system = s_reverbSystems[systemobject];
+    for (int i = 0; i < REVERB_SHARED_BUSES; i++)
+    {
+        ReverbBus* bus = &system->buses[i];
+        if (bus->tank)
+        {
+            bus->tank->Release(dsp_state);
+            bus->tank->~Plugin();
+            FMOD_DSP_FREE(dsp_state, bus->tank);
+        }
+        if (bus->input)
+        {
+            FMOD_DSP_FREE(dsp_state, bus->input);
+        }
+    }
+    
+    FMOD_DSP_FREE(dsp_state, system);
+    s_reverbSystems[systemobject] = nullptr;
     return FMOD_OK;
 }
 
 FMOD_RESULT SystemMix_Callback                  (FMOD_DSP_STATE *dsp_state, int stage)
 {
+    // Once every instance has sent for this mix, run each bus's tank once for the next mix to hear
+    int systemobject = dsp_state->systemobject;
+    if (stage != 1 || systemobject < 0 || systemobject >= REVERB_MAX_SYSTEMS || !s_reverbSystems[systemobject])
+    {
+        return FMOD_OK;
+    }
+    
+    DenormalGuard guard;
+    ReverbSystem* system = s_reverbSystems[systemobject];
+    for (int i = 0; i < REVERB_SHARED_BUSES; i++)
+    {
+        ReverbBus* bus = &system->buses[i];
+        if (bus->tank)
+        {
+            bus->tank->ReadBus(system, bus, dsp_state);
+        }
+    }
     return FMOD_OK;
 }
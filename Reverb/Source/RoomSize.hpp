@@ -0,0 +1,29 @@
+//
+//  RoomSize.hpp
+//  Reverb
+//
+//  Size of the room the reverb models, as a scale on the reference room. It spreads out the early reflections and
+//  stretches every diffuser and tank line, so each line's memory is sized for the largest room up front
+//
+
+#ifndef RoomSize_hpp
+#define RoomSize_hpp
+
+/// Smallest and largest room. No pass is longer than the shortest diffuser, so the smallest room halves the pass, and
+/// the largest at most doubles the power of two each line is stored in
+constexpr float ROOM_SIZE_MIN = 0.5f;
+constexpr float ROOM_SIZE_MAX = 1.5f;
+
+/// Samples back a tap a number of samples back in the reference room is in a room of a size
+inline int RoomSizeTap(int sample, float size)
+{
+    return (int)((sample * size) + 0.5f);
+}
+
+/// Samples a line needs to reach a tap a number of samples back in the reference room in the largest room
+constexpr int RoomSizeMaxLength(int sample)
+{
+    return (int)(sample * ROOM_SIZE_MAX) + 1;
+}
+
+#endif /* RoomSize_hpp */
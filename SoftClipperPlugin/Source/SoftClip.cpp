@@ -8,6 +8,7 @@
 //  This file is a 'blank' plugin that does not process audio and only lets it pass through
 
 #include <math.h>
+#include <new>
 #include <stdio.h>
 #include <string>
 
@@ -103,7 +104,7 @@ extern "C"
 class Plugin
 {
 public:
-    Plugin() { }
+    Plugin() : m_clipPercent(0) { }
     void Read (float* inbuffer, float* outbuffer, unsigned int length, int channels);
     void SetClipPercent(float value) { m_clipPercent = value; }
     float GetClipPercent () const { return m_clipPercent; }
@@ -148,12 +149,12 @@ void Plugin::Read(float *inbuffer, float *outbuffer, unsigned int length, int ch
 
 FMOD_RESULT Create_Callback                     (FMOD_DSP_STATE *dsp_state)
 {
-    Plugin* state = (Plugin* )FMOD_DSP_ALLOC(dsp_state, sizeof(Plugin));
-    dsp_state->plugindata = state;
-    if (!dsp_state->plugindata)
+    void* memory = FMOD_DSP_ALLOC(dsp_state, sizeof(Plugin));
+    if (!memory)
     {
         return FMOD_ERR_MEMORY;
     }
+    dsp_state->plugindata = new (memory) Plugin();
     
     return FMOD_OK;
 }
@@ -161,6 +162,7 @@ FMOD_RESULT Create_Callback                     (FMOD_DSP_STATE *dsp_state)
 FMOD_RESULT Release_Callback                    (FMOD_DSP_STATE *dsp_state)
 {
     Plugin* state = (Plugin* )dsp_state->plugindata;
+    state->~Plugin();
     FMOD_DSP_FREE(dsp_state, state);
     
     return FMOD_OK;